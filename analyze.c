@@ -0,0 +1,447 @@
+/*
+ *  analyze.c
+ *  Contains the static dependency analysis of a loaded program
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+
+static const char* model_names[NUM_MODELS] = { "ideal", "forwarding",
+                                                "no forwarding" };
+
+/* Pipeline stages which matter for the timing models */
+typedef struct Stages
+{
+  int decode;     // Last decode stage, reads registers
+  int execute;    // Last execute stage, ALU and address generation
+  int memory;     // Last memory stage, data access
+  int writeback;
+} Stages;
+
+static int
+valid_register(int reg)
+{
+  return reg >= 0 && reg < 32;
+}
+
+/*
+ * Fills the registers node reads and writes, returns -1 for an unknown
+ * opcode
+ */
+static int
+operands(const APEX_Instruction* ins, Analysis_Node* node)
+{
+  node->dest = -1;
+  node->src[0] = -1;
+  node->src[1] = -1;
+
+  if (!strcmp(ins->opcode, "MOVC")) {
+    node->dest = ins->rd;
+  } else if (!strcmp(ins->opcode, "ADDL") || !strcmp(ins->opcode, "LOAD")) {
+    node->dest = ins->rd;
+    node->src[0] = ins->rs1;
+  } else if (!strcmp(ins->opcode, "SUB")) {
+    node->dest = ins->rd;
+    node->src[0] = ins->rs1;
+    node->src[1] = ins->rs2;
+  } else if (!strcmp(ins->opcode, "STORE")) {
+    node->src[0] = ins->rs1;    // Data
+    node->src[1] = ins->rs2;    // Address
+  } else if (!strcmp(ins->opcode, "JUMP")) {
+    node->src[0] = ins->rs1;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Writes ins in the syntax of the input files
+ */
+void
+APEX_format_instruction(const APEX_Instruction* ins, char* buffer,
+                        size_t size)
+{
+  const char* op = ins->opcode;
+
+  if (!strcmp(op, "MOVC")) {
+    snprintf(buffer, size, "%s,R%d,#%d", op, ins->rd, ins->imm);
+  } else if (!strcmp(op, "ADDL") || !strcmp(op, "LOAD")) {
+    snprintf(buffer, size, "%s,R%d,R%d,#%d", op, ins->rd, ins->rs1, ins->imm);
+  } else if (!strcmp(op, "SUB")) {
+    snprintf(buffer, size, "%s,R%d,R%d,R%d", op, ins->rd, ins->rs1, ins->rs2);
+  } else if (!strcmp(op, "STORE")) {
+    snprintf(buffer, size, "%s,R%d,R%d,#%d", op, ins->rs1, ins->rs2,
+             ins->imm);
+  } else if (!strcmp(op, "JUMP")) {
+    snprintf(buffer, size, "%s,R%d,#%d", op, ins->rs1, ins->imm);
+  } else {
+    snprintf(buffer, size, "%.32s", op);
+  }
+}
+
+static int
+pc_of(int index)
+{
+  return 4000 + 4 * index;
+}
+
+/* Stage at the end of which the result of ins can be forwarded */
+static int
+ready_stage(const APEX_Instruction* ins, const Stages* stages)
+{
+  if (!strcmp(ins->opcode, "MOVC")) {
+    return stages->decode;
+  }
+  if (!strcmp(ins->opcode, "LOAD")) {
+    return stages->memory;
+  }
+  return stages->execute;
+}
+
+/* Stage which operand j of ins has to enter with its value */
+static int
+need_stage(const APEX_Instruction* ins, int j, const Stages* stages,
+           int model)
+{
+  if (model == MODEL_NO_FORWARDING) {
+    return stages->decode + 1;
+  }
+  if (j == 0 && !strcmp(ins->opcode, "STORE")) {
+    return stages->memory;
+  }
+  return stages->execute;
+}
+
+/*
+ * Schedules the program in order through the pipeline under model, fills
+ * stall and cause of every node and returns the cycles to the last
+ * writeback
+ */
+static long
+schedule(APEX_CPU* cpu, APEX_Analysis* analysis, const Stages* stages,
+         int model)
+{
+  int n = cpu->num_stages;
+  long enter[APEX_MAX_STAGES];
+  long previous[APEX_MAX_STAGES];
+  long* ready = malloc(analysis->num_instructions * sizeof(long));
+  long end = 0;
+
+  if (!ready) {
+    return -1;
+  }
+  for (int i = 0; i < analysis->num_instructions; ++i) {
+    const APEX_Instruction* ins = &cpu->code_memory[i];
+    Analysis_Node* node = &analysis->nodes[i];
+
+    node->stall[model] = 0;
+    node->cause[model] = -1;
+    for (int k = 0; k < n; ++k) {
+      long t = 0;
+      if (k) {
+        t = enter[k - 1] + cpu->pipeline[k - 1].latency;
+      }
+      if (i && previous[k] + cpu->pipeline[k].latency > t) {
+        t = previous[k] + cpu->pipeline[k].latency;
+      }
+      for (int j = 0; j < 2 && model != MODEL_IDEAL; ++j) {
+        int p = node->producer[j];
+        if (p < 0 || k != need_stage(ins, j, stages, model) ||
+            ready[p] <= t) {
+          continue;
+        }
+        node->stall[model] += ready[p] - t;
+        node->cause[model] = p;
+        t = ready[p];
+      }
+      enter[k] = t;
+    }
+
+    int r = model == MODEL_NO_FORWARDING ? stages->writeback
+                                         : ready_stage(ins, stages);
+    ready[i] = enter[r] + cpu->pipeline[r].latency;
+    end = enter[n - 1] + cpu->pipeline[n - 1].latency;
+    memcpy(previous, enter, sizeof(enter));
+  }
+  free(ready);
+  return end;
+}
+
+/*
+ * Prints the dependencies on the critical path of model, found by
+ * following the producer which delayed an instruction, or its predecessor
+ * in program order if none did
+ */
+static void
+print_critical_path(APEX_CPU* cpu, APEX_Analysis* analysis, int model,
+                    FILE* out)
+{
+  long edges = 0;
+  long stalls = 0;
+
+  /* First pass for the totals, the second prints the dependencies */
+  for (int pass = 0; pass < 2; ++pass) {
+    long printed = 0;
+    for (int i = analysis->num_instructions - 1; i >= 0;) {
+      Analysis_Node* node = &analysis->nodes[i];
+      int p = node->cause[model];
+      if (p < 0) {
+        i--;
+        continue;
+      }
+      if (!pass) {
+        edges++;
+        stalls += node->stall[model];
+      } else if (printed++ < ANALYZE_PRINT_LIMIT) {
+        char consumer[64];
+        char producer[64];
+        APEX_format_instruction(&cpu->code_memory[i], consumer,
+                                sizeof(consumer));
+        APEX_format_instruction(&cpu->code_memory[p], producer,
+                                sizeof(producer));
+        fprintf(out,
+                "APEX_ANALYZE :   pc(%d) %s waits %d cycles for pc(%d) %s\n",
+                pc_of(i), consumer, node->stall[model], pc_of(p), producer);
+      }
+      i = p;
+    }
+    if (!pass) {
+      fprintf(out,
+              "APEX_ANALYZE : critical path with %s: %ld dependencies, %ld "
+              "stall cycles\n",
+              model_names[model], edges, stalls);
+    }
+  }
+}
+
+/* Prints one hazard unless ANALYZE_PRINT_LIMIT of its kind were printed */
+static void
+hazard(FILE* out, long count, int i, const APEX_Instruction* ins,
+       const char* what)
+{
+  char text[64];
+
+  if (count > ANALYZE_PRINT_LIMIT) {
+    return;
+  }
+  APEX_format_instruction(ins, text, sizeof(text));
+  fprintf(out, "APEX_ANALYZE : pc(%d) %s: %s\n", pc_of(i), text, what);
+}
+
+/* Links operands to producers and flags the hazards of the program */
+static void
+build_graph(APEX_CPU* cpu, APEX_Analysis* analysis, const Stages* stages,
+            FILE* out)
+{
+  Analysis_Hazards* hazards = &analysis->hazards;
+  int writer[32];
+  int read_since[32];
+  long* depth = calloc(analysis->num_instructions, sizeof(long));
+  char what[128];
+
+  for (int r = 0; r < 32; ++r) {
+    writer[r] = -1;
+    read_since[r] = 1;
+  }
+
+  for (int i = 0; i < analysis->num_instructions; ++i) {
+    const APEX_Instruction* ins = &cpu->code_memory[i];
+    Analysis_Node* node = &analysis->nodes[i];
+
+    if (operands(ins, node) ||
+        (node->dest >= 0 && !valid_register(node->dest)) ||
+        (node->src[0] >= 0 && !valid_register(node->src[0])) ||
+        (node->src[1] >= 0 && !valid_register(node->src[1]))) {
+      hazard(out, ++hazards->invalid, i, ins,
+             "unknown opcode or register out of range, ignored");
+      node->dest = node->src[0] = node->src[1] = -1;
+    }
+
+    for (int j = 0; j < 2; ++j) {
+      int reg = node->src[j];
+      node->producer[j] = reg >= 0 ? writer[reg] : -1;
+      if (reg < 0) {
+        continue;
+      }
+      read_since[reg] = 1;
+      if (writer[reg] < 0) {
+        snprintf(what, sizeof(what),
+                 "reads R%d before any write, initial value 0", reg);
+        hazard(out, ++hazards->uninitialized, i, ins, what);
+        continue;
+      }
+      int p = writer[reg];
+      if (depth && depth[p] + 1 > depth[i]) {
+        depth[i] = depth[p] + 1;
+      }
+      if (!strcmp(ins->opcode, "ADDL") &&
+          strcmp(cpu->code_memory[p].opcode, "ADDL")) {
+        snprintf(what, sizeof(what),
+                 "reads R%d from pc(%d) %.16s, the ADDL interlock of the "
+                 "simulator only tracks ADDL results",
+                 reg, pc_of(p), cpu->code_memory[p].opcode);
+        hazard(out, ++hazards->legacy_interlock, i, ins, what);
+      }
+    }
+
+    if (node->dest >= 0) {
+      int reg = node->dest;
+      if (!read_since[reg]) {
+        snprintf(what, sizeof(what),
+                 "overwrites R%d of pc(%d) which was never read", reg,
+                 pc_of(writer[reg]));
+        hazard(out, ++hazards->dead_writes, i, ins, what);
+      }
+      writer[reg] = i;
+      read_since[reg] = 0;
+    }
+
+    if (!strcmp(ins->opcode, "JUMP")) {
+      snprintf(what, sizeof(what),
+               "control hazard, a taken jump squashes up to %d fetched "
+               "instructions",
+               stages->execute);
+      hazard(out, ++hazards->control, i, ins, what);
+    }
+
+    if (depth) {
+      depth[i] = depth[i] ? depth[i] : 1;
+      if (depth[i] > analysis->longest_chain) {
+        analysis->longest_chain = depth[i];
+      }
+    }
+  }
+  free(depth);
+}
+
+/* Flags the dependencies which stall under the interlocked models */
+static void
+report_stalls(APEX_CPU* cpu, APEX_Analysis* analysis, FILE* out)
+{
+  Analysis_Hazards* hazards = &analysis->hazards;
+  char what[128];
+
+  for (int i = 0; i < analysis->num_instructions; ++i) {
+    Analysis_Node* node = &analysis->nodes[i];
+    int p = node->cause[MODEL_NO_FORWARDING];
+    if (p < 0) {
+      continue;
+    }
+    int forwarded = node->stall[MODEL_FORWARDING];
+    hazards->raw++;
+    hazards->raw_forwarded += forwarded > 0;
+    int load_use =
+      forwarded > 0 && !strcmp(cpu->code_memory[p].opcode, "LOAD");
+    hazards->load_use += load_use;
+    snprintf(what, sizeof(what),
+             "RAW%s on pc(%d), %d stall cycles without forwarding, %d with",
+             load_use ? " load-use" : "", pc_of(p),
+             node->stall[MODEL_NO_FORWARDING], forwarded);
+    hazard(out, hazards->raw, i, &cpu->code_memory[i], what);
+  }
+}
+
+/*
+ * Analyzes the code memory of cpu for its configured pipeline and prints
+ * the report to out
+ */
+APEX_Analysis*
+APEX_analyze(APEX_CPU* cpu, FILE* out)
+{
+  APEX_Analysis* analysis = calloc(1, sizeof(*analysis));
+  Stages stages;
+
+  if (!analysis) {
+    return NULL;
+  }
+  analysis->num_instructions = cpu->code_memory_size;
+  analysis->nodes =
+    calloc(cpu->code_memory_size ? cpu->code_memory_size : 1,
+           sizeof(Analysis_Node));
+  if (!analysis->nodes) {
+    free(analysis);
+    return NULL;
+  }
+
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    switch (cpu->pipeline[s].kind) {
+      case STAGE_DECODE:
+        stages.decode = s;
+        break;
+      case STAGE_EXECUTE:
+        stages.execute = s;
+        break;
+      case STAGE_MEMORY:
+        stages.memory = s;
+        break;
+      case STAGE_WRITEBACK:
+        stages.writeback = s;
+        break;
+    }
+  }
+
+  fprintf(out, "APEX_ANALYZE : %d instructions on a %d stage pipeline\n",
+          analysis->num_instructions, cpu->num_stages);
+  build_graph(cpu, analysis, &stages, out);
+  for (int m = 0; m < NUM_MODELS; ++m) {
+    analysis->min_cycles[m] = schedule(cpu, analysis, &stages, m);
+  }
+  report_stalls(cpu, analysis, out);
+
+  Analysis_Hazards* hazards = &analysis->hazards;
+  fprintf(out,
+          "APEX_ANALYZE : hazards: %ld RAW (%ld stall with forwarding, %ld "
+          "load-use), %ld control, %ld uninitialized reads, %ld dead "
+          "writes, %ld ADDL legacy interlock, %ld invalid\n",
+          hazards->raw, hazards->raw_forwarded, hazards->load_use,
+          hazards->control, hazards->uninitialized, hazards->dead_writes,
+          hazards->legacy_interlock, hazards->invalid);
+  fprintf(out, "APEX_ANALYZE : longest def-use chain %ld instructions\n",
+          analysis->longest_chain);
+  print_critical_path(cpu, analysis, MODEL_FORWARDING, out);
+  print_critical_path(cpu, analysis, MODEL_NO_FORWARDING, out);
+  for (int m = 0; m < NUM_MODELS; ++m) {
+    long cycles = analysis->min_cycles[m];
+    fprintf(out,
+            "APEX_ANALYZE : %-13s minimum %ld cycles, IPC bound %.4f\n",
+            model_names[m], cycles,
+            cycles > 0 ? (double)analysis->num_instructions / cycles : 0.0);
+  }
+  return analysis;
+}
+
+/*
+ * Compares the simulated cycles with the bounds, called at the end
+ */
+void
+APEX_analysis_compare(APEX_Analysis* analysis, APEX_CPU* cpu, FILE* out)
+{
+  if (cpu->ins_completed < analysis->num_instructions) {
+    fprintf(out,
+            "APEX_ANALYZE : simulation stopped after %d cycles, before the "
+            "end of the program\n",
+            cpu->clock);
+    return;
+  }
+  fprintf(out, "APEX_ANALYZE : simulated %d cycles, IPC %.4f", cpu->clock,
+          cpu->clock ? (double)analysis->num_instructions / cpu->clock
+                     : 0.0);
+  for (int m = 0; m < NUM_MODELS; ++m) {
+    if (analysis->min_cycles[m] > 0) {
+      fprintf(out, ", %.2fx %s", (double)cpu->clock / analysis->min_cycles[m],
+              model_names[m]);
+    }
+  }
+  fputc('\n', out);
+}
+
+void
+APEX_analysis_free(APEX_Analysis* analysis)
+{
+  if (analysis) {
+    free(analysis->nodes);
+    free(analysis);
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef _APEX_ANALYZE_H_
+#define _APEX_ANALYZE_H_
+/**
+ *  analyze.h
+ *  Contains the static dependency analysis of a loaded program.
+ *
+ *  The register dataflow graph links every source operand to the last
+ *  instruction writing its register. Instructions are then scheduled in
+ *  program order through the configured pipeline, every stage holding one
+ *  instruction for its latency, under three models: no hazards at all,
+ *  interlocks with full forwarding and interlocks which read registers in
+ *  decode only. The last writeback gives the minimum number of cycles of
+ *  each model, an upper bound on the IPC the cycle accurate simulation can
+ *  reach. JUMPs are assumed to fall through, the bound is for the program
+ *  as a straight line.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* Timing models */
+enum
+{
+  MODEL_IDEAL,          // No data hazards
+  MODEL_FORWARDING,     // Results forwarded from the stage producing them
+  MODEL_NO_FORWARDING,  // Operands read in decode after the writeback
+  NUM_MODELS
+};
+
+/* Stall cycles printed per hazard kind before only counting */
+#define ANALYZE_PRINT_LIMIT 16
+
+/* Operands of one instruction in the dataflow graph */
+typedef struct Analysis_Node
+{
+  int dest;             // Register written, -1 for none
+  int src[2];           // Registers read, -1 for none
+  int producer[2];      // Instruction writing src last, -1 for the initial
+  int stall[NUM_MODELS];
+  int cause[NUM_MODELS];  // Producer which delayed it, -1 for none
+} Analysis_Node;
+
+typedef struct Analysis_Hazards
+{
+  long raw;             // Dependencies which stall without forwarding
+  long raw_forwarded;   // ... and still stall with it
+  long load_use;
+  long control;         // JUMPs, taken ones squash the fetched instructions
+  long uninitialized;   // Reads of registers no instruction wrote
+  long dead_writes;     // Overwritten before being read
+  long legacy_interlock;  // ADDL reading a MOVC, SUB or LOAD result
+  long invalid;         // Unknown opcode or register out of range
+} Analysis_Hazards;
+
+typedef struct APEX_Analysis
+{
+  int num_instructions;
+  Analysis_Node* nodes;
+  long min_cycles[NUM_MODELS];
+  long longest_chain;   // Instructions on the longest def-use chain
+  Analysis_Hazards hazards;
+} APEX_Analysis;
+
+APEX_Analysis*
+APEX_analyze(APEX_CPU* cpu, FILE* out);
+
+void
+APEX_analysis_compare(APEX_Analysis* analysis, APEX_CPU* cpu, FILE* out);
+
+void
+APEX_analysis_free(APEX_Analysis* analysis);
+
+void
+APEX_format_instruction(const APEX_Instruction* ins, char* buffer,
+                        size_t size);
+
+#endif
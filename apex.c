@@ -0,0 +1,263 @@
+/*
+ *  apex.c
+ *  Contains libapex, the simulator behind the interface of apex.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "apex.h"
+#include "assembler.h"
+#include "cpu.h"
+#include "fastforward.h"
+#include "replay.h"
+#include "smt.h"
+#include "vpred.h"
+
+#define DATA_WORDS (int)(sizeof(((APEX_CPU*)0)->data_memory) / sizeof(int))
+
+struct APEX_Sim
+{
+  APEX_CPU* cpu;
+  int started;          // Fast-forward and analysis done
+  int failed;
+
+  long loads;
+  long stores;
+
+  APEX_Retire_Callback on_retire;
+  void* retire_user;
+  APEX_Memory_Callback on_memory;
+  void* memory_user;
+};
+
+int
+APEX_api_version(void)
+{
+  return APEX_API_VERSION;
+}
+
+/* Register file of a hardware thread, thread 0 runs on that of the cpu */
+static int*
+thread_regs(APEX_CPU* cpu, int thread)
+{
+  return thread ? cpu->smt->context[thread].regs : cpu->regs;
+}
+
+static void
+retire_hook(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Sim* sim = cpu->hook_context;
+  APEX_Retire_Event event;
+
+  /* Past the end of code memory empty instructions flow through */
+  if (stage->pc < 4000 || (stage->pc - 4000) / 4 >= cpu->code_memory_size) {
+    return;
+  }
+  event.cycle = cpu->clock;
+  event.pc = stage->pc;
+  event.opcode = stage->opcode;
+  event.rd = -1;
+  event.value = 0;
+  event.thread = stage->thread;
+  if (!strcmp(stage->opcode, "MOVC") || !strcmp(stage->opcode, "ADDL") ||
+      !strcmp(stage->opcode, "SUB") || !strcmp(stage->opcode, "LOAD")) {
+    event.rd = stage->rd;
+    event.value = thread_regs(cpu, stage->thread)[stage->rd];
+  }
+  sim->on_retire(sim->retire_user, &event);
+}
+
+static void
+access_hook(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Sim* sim = cpu->hook_context;
+  APEX_Memory_Event event;
+
+  event.is_store = !strcmp(stage->opcode, "STORE");
+  if (event.is_store) {
+    sim->stores++;
+  } else {
+    sim->loads++;
+  }
+  if (!sim->on_memory) {
+    return;
+  }
+  event.cycle = cpu->clock;
+  event.pc = stage->pc;
+  event.address = stage->mem_address;
+  event.value = event.is_store ? stage->rs1_value : stage->buffer;
+  sim->on_memory(sim->memory_user, &event);
+}
+
+APEX_Sim*
+APEX_sim_create(const char* program, size_t length)
+{
+  APEX_Program assembled;
+  if (APEX_assemble_buffer(program, length, &assembled)) {
+    return NULL;
+  }
+
+  APEX_Sim* sim = calloc(1, sizeof(*sim));
+  APEX_CPU* cpu = sim ? APEX_cpu_init_program(&assembled) : NULL;
+  if (!cpu) {
+    free(sim);
+    APEX_program_free(&assembled);
+    return NULL;
+  }
+  cpu->owns_code_memory = 1;
+  free(assembled.data);
+  cpu->debug_messages = 0;
+  cpu->access_hook = access_hook;
+  cpu->hook_context = sim;
+  sim->cpu = cpu;
+  return sim;
+}
+
+int
+APEX_sim_set_option(APEX_Sim* sim, const char* name, const char* value)
+{
+  if (sim->started) {
+    return -1;
+  }
+  return APEX_cpu_set_option(sim->cpu, name, value);
+}
+
+/*
+ * Runs what apex_sim does before the first cycle
+ */
+static int
+start(APEX_Sim* sim)
+{
+  APEX_CPU* cpu = sim->cpu;
+
+  sim->started = 1;
+  if (cpu->analyze) {
+    cpu->analysis = APEX_analyze(cpu, stderr);
+  }
+  if (cpu->ff_instructions && APEX_cpu_fast_forward(cpu)) {
+    sim->failed = 1;
+  }
+  if (!sim->failed && cpu->replay && APEX_replay_start(cpu)) {
+    sim->failed = 1;
+  }
+  return sim->failed ? -1 : 0;
+}
+
+long
+APEX_sim_step(APEX_Sim* sim, long cycles)
+{
+  APEX_CPU* cpu = sim->cpu;
+  long n;
+
+  if ((!sim->started && start(sim)) || sim->failed) {
+    return -1;
+  }
+  for (n = 0; n < cycles && !APEX_cpu_drained(cpu); ++n) {
+    if (APEX_cpu_step(cpu)) {
+      sim->failed = 1;
+      return -1;
+    }
+  }
+  return n;
+}
+
+int
+APEX_sim_run(APEX_Sim* sim, long max_cycles)
+{
+  long left = max_cycles - sim->cpu->clock;
+
+  if (left > 0 && APEX_sim_step(sim, left) < 0) {
+    return -1;
+  }
+  return APEX_cpu_drained(sim->cpu) ? 0 : 1;
+}
+
+int
+APEX_sim_get_register(APEX_Sim* sim, int reg, int* value)
+{
+  return APEX_sim_get_thread_register(sim, 0, reg, value);
+}
+
+int
+APEX_sim_get_thread_register(APEX_Sim* sim, int thread, int reg, int* value)
+{
+  APEX_CPU* cpu = sim->cpu;
+  int num_threads = cpu->smt ? cpu->smt->num_threads : 1;
+
+  if (thread < 0 || thread >= num_threads || reg < 0 || reg >= 32) {
+    return -1;
+  }
+  *value = thread_regs(cpu, thread)[reg];
+  return 0;
+}
+
+static int
+valid_range(int address, int count)
+{
+  return address >= 0 && count >= 0 && count <= DATA_WORDS - address;
+}
+
+int
+APEX_sim_read_memory(APEX_Sim* sim, int address, int* words, int count)
+{
+  if (!valid_range(address, count)) {
+    return -1;
+  }
+  memcpy(words, &sim->cpu->data_memory[address], count * sizeof(int));
+  return 0;
+}
+
+int
+APEX_sim_write_memory(APEX_Sim* sim, int address, const int* words,
+                      int count)
+{
+  if (!valid_range(address, count)) {
+    return -1;
+  }
+  memcpy(&sim->cpu->data_memory[address], words, count * sizeof(int));
+  return 0;
+}
+
+void
+APEX_sim_get_counters(APEX_Sim* sim, APEX_Counters* counters)
+{
+  APEX_CPU* cpu = sim->cpu;
+
+  counters->cycles = cpu->clock;
+  counters->instructions = cpu->ins_completed;
+  counters->stall_cycles = cpu->clock_stalled_cycles;
+  if (cpu->vpred) {
+    counters->stall_cycles += cpu->vpred->interlock_cycles;
+  }
+  counters->loads = sim->loads;
+  counters->stores = sim->stores;
+  counters->bad_accesses = cpu->bad_accesses;
+  counters->pc = cpu->pc;
+  counters->finished = APEX_cpu_drained(cpu);
+}
+
+void
+APEX_sim_on_retire(APEX_Sim* sim, APEX_Retire_Callback callback, void* user)
+{
+  sim->on_retire = callback;
+  sim->retire_user = user;
+  sim->cpu->retire_hook = callback ? retire_hook : NULL;
+  sim->cpu->variant = NULL;
+}
+
+void
+APEX_sim_on_memory(APEX_Sim* sim, APEX_Memory_Callback callback, void* user)
+{
+  sim->on_memory = callback;
+  sim->memory_user = user;
+}
+
+void
+APEX_sim_destroy(APEX_Sim* sim)
+{
+  if (sim) {
+    APEX_cpu_stop(sim->cpu);
+    free(sim);
+  }
+}
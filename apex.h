@@ -0,0 +1,120 @@
+#ifndef _APEX_H_
+#define _APEX_H_
+/**
+ *  apex.h
+ *  Contains the interface of libapex, the simulator as a library.
+ *
+ *  A simulator is created from a program held in memory, configured with
+ *  the runtime options of apex_sim and stepped cycle by cycle or run to the
+ *  end. Registers, data memory and counters can be read between steps, and
+ *  callbacks observe every retired instruction and data access. Nothing is
+ *  printed, except the reports of optional models (load/store queue,
+ *  predictors, energy, analysis) to stderr when the simulator is destroyed.
+ *
+ *  Only this header is needed to link against libapex.a. Simulators are
+ *  independent, different threads may drive different simulators.
+ */
+#include <stddef.h>
+
+/* Incremented when the interface changes incompatibly */
+#define APEX_API_VERSION 1
+
+typedef struct APEX_Sim APEX_Sim;
+
+/* Instruction leaving writeback. The model may retire an instruction again
+ * while decode stalls, as apex_sim does
+ */
+typedef struct APEX_Retire_Event
+{
+  long cycle;
+  int pc;
+  const char* opcode;
+  int rd;               // Register written, -1 for none
+  int value;            // Value written to rd
+  int thread;           // Hardware thread, 0 without --threads
+} APEX_Retire_Event;
+
+/* LOAD or STORE in the last memory stage */
+typedef struct APEX_Memory_Event
+{
+  long cycle;
+  int pc;
+  int is_store;
+  int address;          // Word address, accesses outside data memory are
+  int value;            // ignored and loads read 0
+} APEX_Memory_Event;
+
+typedef void (*APEX_Retire_Callback)(void* user,
+                                     const APEX_Retire_Event* event);
+typedef void (*APEX_Memory_Callback)(void* user,
+                                     const APEX_Memory_Event* event);
+
+typedef struct APEX_Counters
+{
+  long cycles;
+  long instructions;    // Retired, as counted by apex_sim
+  long stall_cycles;    // Decode waiting for an operand
+  long loads;
+  long stores;
+  long bad_accesses;    // LOADs and STOREs outside data memory
+  int pc;               // Next pc to fetch
+  int finished;         // Last instruction left the pipeline
+} APEX_Counters;
+
+int
+APEX_api_version(void);
+
+/* Assembles program, the source of an apex_sim input file without
+ * includes, and preloads its data. Returns NULL if it is empty or invalid.
+ */
+APEX_Sim*
+APEX_sim_create(const char* program, size_t length);
+
+/* Sets a runtime option as --name=value of apex_sim, before the first
+ * step. Returns 0 on success.
+ */
+int
+APEX_sim_set_option(APEX_Sim* sim, const char* name, const char* value);
+
+/* Simulates up to cycles cycles, fewer once the program finished. Returns
+ * the cycles simulated, -1 on an error.
+ */
+long
+APEX_sim_step(APEX_Sim* sim, long cycles);
+
+/* Simulates until the program finished or max_cycles have been simulated
+ * in total, returns 0 if it finished
+ */
+int
+APEX_sim_run(APEX_Sim* sim, long max_cycles);
+
+/* Register of thread 0, the only one without --threads */
+int
+APEX_sim_get_register(APEX_Sim* sim, int reg, int* value);
+
+int
+APEX_sim_get_thread_register(APEX_Sim* sim, int thread, int reg,
+                             int* value);
+
+int
+APEX_sim_read_memory(APEX_Sim* sim, int address, int* words, int count);
+
+int
+APEX_sim_write_memory(APEX_Sim* sim, int address, const int* words,
+                      int count);
+
+void
+APEX_sim_get_counters(APEX_Sim* sim, APEX_Counters* counters);
+
+void
+APEX_sim_on_retire(APEX_Sim* sim, APEX_Retire_Callback callback,
+                   void* user);
+
+void
+APEX_sim_on_memory(APEX_Sim* sim, APEX_Memory_Callback callback,
+                   void* user);
+
+void
+APEX_sim_destroy(APEX_Sim* sim);
+
+#endif
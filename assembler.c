@@ -0,0 +1,954 @@
+/*
+ *  assembler.c
+ *  Contains the assembler front end and linker of APEX programs
+ */
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "assembler.h"
+
+#define DATA_WORDS (int)(sizeof(((APEX_CPU*)0)->data_memory) / sizeof(int))
+
+#define FNV_OFFSET 0xcbf29ce484222325ul
+#define FNV_PRIME 0x100000001b3ul
+
+enum
+{
+  SECTION_TEXT,
+  SECTION_DATA
+};
+
+/* Fields of each opcode in the order they are written: d for rd, s for
+ * rs1, t for rs2 and i for the immediate
+ */
+static const struct
+{
+  const char* opcode;
+  const char* fields;
+} formats[] = {
+  { "MOVC", "di" }, { "STORE", "sti" }, { "ADDL", "dsi" },
+  { "SUB", "dst" }, { "LOAD", "dsi" },  { "JUMP", "si" },
+};
+
+#define NUM_FORMATS (int)(sizeof(formats) / sizeof(formats[0]))
+
+/* Label, offset from the start of its section in its file */
+typedef struct Asm_Symbol
+{
+  char* name;
+  int section;
+  int offset;
+  long value;             // Pc or address, once laid out
+  const char* file;
+  int line;
+} Asm_Symbol;
+
+/* Immediate or data word to fill in with the value of a label once linked */
+typedef struct Asm_Fixup
+{
+  int section;
+  int offset;
+  char* symbol;
+  long addend;
+  const char* file;
+  int line;
+} Asm_Fixup;
+
+/* A file given to the assembler with the files it includes */
+typedef struct Asm_Unit
+{
+  const char* path;
+  const char* text;       // Source held in memory, NULL to read path
+  size_t length;
+  int section;
+
+  APEX_Instruction* code;
+  int code_size;
+  int code_capacity;
+  int* data;
+  int data_size;
+  int data_capacity;
+  Asm_Symbol* symbols;
+  int num_symbols;
+  int symbol_capacity;
+  Asm_Fixup* fixups;
+  int num_fixups;
+  int fixup_capacity;
+
+  /* Names of the file and its includes, symbols and fixups point to them */
+  char** files;
+  int num_files;
+  int file_capacity;
+
+  int code_base;
+  int data_base;
+
+  char error[256];        // First error, empty if none
+} Asm_Unit;
+
+typedef struct Asm_Link
+{
+  Asm_Unit* units;
+  int num_units;
+  int resolve;            // 0 while parsing, 1 while resolving
+
+  /* Every symbol of the program, open addressing */
+  Asm_Symbol** table;
+  unsigned long table_mask;
+
+  APEX_Program* program;
+
+  pthread_mutex_t lock;
+  int next_unit;
+} Asm_Link;
+
+static void
+unit_error(Asm_Unit* unit, const char* file, int line, const char* format, ...)
+{
+  if (unit->error[0]) {
+    return;
+  }
+  int len =
+    snprintf(unit->error, sizeof(unit->error), "%s line %d: ", file, line);
+  va_list args;
+  va_start(args, format);
+  vsnprintf(unit->error + len, sizeof(unit->error) - len, format, args);
+  va_end(args);
+}
+
+/* Makes room for one more element of size in array */
+static int
+grow(void** array, int* capacity, int count, size_t size)
+{
+  if (count < *capacity) {
+    return 0;
+  }
+  int new_capacity = *capacity ? *capacity * 2 : 64;
+  void* grown = realloc(*array, new_capacity * size);
+  if (!grown) {
+    return -1;
+  }
+  *array = grown;
+  *capacity = new_capacity;
+  return 0;
+}
+
+static char*
+trim(char* text)
+{
+  while (isspace((unsigned char)*text)) {
+    text++;
+  }
+  char* end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1])) {
+    *--end = '\0';
+  }
+  return text;
+}
+
+static int
+label_start(char c)
+{
+  return isalpha((unsigned char)c) || c == '_' || c == '.';
+}
+
+static int
+label_char(char c)
+{
+  return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+/* Reads the whole file into a string, NULL if it cannot be read */
+static char*
+read_file(const char* path)
+{
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    return NULL;
+  }
+
+  char* text = NULL;
+  size_t len = 0;
+  size_t capacity = 0;
+  size_t nread;
+  do {
+    if (len + 1 >= capacity) {
+      capacity = capacity ? capacity * 2 : 65536;
+      char* grown = realloc(text, capacity);
+      if (!grown) {
+        free(text);
+        fclose(fp);
+        return NULL;
+      }
+      text = grown;
+    }
+    nread = fread(text + len, 1, capacity - len - 1, fp);
+    len += nread;
+  } while (nread);
+
+  int failed = ferror(fp);
+  fclose(fp);
+  if (failed) {
+    free(text);
+    return NULL;
+  }
+  text[len] = '\0';
+  return text;
+}
+
+static int
+parse_number(const char* text, long* value)
+{
+  char* end;
+
+  if (!isdigit((unsigned char)text[text[0] == '-' || text[0] == '+'])) {
+    return -1;
+  }
+  *value = strtol(text, &end, 10);
+  return *end != '\0' || *value < INT_MIN || *value > INT_MAX ? -1 : 0;
+}
+
+/*
+ * Parses a number or label[+-number] into the word at offset of section,
+ * a label is filled in when linked
+ */
+static int
+parse_value(Asm_Unit* unit, char* text, int section, int offset, int* word,
+            const char* file, int line)
+{
+  long value;
+
+  if (!parse_number(text, &value)) {
+    *word = value;
+    return 0;
+  }
+  if (!label_start(text[0])) {
+    unit_error(unit, file, line, "invalid value '%s'", text);
+    return -1;
+  }
+
+  char* end = text;
+  while (label_char(*end)) {
+    end++;
+  }
+  long addend = 0;
+  if (*end && (!strchr("+-", *end) || parse_number(end, &addend))) {
+    unit_error(unit, file, line, "invalid value '%s'", text);
+    return -1;
+  }
+
+  if (grow((void**)&unit->fixups, &unit->fixup_capacity, unit->num_fixups,
+           sizeof(Asm_Fixup))) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  Asm_Fixup* fixup = &unit->fixups[unit->num_fixups];
+  fixup->symbol = strndup(text, end - text);
+  if (!fixup->symbol) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  fixup->section = section;
+  fixup->offset = offset;
+  fixup->addend = addend;
+  fixup->file = file;
+  fixup->line = line;
+  unit->num_fixups++;
+  *word = 0;
+  return 0;
+}
+
+static int
+parse_register(Asm_Unit* unit, const char* text, int* reg, const char* file,
+               int line)
+{
+  long value;
+
+  if ((text[0] != 'R' && text[0] != 'r') || !isdigit((unsigned char)text[1]) ||
+      parse_number(text + 1, &value)) {
+    unit_error(unit, file, line, "expected a register, got '%s'", text);
+    return -1;
+  }
+  if (value < 0 || value >= 32) {
+    unit_error(unit, file, line, "register out of range");
+    return -1;
+  }
+  *reg = value;
+  return 0;
+}
+
+/* Splits text at commas into at most max trimmed operands */
+static int
+split_operands(char* text, char** operands, int max)
+{
+  int count = 0;
+
+  if (!*text) {
+    return 0;
+  }
+  for (;;) {
+    char* comma = strchr(text, ',');
+    if (comma) {
+      *comma = '\0';
+    }
+    if (count == max) {
+      return max + 1;
+    }
+    operands[count++] = trim(text);
+    if (!comma) {
+      return count;
+    }
+    text = comma + 1;
+  }
+}
+
+static int
+parse_instruction(Asm_Unit* unit, char* text, const char* file, int line)
+{
+  char* end = text;
+  while (*end && *end != ',' && !isspace((unsigned char)*end)) {
+    end++;
+  }
+  char* rest = end;
+  while (isspace((unsigned char)*rest)) {
+    rest++;
+  }
+  if (*rest == ',') {
+    rest++;
+  }
+  *end = '\0';
+
+  if (unit->section != SECTION_TEXT) {
+    unit_error(unit, file, line, "instruction in the data section");
+    return -1;
+  }
+  if (grow((void**)&unit->code, &unit->code_capacity, unit->code_size,
+           sizeof(APEX_Instruction))) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  /* Zeroed, not every instruction format sets all fields */
+  APEX_Instruction* ins = &unit->code[unit->code_size];
+  memset(ins, 0, sizeof(*ins));
+
+  int f = 0;
+  while (f < NUM_FORMATS && strcasecmp(text, formats[f].opcode)) {
+    f++;
+  }
+  if (f == NUM_FORMATS) {
+    /* Opcodes the stages do not implement pass through the pipeline doing
+     * nothing, as they always did, their operands are not read
+     */
+    snprintf(ins->opcode, sizeof(ins->opcode), "%s", text);
+    unit->code_size++;
+    return 0;
+  }
+  strcpy(ins->opcode, formats[f].opcode);
+
+  const char* fields = formats[f].fields;
+  int num_fields = strlen(fields);
+  char* operands[4];
+  if (split_operands(rest, operands, num_fields) != num_fields) {
+    unit_error(unit, file, line, "%s takes %d operands", formats[f].opcode,
+               num_fields);
+    return -1;
+  }
+
+  for (int i = 0; i < num_fields; ++i) {
+    int status;
+    switch (fields[i]) {
+      case 'd':
+        status = parse_register(unit, operands[i], &ins->rd, file, line);
+        break;
+      case 's':
+        status = parse_register(unit, operands[i], &ins->rs1, file, line);
+        break;
+      case 't':
+        status = parse_register(unit, operands[i], &ins->rs2, file, line);
+        break;
+      default:
+        if (operands[i][0] != '#') {
+          unit_error(unit, file, line, "expected an immediate, got '%s'",
+                     operands[i]);
+          return -1;
+        }
+        status = parse_value(unit, operands[i] + 1, SECTION_TEXT,
+                             unit->code_size, &ins->imm, file, line);
+        break;
+    }
+    if (status) {
+      return -1;
+    }
+  }
+  unit->code_size++;
+  return 0;
+}
+
+static int
+add_data(Asm_Unit* unit, const char* file, int line)
+{
+  if (unit->data_size == DATA_WORDS) {
+    unit_error(unit, file, line, "data beyond %d words of data memory",
+               DATA_WORDS);
+    return -1;
+  }
+  if (grow((void**)&unit->data, &unit->data_capacity, unit->data_size,
+           sizeof(int))) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  unit->data[unit->data_size] = 0;
+  return 0;
+}
+
+static int
+parse_file(Asm_Unit* unit, const char* path, int depth);
+
+/* Path of an included file, relative to the directory of the includer */
+static char*
+include_path(const char* includer, const char* name)
+{
+  const char* slash = strrchr(includer, '/');
+  if (name[0] == '/' || !slash) {
+    return strdup(name);
+  }
+
+  int dir_len = slash - includer + 1;
+  char* path = malloc(dir_len + strlen(name) + 1);
+  if (path) {
+    memcpy(path, includer, dir_len);
+    strcpy(path + dir_len, name);
+  }
+  return path;
+}
+
+static int
+parse_directive(Asm_Unit* unit, char* text, const char* file, int line,
+                int depth)
+{
+  char* args = text;
+  while (*args && !isspace((unsigned char)*args)) {
+    args++;
+  }
+  if (*args) {
+    *args++ = '\0';
+    args = trim(args);
+  }
+
+  if (!strcmp(text, ".text") || !strcmp(text, ".data")) {
+    if (*args) {
+      unit_error(unit, file, line, "%s takes no operands", text);
+      return -1;
+    }
+    unit->section = text[1] == 't' ? SECTION_TEXT : SECTION_DATA;
+    return 0;
+  }
+
+  if (!strcmp(text, ".include")) {
+    if (unit->text) {
+      unit_error(unit, file, line, "no includes in a program held in memory");
+      return -1;
+    }
+    size_t len = strlen(args);
+    if (len >= 2 && args[0] == '"' && args[len - 1] == '"') {
+      args[len - 1] = '\0';
+      args++;
+    }
+    if (!*args) {
+      unit_error(unit, file, line, ".include takes a file name");
+      return -1;
+    }
+    if (depth == ASM_MAX_INCLUDE_DEPTH) {
+      unit_error(unit, file, line, "includes nested deeper than %d",
+                 ASM_MAX_INCLUDE_DEPTH);
+      return -1;
+    }
+    char* path = include_path(file, args);
+    if (!path) {
+      unit_error(unit, file, line, "out of memory");
+      return -1;
+    }
+    int status = parse_file(unit, path, depth + 1);
+    free(path);
+    if (status && !unit->error[0]) {
+      unit_error(unit, file, line, "unable to read '%s'", args);
+    }
+    return status;
+  }
+
+  if (strcmp(text, ".word") && strcmp(text, ".space")) {
+    unit_error(unit, file, line, "unknown directive '%s'", text);
+    return -1;
+  }
+  if (unit->section != SECTION_DATA) {
+    unit_error(unit, file, line, "%s outside the data section", text);
+    return -1;
+  }
+
+  if (!strcmp(text, ".space")) {
+    long words;
+    if (parse_number(args, &words) || words < 0) {
+      unit_error(unit, file, line, ".space takes a number of words");
+      return -1;
+    }
+    for (long i = 0; i < words; ++i) {
+      if (add_data(unit, file, line)) {
+        return -1;
+      }
+      unit->data_size++;
+    }
+    return 0;
+  }
+
+  if (!*args) {
+    unit_error(unit, file, line, ".word takes one or more values");
+    return -1;
+  }
+  for (;;) {
+    char* comma = strchr(args, ',');
+    if (comma) {
+      *comma = '\0';
+    }
+    if (add_data(unit, file, line) ||
+        parse_value(unit, trim(args), SECTION_DATA, unit->data_size,
+                    &unit->data[unit->data_size], file, line)) {
+      return -1;
+    }
+    unit->data_size++;
+    if (!comma) {
+      return 0;
+    }
+    args = comma + 1;
+  }
+}
+
+static int
+define_label(Asm_Unit* unit, char* name, const char* file, int line)
+{
+  if (grow((void**)&unit->symbols, &unit->symbol_capacity, unit->num_symbols,
+           sizeof(Asm_Symbol))) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  Asm_Symbol* symbol = &unit->symbols[unit->num_symbols];
+  symbol->name = strdup(name);
+  if (!symbol->name) {
+    unit_error(unit, file, line, "out of memory");
+    return -1;
+  }
+  symbol->section = unit->section;
+  symbol->offset =
+    unit->section == SECTION_TEXT ? unit->code_size : unit->data_size;
+  symbol->file = file;
+  symbol->line = line;
+  unit->num_symbols++;
+  return 0;
+}
+
+static int
+parse_line(Asm_Unit* unit, char* text, const char* file, int line, int depth)
+{
+  char* comment = strchr(text, ';');
+  if (comment) {
+    *comment = '\0';
+  }
+  text = trim(text);
+
+  /* Labels, any number of them */
+  for (;;) {
+    char* end = text;
+    if (!label_start(*end)) {
+      break;
+    }
+    while (label_char(*end)) {
+      end++;
+    }
+    if (*end != ':') {
+      break;
+    }
+    *end = '\0';
+    if (define_label(unit, text, file, line)) {
+      return -1;
+    }
+    text = trim(end + 1);
+  }
+
+  if (!*text) {
+    return 0;
+  }
+  if (text[0] == '.') {
+    return parse_directive(unit, text, file, line, depth);
+  }
+  return parse_instruction(unit, text, file, line);
+}
+
+/*
+ * Parses the lines of text, the contents of the file at path, into unit and
+ * frees text. Returns -1 on an error.
+ */
+static int
+parse_text(Asm_Unit* unit, const char* path, char* text, int depth)
+{
+  /* Kept until the unit is freed, symbols and fixups point to it */
+  char* name = strdup(path);
+  if (!name || grow((void**)&unit->files, &unit->file_capacity,
+                     unit->num_files, sizeof(char*))) {
+    free(name);
+    free(text);
+    unit_error(unit, path, 0, "out of memory");
+    return -1;
+  }
+  unit->files[unit->num_files++] = name;
+
+  int status = 0;
+  int line = 1;
+  for (char* start = text; *start && !status; ++line) {
+    char* end = strchr(start, '\n');
+    if (end) {
+      *end = '\0';
+    }
+    status = parse_line(unit, start, name, line, depth);
+    if (!end) {
+      break;
+    }
+    start = end + 1;
+  }
+  free(text);
+  return status;
+}
+
+/*
+ * Parses the lines of the file at path into unit, returns -1 on an error or
+ * if the file cannot be read
+ */
+static int
+parse_file(Asm_Unit* unit, const char* path, int depth)
+{
+  char* text = read_file(path);
+  if (!text) {
+    return -1;
+  }
+  return parse_text(unit, path, text, depth);
+}
+
+/* Parses the source unit holds in memory, stopping at a null byte */
+static int
+parse_buffer(Asm_Unit* unit)
+{
+  char* text = strndup(unit->text, unit->length);
+  if (!text) {
+    return -1;
+  }
+  return parse_text(unit, unit->path, text, 0);
+}
+
+static unsigned long
+symbol_hash(const char* name)
+{
+  unsigned long hash = FNV_OFFSET;
+  for (; *name; ++name) {
+    hash = (hash ^ (unsigned char)*name) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static Asm_Symbol**
+symbol_slot(Asm_Link* link, const char* name)
+{
+  unsigned long i = symbol_hash(name) & link->table_mask;
+  while (link->table[i] && strcmp(link->table[i]->name, name)) {
+    i = (i + 1) & link->table_mask;
+  }
+  return &link->table[i];
+}
+
+/*
+ * Copies the code and data of unit into the program and fills in the
+ * labels it uses
+ */
+static void
+resolve_unit(Asm_Link* link, Asm_Unit* unit)
+{
+  APEX_Program* program = link->program;
+  APEX_Instruction* code = program->code + unit->code_base;
+  int* data = program->data + unit->data_base;
+
+  memcpy(code, unit->code, sizeof(*code) * unit->code_size);
+  if (unit->data_size) {
+    memcpy(data, unit->data, sizeof(*data) * unit->data_size);
+  }
+
+  for (int i = 0; i < unit->num_fixups; ++i) {
+    Asm_Fixup* fixup = &unit->fixups[i];
+    Asm_Symbol* symbol = *symbol_slot(link, fixup->symbol);
+    if (!symbol) {
+      unit_error(unit, fixup->file, fixup->line, "undefined label '%s'",
+                 fixup->symbol);
+      return;
+    }
+
+    long value = symbol->value + fixup->addend;
+    if (value < INT_MIN || value > INT_MAX) {
+      unit_error(unit, fixup->file, fixup->line, "value of '%s' out of range",
+                 fixup->symbol);
+      return;
+    }
+    if (fixup->section == SECTION_TEXT) {
+      code[fixup->offset].imm = value;
+    } else {
+      data[fixup->offset] = value;
+    }
+  }
+}
+
+static void*
+worker(void* arg)
+{
+  Asm_Link* link = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&link->lock);
+    int index = link->next_unit++;
+    pthread_mutex_unlock(&link->lock);
+    if (index >= link->num_units) {
+      break;
+    }
+
+    Asm_Unit* unit = &link->units[index];
+    if (link->resolve) {
+      resolve_unit(link, unit);
+    } else if ((unit->text ? parse_buffer(unit)
+                           : parse_file(unit, unit->path, 0)) &&
+               !unit->error[0]) {
+      snprintf(unit->error, sizeof(unit->error), "Unable to read %s",
+               unit->path);
+    }
+  }
+  return NULL;
+}
+
+/* Runs the current pass over all units, one host thread takes one at a time */
+static void
+run_pass(Asm_Link* link, int num_threads)
+{
+  pthread_t threads[num_threads];
+
+  link->next_unit = 0;
+  for (int t = 1; t < num_threads; ++t) {
+    if (pthread_create(&threads[t], NULL, worker, link)) {
+      /* The threads already started and this one do the rest */
+      num_threads = t;
+      break;
+    }
+  }
+  worker(link);
+  for (int t = 1; t < num_threads; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+}
+
+/* Prints the error of every unit in file order, returns -1 if any */
+static int
+report_errors(Asm_Link* link)
+{
+  int status = 0;
+  for (int u = 0; u < link->num_units; ++u) {
+    if (link->units[u].error[0]) {
+      fprintf(stderr, "APEX_Error : %s\n", link->units[u].error);
+      status = -1;
+    }
+  }
+  return status;
+}
+
+/*
+ * Places every unit after the previous one and enters all labels in the
+ * symbol table
+ */
+static int
+layout(Asm_Link* link)
+{
+  long code_size = 0;
+  long data_size = 0;
+  long num_symbols = 0;
+
+  for (int u = 0; u < link->num_units; ++u) {
+    Asm_Unit* unit = &link->units[u];
+    unit->code_base = code_size;
+    unit->data_base = data_size;
+    code_size += unit->code_size;
+    data_size += unit->data_size;
+    num_symbols += unit->num_symbols;
+  }
+  if (!code_size) {
+    fprintf(stderr, "APEX_Error : No instructions in the program\n");
+    return -1;
+  }
+  if (code_size > (INT_MAX - 4000) / 4) {
+    fprintf(stderr, "APEX_Error : Program too large\n");
+    return -1;
+  }
+  if (data_size > DATA_WORDS) {
+    fprintf(stderr,
+            "APEX_Error : %ld data words, data memory holds %d\n",
+            data_size, DATA_WORDS);
+    return -1;
+  }
+
+  unsigned long table_size = 16;
+  while (table_size < 2 * (unsigned long)num_symbols) {
+    table_size *= 2;
+  }
+  link->table = calloc(table_size, sizeof(*link->table));
+  link->table_mask = table_size - 1;
+
+  APEX_Program* program = link->program;
+  program->code = calloc(code_size, sizeof(*program->code));
+  program->code_size = code_size;
+  program->data = calloc(data_size ? data_size : 1, sizeof(*program->data));
+  program->data_size = data_size;
+  if (!link->table || !program->code || !program->data) {
+    fprintf(stderr, "APEX_Error : Out of memory linking the program\n");
+    return -1;
+  }
+
+  int status = 0;
+  for (int u = 0; u < link->num_units; ++u) {
+    Asm_Unit* unit = &link->units[u];
+    for (int i = 0; i < unit->num_symbols; ++i) {
+      Asm_Symbol* symbol = &unit->symbols[i];
+      /* The pc of its instruction or the address of its word */
+      symbol->value = symbol->section == SECTION_TEXT
+                        ? 4000 + 4 * (long)(unit->code_base + symbol->offset)
+                        : unit->data_base + symbol->offset;
+      Asm_Symbol** slot = symbol_slot(link, symbol->name);
+      if (*slot) {
+        fprintf(stderr,
+                "APEX_Error : %s line %d: label '%s' already defined in %s "
+                "line %d\n",
+                symbol->file, symbol->line, symbol->name, (*slot)->file,
+                (*slot)->line);
+        status = -1;
+        continue;
+      }
+      *slot = symbol;
+    }
+  }
+  return status;
+}
+
+static void
+free_unit(Asm_Unit* unit)
+{
+  for (int i = 0; i < unit->num_symbols; ++i) {
+    free(unit->symbols[i].name);
+  }
+  for (int i = 0; i < unit->num_fixups; ++i) {
+    free(unit->fixups[i].symbol);
+  }
+  for (int i = 0; i < unit->num_files; ++i) {
+    free(unit->files[i]);
+  }
+  free(unit->code);
+  free(unit->data);
+  free(unit->symbols);
+  free(unit->fixups);
+  free(unit->files);
+}
+
+/*
+ * Parses, lays out and resolves the units of link into program, then frees
+ * them
+ */
+static int
+assemble(Asm_Link* link, int num_threads, APEX_Program* program)
+{
+  if (num_threads < 1) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = online > 0 ? online : 1;
+  }
+  if (num_threads > link->num_units) {
+    num_threads = link->num_units;
+  }
+  link->program = program;
+  pthread_mutex_init(&link->lock, NULL);
+
+  /* Files are parsed in parallel, then laid out in order and resolved in
+   * parallel against the symbols of all of them
+   */
+  run_pass(link, num_threads);
+  int status = report_errors(link);
+  if (!status) {
+    status = layout(link);
+  }
+  if (!status) {
+    link->resolve = 1;
+    run_pass(link, num_threads);
+    status = report_errors(link);
+  }
+
+  for (int u = 0; u < link->num_units; ++u) {
+    free_unit(&link->units[u]);
+  }
+  free(link->table);
+  pthread_mutex_destroy(&link->lock);
+  if (status) {
+    APEX_program_free(program);
+  }
+  return status;
+}
+
+int
+APEX_assemble(const char* const* files, int num_files, int num_threads,
+              APEX_Program* program)
+{
+  memset(program, 0, sizeof(*program));
+  if (num_files < 1) {
+    return -1;
+  }
+
+  Asm_Link link = { 0 };
+  link.units = calloc(num_files, sizeof(*link.units));
+  if (!link.units) {
+    return -1;
+  }
+  link.num_units = num_files;
+  for (int u = 0; u < num_files; ++u) {
+    link.units[u].path = files[u];
+  }
+
+  int status = assemble(&link, num_threads, program);
+  free(link.units);
+  return status;
+}
+
+int
+APEX_assemble_buffer(const char* buffer, size_t length,
+                     APEX_Program* program)
+{
+  Asm_Unit unit = { 0 };
+  unit.path = "buffer";
+  unit.text = buffer;
+  unit.length = length;
+
+  Asm_Link link = { 0 };
+  link.units = &unit;
+  link.num_units = 1;
+  memset(program, 0, sizeof(*program));
+  return assemble(&link, 1, program);
+}
+
+void
+APEX_program_free(APEX_Program* program)
+{
+  free(program->code);
+  free(program->data);
+  memset(program, 0, sizeof(*program));
+}
@@ -0,0 +1,54 @@
+#ifndef _APEX_ASSEMBLER_H_
+#define _APEX_ASSEMBLER_H_
+/**
+ *  assembler.h
+ *  Contains the assembler front end: source files with labels, data
+ *  sections and include files are parsed in parallel on host threads and
+ *  linked into a single program.
+ *
+ *  A line holds an optional label, then an instruction in the format of
+ *  the input files (MOVC,R1,#11) or a directive, then an optional comment
+ *  starting with ';'. Blank lines hold nothing.
+ *    name:             defines name at the next instruction or data word
+ *    .text / .data     switches between the code and the data section
+ *    .word v, v, ...   data words, numbers or labels
+ *    .space n          n data words of 0
+ *    .include "file"   parses file here, relative to the including file
+ *  An immediate is a number or a label plus or minus a number (#loop,
+ *  #table+2). A code label is the pc of its instruction, a data label the
+ *  address of its word. Labels are global to the program.
+ *  Opcodes the stages do not implement are kept without their operands.
+ *
+ *  Files are linked in the order given: code from pc 4000 and data from
+ *  address 0, each file after the previous one.
+ */
+#include "cpu.h"
+
+#define ASM_MAX_INCLUDE_DEPTH 16
+
+typedef struct APEX_Program
+{
+  APEX_Instruction* code;
+  int code_size;
+  int* data;          // Data memory from address 0 up, the rest is 0
+  int data_size;
+} APEX_Program;
+
+/* Assembles and links files on up to num_threads host threads, 0 for one
+ * per online cpu. Returns 0 on success, errors go to stderr.
+ */
+int
+APEX_assemble(const char* const* files, int num_files, int num_threads,
+              APEX_Program* program);
+
+/* Same as APEX_assemble for the source of one file held in memory, which
+ * cannot include files
+ */
+int
+APEX_assemble_buffer(const char* buffer, size_t length,
+                     APEX_Program* program);
+
+void
+APEX_program_free(APEX_Program* program);
+
+#endif
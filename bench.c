@@ -0,0 +1,214 @@
+/*
+ *  bench.c
+ *  Benchmark of the specialized variants of the stages against the generic
+ *  ones ('apex_bench')
+ *
+ *  The program (a built-in loop by default) is stepped for a number of
+ *  cycles with the variant chosen for the options given and again with the
+ *  generic stages, both must end in the same state. The best host time of
+ *  a few alternating repetitions is reported for each. Next to the opcode
+ *  comparisons of the stages the gap is small, it grows in an optimized
+ *  build.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "assembler.h"
+#include "cpu.h"
+
+#define BENCH_MAX_OPTIONS 32
+
+/* Loop of register, ALU and memory instructions which never drains */
+static const char loop[] = "MOVC,R1,#0\n"
+                           "MOVC,R2,#1\n"
+                           "MOVC,R7,#4012\n"
+                           "ADDL,R1,R1,#1\n"
+                           "SUB,R3,R1,R2\n"
+                           "STORE,R1,R2,#16\n"
+                           "LOAD,R4,R2,#16\n"
+                           "ADDL,R5,R3,#2\n"
+                           "MOVC,R6,#7\n"
+                           "SUB,R3,R5,R6\n"
+                           "JUMP,R7,#0\n";
+
+typedef struct Bench
+{
+  APEX_Program program;
+  const char* option_names[BENCH_MAX_OPTIONS];
+  const char* option_values[BENCH_MAX_OPTIONS];
+  int num_options;
+  long cycles;
+} Bench;
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_bench [options] [input_file] "
+          "[--option=value ...]\n"
+          "  -c cycles   cycles to simulate (default 2000000)\n"
+          "  -r repeats  runs of each variant, the best counts (default 5)\n"
+          "Without an input file a built-in loop is simulated. Fast-forward "
+          "and analysis are not run.\n"
+          "Options:\n");
+  APEX_print_options(stderr);
+  exit(1);
+}
+
+static double
+now_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/*
+ * Creates a quiet cpu for the program and options of bench
+ */
+static APEX_CPU*
+bench_cpu(Bench* bench, int specialize)
+{
+  APEX_CPU* cpu = APEX_cpu_init_program(&bench->program);
+  if (!cpu) {
+    return NULL;
+  }
+  cpu->debug_messages = 0;
+  for (int i = 0; i < bench->num_options; ++i) {
+    if (APEX_cpu_set_option(cpu, bench->option_names[i],
+                            bench->option_values[i])) {
+      APEX_cpu_stop(cpu);
+      return NULL;
+    }
+  }
+  cpu->specialize = specialize;
+  return cpu;
+}
+
+/*
+ * Steps a new cpu through the program, returns the time in ms or -1 on an
+ * error. The cpu of the best run so far is kept in *best.
+ */
+static double
+bench_run(Bench* bench, int specialize, APEX_CPU** best, double* best_ms)
+{
+  APEX_CPU* cpu = bench_cpu(bench, specialize);
+  if (!cpu) {
+    return -1;
+  }
+  double start = now_ms();
+  for (long n = 0; n < bench->cycles && !APEX_cpu_drained(cpu); ++n) {
+    if (APEX_cpu_step(cpu)) {
+      APEX_cpu_stop(cpu);
+      return -1;
+    }
+  }
+  double ms = now_ms() - start;
+  if (!*best || ms < *best_ms) {
+    if (*best) {
+      APEX_cpu_stop(*best);
+    }
+    *best = cpu;
+    *best_ms = ms;
+  } else {
+    APEX_cpu_stop(cpu);
+  }
+  return ms;
+}
+
+static int
+same_state(APEX_CPU* a, APEX_CPU* b)
+{
+  return a->clock == b->clock && a->ins_completed == b->ins_completed &&
+         a->pc == b->pc && !memcmp(a->regs, b->regs, sizeof(a->regs)) &&
+         !memcmp(a->data_memory, b->data_memory, sizeof(a->data_memory));
+}
+
+static void
+print_result(const char* variant, double ms, APEX_CPU* cpu, int repeats)
+{
+  fprintf(stderr,
+          "APEX_BENCH : %-10s best of %d %10.2f ms, %8.2f Mcycles/s\n",
+          variant, repeats, ms, ms > 0 ? cpu->clock / ms / 1e3 : 0.0);
+}
+
+int
+main(int argc, char const* argv[])
+{
+  Bench bench = { .cycles = 2000000 };
+  const char* input = NULL;
+  int repeats = 5;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--", 2)) {
+      const char* value = strchr(argv[i], '=');
+      if (bench.num_options == BENCH_MAX_OPTIONS) {
+        fprintf(stderr, "APEX_Error : More than %d options\n",
+                BENCH_MAX_OPTIONS);
+        return 1;
+      }
+      bench.option_names[bench.num_options] =
+        value ? strndup(argv[i] + 2, value - argv[i] - 2)
+              : strdup(argv[i] + 2);
+      bench.option_values[bench.num_options++] = value ? value + 1 : "1";
+    } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      bench.cycles = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' || input) {
+      usage();
+    } else {
+      input = argv[i];
+    }
+  }
+  if (bench.cycles <= 0 || repeats <= 0) {
+    usage();
+  }
+
+  if (input ? APEX_assemble(&input, 1, 0, &bench.program)
+            : APEX_assemble_buffer(loop, strlen(loop), &bench.program)) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n",
+            input ? input : "the built-in loop");
+    return 1;
+  }
+
+  /* Runs alternate, so a change of the host load hits both alike */
+  APEX_CPU* specialized = NULL;
+  APEX_CPU* generic = NULL;
+  double specialized_ms = 0;
+  double generic_ms = 0;
+  for (int r = 0; r < repeats; ++r) {
+    if (bench_run(&bench, 1, &specialized, &specialized_ms) < 0 ||
+        bench_run(&bench, 0, &generic, &generic_ms) < 0) {
+      return 1;
+    }
+  }
+
+  fprintf(stderr, "APEX_BENCH : %s, %d cycles, %d instructions\n",
+          input ? input : "built-in loop", generic->clock,
+          generic->ins_completed);
+  print_result(APEX_cpu_variant(specialized), specialized_ms, specialized,
+               repeats);
+  print_result(APEX_cpu_variant(generic), generic_ms, generic, repeats);
+
+  int status = 0;
+  if (!same_state(specialized, generic)) {
+    fprintf(stderr,
+            "APEX_Error : %s and generic stages end in different states\n",
+            APEX_cpu_variant(specialized));
+    status = 1;
+  } else if (specialized_ms > 0) {
+    fprintf(stderr, "APEX_BENCH : %s runs at %.2fx the generic speed\n",
+            APEX_cpu_variant(specialized), generic_ms / specialized_ms);
+  }
+
+  APEX_cpu_stop(specialized);
+  APEX_cpu_stop(generic);
+  for (int i = 0; i < bench.num_options; ++i) {
+    free((char*)bench.option_names[i]);
+  }
+  APEX_program_free(&bench.program);
+  return status;
+}
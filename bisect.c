@@ -0,0 +1,395 @@
+/*
+ *  bisect.c
+ *  Finds the first cycle two builds of the simulator diverge in
+ *  ('apex_bisect')
+ *
+ *  Both simulators run the program quietly while recording a hash of the
+ *  architectural state every few cycles and periodic checkpoints. The
+ *  first mismatching hash bounds a window, which each build replays from
+ *  its own checkpoint before it with a hash every cycle to find the first
+ *  diverging cycle. The last cycles up to it are then replayed once more
+ *  with stage messages, into a trace per build.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "replay.h"
+
+#define BISECT_MAX_OPTIONS 32
+
+typedef struct Bisect
+{
+  const char* sim[2];
+  const char** inputs;        // Linked into one program by apex_sim
+  int num_inputs;
+  const char* options[BISECT_MAX_OPTIONS];
+  int num_options;
+  long cycles;
+  long interval;
+  long checkpoint_interval;
+  long window;
+  const char* prefix;
+} Bisect;
+
+static const char side[2] = { 'a', 'b' };
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_bisect [options] <simulator A> "
+          "<simulator B> <input_file> [<input_file> ...] "
+          "[--option=value ...]\n"
+          "  -x cycles    cycles to simulate (default 1000000)\n"
+          "  -k cycles    cycles per hash (default 1000)\n"
+          "  -c cycles    cycles per checkpoint (default 100000)\n"
+          "  -w cycles    cycles traced up to the divergence (default 10)\n"
+          "  -o prefix    prefix of the recordings and traces (default "
+          "bisect)\n"
+          "Both simulators get the options, exits with 1 when they "
+          "diverge.\n");
+  exit(2);
+}
+
+static double
+now_s(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static char*
+file_name(Bisect* bisect, int i, const char* suffix)
+{
+  static char names[2][3][4096];
+  static int next;
+  char* name = names[i][next++ % 3];
+
+  snprintf(name, sizeof(names[i][0]), "%s-%c.%s", bisect->prefix, side[i],
+           suffix);
+  return name;
+}
+
+/*
+ * Starts simulator i for cycles from the checkpoint at or before restore
+ * (from cycle 0 if restore is negative) with the extra options given,
+ * stdout goes to output
+ */
+static pid_t
+spawn(Bisect* bisect, int i, long cycles, long restore, const char* output,
+      const char* extra[], int num_extra)
+{
+  char cycles_arg[32];
+  char restore_arg[4200];
+  const char* argv[bisect->num_inputs + BISECT_MAX_OPTIONS + 16];
+  int argc = 0;
+
+  snprintf(cycles_arg, sizeof(cycles_arg), "%ld", cycles);
+  argv[argc++] = bisect->sim[i];
+  for (int f = 0; f < bisect->num_inputs; ++f) {
+    argv[argc++] = bisect->inputs[f];
+  }
+  argv[argc++] = "simulate";
+  argv[argc++] = cycles_arg;
+  for (int o = 0; o < bisect->num_options; ++o) {
+    argv[argc++] = bisect->options[o];
+  }
+  if (restore >= 0) {
+    snprintf(restore_arg, sizeof(restore_arg), "--restore=%s:%ld",
+             file_name(bisect, i, "rec"), restore);
+    argv[argc++] = restore_arg;
+  }
+  for (int e = 0; e < num_extra; ++e) {
+    argv[argc++] = extra[e];
+  }
+  argv[argc] = NULL;
+
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid) {
+    return pid;
+  }
+  int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int null = open("/dev/null", O_WRONLY);
+  if (out < 0 || null < 0) {
+    _exit(127);
+  }
+  dup2(out, STDOUT_FILENO);
+  dup2(null, STDERR_FILENO);
+  execv(argv[0], (char* const*)argv);
+  _exit(127);
+}
+
+/*
+ * Runs both simulators side by side, the extra options of each are the
+ * same but for the name of the file, which ends in suffix
+ */
+static int
+run_both(Bisect* bisect, long cycles, const long restore[2],
+         const char* output_suffix, const char* option, const char* suffix,
+         const char* extra[], int num_extra)
+{
+  char file_arg[2][4200];
+  const char* args[2][8];
+  pid_t pid[2];
+  int status = 0;
+
+  for (int i = 0; i < 2; ++i) {
+    int n = 0;
+    if (option) {
+      snprintf(file_arg[i], sizeof(file_arg[i]), "--%s=%s", option,
+               file_name(bisect, i, suffix));
+      args[i][n++] = file_arg[i];
+    }
+    for (int e = 0; e < num_extra; ++e) {
+      args[i][n++] = extra[e];
+    }
+    const char* output =
+      output_suffix ? file_name(bisect, i, output_suffix) : "/dev/null";
+    pid[i] = spawn(bisect, i, cycles, restore[i], output, args[i], n);
+  }
+  for (int i = 0; i < 2; ++i) {
+    int exit_status;
+    if (pid[i] < 0 || waitpid(pid[i], &exit_status, 0) < 0 ||
+        !WIFEXITED(exit_status) || WEXITSTATUS(exit_status)) {
+      fprintf(stderr, "APEX_Error : %s failed, run it alone for its errors\n",
+              bisect->sim[i]);
+      status = -1;
+    }
+  }
+  return status;
+}
+
+static int
+read_both(Bisect* bisect, const char* suffix, Replay_Recording recording[2])
+{
+  if (APEX_replay_read(file_name(bisect, 0, suffix), &recording[0])) {
+    return -1;
+  }
+  if (APEX_replay_read(file_name(bisect, 1, suffix), &recording[1])) {
+    APEX_replay_free_recording(&recording[0]);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Cycle of the first hash the recordings differ in, -1 if none. Hashes
+ * of a cycle only one of them has are skipped, the last cycle both agree
+ * in is left in *agree and their number in *agreed.
+ */
+static long
+first_mismatch(Replay_Recording recording[2], long* agree, int* agreed)
+{
+  Replay_Hash* a = recording[0].hashes;
+  Replay_Hash* b = recording[1].hashes;
+  int i = 0;
+  int j = 0;
+
+  *agree = 0;
+  *agreed = 0;
+  while (i < recording[0].num_hashes && j < recording[1].num_hashes) {
+    if (a[i].cycle < b[j].cycle) {
+      ++i;
+    } else if (b[j].cycle < a[i].cycle) {
+      ++j;
+    } else if (a[i].hash != b[j].hash) {
+      return a[i].cycle;
+    } else {
+      *agree = a[i].cycle;
+      ++*agreed;
+      ++i;
+      ++j;
+    }
+  }
+  /* A run which ended early diverged after its last hash */
+  if (i < recording[0].num_hashes) {
+    return a[i].cycle;
+  }
+  return j < recording[1].num_hashes ? b[j].cycle : -1;
+}
+
+/* Cycle of the last checkpoint at or before cycle, -1 if none */
+static long
+checkpoint_before(Replay_Recording* recording, long cycle)
+{
+  long found = -1;
+  for (int c = 0; c < recording->num_checkpoints; ++c) {
+    if (recording->checkpoints[c] <= cycle) {
+      found = recording->checkpoints[c];
+    }
+  }
+  return found;
+}
+
+/*
+ * Prints the first line the traces differ in
+ */
+static void
+compare_traces(Bisect* bisect)
+{
+  char line[2][1024];
+  FILE* fp[2];
+
+  fp[0] = fopen(file_name(bisect, 0, "trace"), "r");
+  fp[1] = fopen(file_name(bisect, 1, "trace"), "r");
+  for (long n = 1; fp[0] && fp[1]; ++n) {
+    char* got[2] = { fgets(line[0], sizeof(line[0]), fp[0]),
+                     fgets(line[1], sizeof(line[1]), fp[1]) };
+    if (!got[0] && !got[1]) {
+      break;
+    }
+    if (!got[0] || !got[1] || strcmp(line[0], line[1])) {
+      fprintf(stderr, "APEX_BISECT : Traces differ first in line %ld\n", n);
+      for (int i = 0; i < 2; ++i) {
+        fprintf(stderr, "  %c: %s", 'A' + i,
+                got[i] ? line[i] : "(end of trace)\n");
+      }
+      break;
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (fp[i]) {
+      fclose(fp[i]);
+    }
+  }
+}
+
+int
+main(int argc, char const* argv[])
+{
+  Bisect bisect = { .cycles = 1000000,
+                    .interval = 1000,
+                    .checkpoint_interval = 100000,
+                    .window = 10,
+                    .prefix = "bisect" };
+  const char* positional[argc];
+  int num_positional = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--", 2)) {
+      if (bisect.num_options == BISECT_MAX_OPTIONS) {
+        fprintf(stderr, "APEX_Error : More than %d options\n",
+                BISECT_MAX_OPTIONS);
+        return 2;
+      }
+      bisect.options[bisect.num_options++] = argv[i];
+    } else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+      bisect.cycles = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+      bisect.interval = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      bisect.checkpoint_interval = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      bisect.window = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      bisect.prefix = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage();
+    } else {
+      positional[num_positional++] = argv[i];
+    }
+  }
+  if (num_positional < 3 || bisect.cycles <= 0 || bisect.interval <= 0 ||
+      bisect.checkpoint_interval < 0 || bisect.window < 0) {
+    usage();
+  }
+  bisect.sim[0] = positional[0];
+  bisect.sim[1] = positional[1];
+  bisect.inputs = positional + 2;
+  bisect.num_inputs = num_positional - 2;
+
+  double start = now_s();
+  char interval_arg[64];
+  char checkpoint_arg[64];
+  char quiet_arg[64];
+  snprintf(interval_arg, sizeof(interval_arg), "--record-interval=%ld",
+           bisect.interval);
+  snprintf(checkpoint_arg, sizeof(checkpoint_arg),
+           "--checkpoint-interval=%ld", bisect.checkpoint_interval);
+  /* Stage messages from past the last cycle, so the runs are quiet */
+  snprintf(quiet_arg, sizeof(quiet_arg), "--trace-from=%ld", bisect.cycles);
+
+  /* Recordings of the whole run */
+  const long from_start[2] = { -1, -1 };
+  const char* record_args[] = { interval_arg, checkpoint_arg, quiet_arg };
+  Replay_Recording recording[2];
+  if (run_both(&bisect, bisect.cycles, from_start, NULL, "record", "rec",
+               record_args, 3) ||
+      read_both(&bisect, "rec", recording)) {
+    return 2;
+  }
+  long agree;
+  int agreed;
+  long differ = first_mismatch(recording, &agree, &agreed);
+  if (differ < 0) {
+    fprintf(stderr,
+            "APEX_BISECT : %d hashes agree, no divergence in %ld cycles "
+            "(%.2f s)\n",
+            agreed, bisect.cycles, now_s() - start);
+    APEX_replay_free_recording(&recording[0]);
+    APEX_replay_free_recording(&recording[1]);
+    return 0;
+  }
+  fprintf(stderr,
+          "APEX_BISECT : Hashes agree up to cycle %ld and differ at cycle "
+          "%ld\n",
+          agree, differ);
+
+  /* Every cycle of the window, each build from its own checkpoint */
+  long replay_from = checkpoint_before(&recording[0], agree);
+  long restore[2] = { agree, agree };
+  if (replay_from < 0 ||
+      replay_from != checkpoint_before(&recording[1], agree)) {
+    restore[0] = restore[1] = -1;   // No common checkpoint, from the start
+    replay_from = 0;
+  }
+  APEX_replay_free_recording(&recording[0]);
+  APEX_replay_free_recording(&recording[1]);
+
+  char from_arg[64];
+  snprintf(from_arg, sizeof(from_arg), "--record-from=%ld", agree);
+  const char* window_args[] = { "--record-interval=1", from_arg,
+                                "--checkpoint-interval=0", quiet_arg };
+  if (run_both(&bisect, differ - replay_from, restore, NULL, "record", "win",
+               window_args, 4) ||
+      read_both(&bisect, "win", recording)) {
+    return 2;
+  }
+  long diverge = first_mismatch(recording, &agree, &agreed);
+  APEX_replay_free_recording(&recording[0]);
+  APEX_replay_free_recording(&recording[1]);
+  if (diverge < 0) {
+    fprintf(stderr,
+            "APEX_Error : Replaying cycles %ld to %ld does not reproduce the "
+            "mismatch, a simulator is not deterministic\n",
+            replay_from, differ);
+    return 2;
+  }
+
+  /* Stage messages of the last cycles up to the divergence */
+  long trace_from = diverge - bisect.window > replay_from
+                      ? diverge - bisect.window
+                      : replay_from;
+  char trace_arg[64];
+  snprintf(trace_arg, sizeof(trace_arg), "--trace-from=%ld", trace_from);
+  const char* trace_args[] = { trace_arg };
+  if (run_both(&bisect, diverge - replay_from, restore, "trace", NULL, NULL,
+               trace_args, 1)) {
+    return 2;
+  }
+
+  fprintf(stderr, "APEX_BISECT : First diverging cycle %ld (%.2f s)\n",
+          diverge, now_s() - start);
+  fprintf(stderr, "APEX_BISECT : Cycles %ld to %ld traced in %s and %s\n",
+          trace_from, diverge, file_name(&bisect, 0, "trace"),
+          file_name(&bisect, 1, "trace"));
+  compare_traces(&bisect);
+  return 1;
+}
@@ -0,0 +1,130 @@
+/*
+ *  cache.c
+ *  Contains a set associative cache model with per line coherence state
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+/*
+ * This function creates an empty cache, all lines invalid
+ */
+APEX_Cache*
+APEX_cache_init(int sets, int ways, int line_words)
+{
+  if (sets <= 0 || ways <= 0 || line_words <= 0) {
+    return NULL;
+  }
+
+  APEX_Cache* cache = calloc(1, sizeof(*cache));
+  if (!cache) {
+    return NULL;
+  }
+
+  cache->lines = calloc((size_t)sets * ways, sizeof(APEX_Cache_Line));
+  if (!cache->lines) {
+    free(cache);
+    return NULL;
+  }
+
+  cache->sets = sets;
+  cache->ways = ways;
+  cache->line_words = line_words;
+  return cache;
+}
+
+/*
+ * Parses a geometry of the form "sets:ways:line_words", returns 0 on success
+ */
+int
+APEX_cache_parse_geometry(const char* spec, int* sets, int* ways,
+                          int* line_words)
+{
+  if (!spec || sscanf(spec, "%d:%d:%d", sets, ways, line_words) != 3) {
+    return -1;
+  }
+  if (*sets <= 0 || *ways <= 0 || *line_words <= 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int
+APEX_cache_line_address(APEX_Cache* cache, int address)
+{
+  return address / cache->line_words;
+}
+
+static APEX_Cache_Line*
+get_set(APEX_Cache* cache, int line_address)
+{
+  return &cache->lines[(line_address % cache->sets) * cache->ways];
+}
+
+/*
+ * Returns the valid line holding line_address, NULL on a miss.
+ * Does not update LRU state, use APEX_cache_touch for that.
+ */
+APEX_Cache_Line*
+APEX_cache_lookup(APEX_Cache* cache, int line_address)
+{
+  APEX_Cache_Line* set = get_set(cache, line_address);
+  for (int i = 0; i < cache->ways; ++i) {
+    if (set[i].state != LINE_I && set[i].tag == line_address) {
+      return &set[i];
+    }
+  }
+  return NULL;
+}
+
+void
+APEX_cache_touch(APEX_Cache* cache, APEX_Cache_Line* line)
+{
+  line->last_use = ++cache->tick;
+}
+
+/*
+ * Installs line_address in the given state, replacing an invalid way or the
+ * LRU way of the set. The replaced line is copied to victim (if not NULL),
+ * its state is LINE_I when nothing valid was evicted.
+ */
+APEX_Cache_Line*
+APEX_cache_fill(APEX_Cache* cache, int line_address, int state,
+                APEX_Cache_Line* victim)
+{
+  APEX_Cache_Line* set = get_set(cache, line_address);
+  APEX_Cache_Line* line = &set[0];
+
+  for (int i = 0; i < cache->ways; ++i) {
+    if (set[i].state == LINE_I) {
+      line = &set[i];
+      break;
+    }
+    if (set[i].last_use < line->last_use) {
+      line = &set[i];
+    }
+  }
+
+  if (victim) {
+    *victim = *line;
+  }
+  if (line->state != LINE_I) {
+    cache->evictions++;
+  }
+
+  line->tag = line_address;
+  line->state = state;
+  APEX_cache_touch(cache, line);
+  return line;
+}
+
+void
+APEX_cache_free(APEX_Cache* cache)
+{
+  if (cache) {
+    free(cache->lines);
+    free(cache);
+  }
+}
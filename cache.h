@@ -0,0 +1,65 @@
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+/**
+ *  cache.h
+ *  Contains a set associative cache model with per line coherence state.
+ *  Addresses are data memory word addresses.
+ */
+
+/* Coherence state of a cache line (MESI uses all but LINE_O) */
+enum
+{
+  LINE_I,
+  LINE_S,
+  LINE_E,
+  LINE_O,
+  LINE_M
+};
+
+/* Model of one cache line, only tags are kept, data lives in memory */
+typedef struct APEX_Cache_Line
+{
+  int tag;                  // Line address (address / line_words)
+  int state;                // Coherence state, LINE_I if invalid
+  unsigned long last_use;   // LRU timestamp
+} APEX_Cache_Line;
+
+/* Model of a set associative LRU cache */
+typedef struct APEX_Cache
+{
+  int sets;
+  int ways;
+  int line_words;           // Words per line
+  unsigned long tick;       // Advances on every access, drives LRU
+  APEX_Cache_Line* lines;   // sets * ways entries
+
+  /* Some stats */
+  long hits;
+  long misses;
+  long evictions;
+} APEX_Cache;
+
+APEX_Cache*
+APEX_cache_init(int sets, int ways, int line_words);
+
+int
+APEX_cache_parse_geometry(const char* spec, int* sets, int* ways,
+                          int* line_words);
+
+int
+APEX_cache_line_address(APEX_Cache* cache, int address);
+
+APEX_Cache_Line*
+APEX_cache_lookup(APEX_Cache* cache, int line_address);
+
+APEX_Cache_Line*
+APEX_cache_fill(APEX_Cache* cache, int line_address, int state,
+                APEX_Cache_Line* victim);
+
+void
+APEX_cache_touch(APEX_Cache* cache, APEX_Cache_Line* line);
+
+void
+APEX_cache_free(APEX_Cache* cache);
+
+#endif
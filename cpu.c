@@ -10,10 +10,94 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "analyze.h"
+#include "assembler.h"
 #include "cpu.h"
+#include "energy.h"
+#include "fastforward.h"
+#include "lsq.h"
+#include "memtrace.h"
+#include "pipeline.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "replay.h"
+#include "smt.h"
+#include "telemetry.h"
+#include "vpred.h"
 
 /* Set this flag to 1 to enable debug messages */
+#ifndef ENABLE_DEBUG_MESSAGES
 #define ENABLE_DEBUG_MESSAGES 1
+#endif
+
+/* Features the stages check for at runtime. Variants of the stages
+ * specialized for common sets of them are compiled from cpu_stages.h, and
+ * outside a variant CPU_FEATURES is all of them
+ */
+#define FEATURE_DEBUG (1 << 0)          // Per-cycle stage messages
+#define FEATURE_ENERGY (1 << 1)
+#define FEATURE_TELEMETRY (1 << 2)
+#define FEATURE_VPRED (1 << 3)
+#define FEATURE_LSQ (1 << 4)
+#define FEATURE_MEMTRACE (1 << 5)
+#define FEATURE_HOOKS (1 << 6)          // Retire and data access hooks
+#define FEATURE_MEM_HANDLER (1 << 7)    // External data memory
+#define FEATURE_PROFILE (1 << 8)        // Self-profiler
+#define FEATURE_SMT (1 << 9)            // Hardware threads
+#define FEATURE_PREFETCH (1 << 10)      // Data cache and prefetcher
+#define FEATURES_ALL ((1 << 11) - 1)
+
+#define CPU_FEATURES FEATURES_ALL
+
+/* Runtime test of feature, constant false in variants without it */
+#define ENABLED(feature, test) ((CPU_FEATURES & (feature)) && (test))
+
+/* Debug messages can additionally be switched off per cpu at runtime */
+#define DEBUG_MESSAGES(cpu)                                                  \
+  (ENABLE_DEBUG_MESSAGES && ENABLED(FEATURE_DEBUG, (cpu)->debug_messages))
+
+/* Counts n events of the energy model */
+#define ENERGY_EVENTS(cpu, event, n)                                         \
+  do {                                                                       \
+    if (ENABLED(FEATURE_ENERGY, (cpu)->energy)) {                            \
+      (cpu)->energy->events[event] += (n);                                   \
+    }                                                                        \
+  } while (0)
+
+/* Adds the host time of printing between the two to the self-profile */
+#if APEX_SELF_PROFILE
+#define PROFILE_OUTPUT_BEGIN(cpu)                                            \
+  unsigned long long output_start = (cpu)->profile ? APEX_profile_ticks() : 0
+#define PROFILE_OUTPUT_END(cpu)                                              \
+  do {                                                                       \
+    if ((cpu)->profile) {                                                    \
+      (cpu)->profile->phase[PROFILE_OUTPUT] +=                               \
+        APEX_profile_ticks() - output_start;                                 \
+    }                                                                        \
+  } while (0)
+#else
+#define PROFILE_OUTPUT_BEGIN(cpu)
+#define PROFILE_OUTPUT_END(cpu)
+#endif
+
+/* Registers, scoreboard and pc of hardware thread t, thread 0 runs on
+ * those of the cpu
+ */
+#define THREAD_REGS(cpu, t)                                                  \
+  (ENABLED(FEATURE_SMT, t) ? (cpu)->smt->context[t].regs : (cpu)->regs)
+#define THREAD_VALID(cpu, t)                                                 \
+  (ENABLED(FEATURE_SMT, t) ? (cpu)->smt->context[t].regs_valid              \
+                           : (cpu)->regs_valid)
+#define THREAD_PC(cpu, t)                                                    \
+  (*(ENABLED(FEATURE_SMT, t) ? &(cpu)->smt->context[t].pc : &(cpu)->pc))
+
+/* Counts an event of the current telemetry window */
+#define TELEMETRY_COUNT(cpu, field)                                          \
+  do {                                                                       \
+    if (ENABLED(FEATURE_TELEMETRY, (cpu)->telemetry)) {                      \
+      (cpu)->telemetry->current.field++;                                     \
+    }                                                                        \
+  } while (0)
 
 /*
  * This function creates and initializes APEX cpu.
@@ -27,28 +111,98 @@ APEX_cpu_init(const char* filename)
   if (!filename) {
     return NULL;
   }
+  return APEX_cpu_init_files(&filename, 1);
+}
+
+/*
+ * Creates an APEX cpu running the program linked from the source files,
+ * with its data sections loaded into data memory
+ */
+APEX_CPU*
+APEX_cpu_init_files(const char* const* filenames, int num_files)
+{
+  /* Parse input files and create code memory */
+#if APEX_SELF_PROFILE
+  unsigned long long parse_start = APEX_profile_ticks();
+#endif
+  APEX_Program program;
+  if (APEX_assemble(filenames, num_files, 0, &program)) {
+    return NULL;
+  }
+
+  APEX_CPU* cpu = APEX_cpu_init_program(&program);
+  if (!cpu) {
+    APEX_program_free(&program);
+    return NULL;
+  }
+  cpu->owns_code_memory = 1;
+  free(program.data);
+#if APEX_SELF_PROFILE
+  cpu->parse_ticks = APEX_profile_ticks() - parse_start;
+#endif
+  return cpu;
+}
 
-  APEX_CPU* cpu = malloc(sizeof(*cpu));
+/*
+ * This function creates an APEX cpu which runs code memory owned by the
+ * caller. The code is only read, several cpus may share it.
+ */
+APEX_CPU*
+APEX_cpu_init_shared(APEX_Instruction* code_memory, int code_memory_size)
+{
+  /* Zeroed, so every model, hook and counter starts off and at 0 */
+  APEX_CPU* cpu = calloc(1, sizeof(*cpu));
   if (!cpu) {
     return NULL;
   }
 
   /* Initialize PC, Registers and all pipeline stages */
   cpu->pc = 4000;
-  memset(cpu->regs, 0, sizeof(int) * 32);
   memset(cpu->regs_valid, 1, sizeof(int) * 32);
-  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
-  memset(cpu->data_memory, 0, sizeof(int) * 4000);
+  cpu->debug_messages = 1;
+  cpu->ff_mode = FF_JIT;
+  cpu->specialize = 1;
 
-  /* Parse input file and create code memory */
-  cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
+  cpu->code_memory = code_memory;
+  cpu->code_memory_size = code_memory_size;
 
-  if (!cpu->code_memory) {
-    free(cpu);
-    return NULL;
+  /* Build the default pipeline, this makes all stages busy except Fetch */
+  APEX_pipeline_configure(cpu, APEX_DEFAULT_PIPELINE);
+
+  //Compute the value of a flag:: clock_stalled_cycles
+  //cpu->clock_stalled_cycles=NUM_STAGES+(1*(cpu->code_memory_size-1)); // compute the value of clock cycles
+
+  // after that add when stalled
+  // then check if clock executed(cpu->clck) and stalled flag(cpu->clock_stalled_cycles): if equl then simulate will work further
+
+
+
+  return cpu;
+}
+
+/*
+ * Creates an APEX cpu running the code of program, which stays owned by the
+ * caller, with its data loaded into data memory
+ */
+APEX_CPU*
+APEX_cpu_init_program(const APEX_Program* program)
+{
+  APEX_CPU* cpu = APEX_cpu_init_shared(program->code, program->code_size);
+  if (cpu) {
+    memcpy(cpu->data_memory, program->data,
+           sizeof(int) * program->data_size);
   }
+  return cpu;
+}
 
-  if (ENABLE_DEBUG_MESSAGES) {
+/*
+ * This function dumps the code memory loaded by APEX_cpu_init.
+ */
+void
+APEX_cpu_print_code_memory(APEX_CPU* cpu)
+{
+  PROFILE_OUTPUT_BEGIN(cpu);
+  if (DEBUG_MESSAGES(cpu)) {
     fprintf(stderr,
             "APEX_CPU : Initialized APEX CPU, loaded %d instructions\n",
             cpu->code_memory_size);
@@ -64,21 +218,7 @@ APEX_cpu_init(const char* filename)
              cpu->code_memory[i].imm);
     }
   }
-
-  /* Make all stages busy except Fetch stage, initally to start the pipeline */
-  for (int i = 1; i < NUM_STAGES; ++i) {
-    cpu->stage[i].busy = 1;
-  }
-
-  //Compute the value of a flag:: clock_stalled_cycles
-  //cpu->clock_stalled_cycles=NUM_STAGES+(1*(cpu->code_memory_size-1)); // compute the value of clock cycles
-
-  // after that add when stalled
-  // then check if clock executed(cpu->clck) and stalled flag(cpu->clock_stalled_cycles): if equl then simulate will work further
-
-
-
-  return cpu;
+  PROFILE_OUTPUT_END(cpu);
 }
 
 /*
@@ -90,20 +230,82 @@ APEX_cpu_init(const char* filename)
 void
 APEX_cpu_stop(APEX_CPU* cpu)
 {
-  free(cpu->code_memory);
+#if APEX_SELF_PROFILE
+  if (cpu->profile) {
+    APEX_profile_report(cpu->profile, cpu, stderr);
+    free(cpu->profile);
+  }
+#endif
+  if (cpu->replay) {
+    APEX_replay_close(cpu);
+  }
+  if (cpu->smt) {
+    APEX_smt_report(cpu, stderr);
+    APEX_smt_free(cpu->smt);
+  }
+  if (cpu->bad_accesses) {
+    fprintf(stderr, "APEX_CPU : %ld data accesses outside data memory "
+                    "ignored\n",
+            cpu->bad_accesses);
+  }
+  if (cpu->telemetry) {
+    APEX_telemetry_close(cpu);
+  }
+  if (cpu->memtrace) {
+    APEX_memtrace_flush(cpu->memtrace);
+    fprintf(stderr, "APEX_CPU : Traced %ld memory accesses in %ld bytes\n",
+            cpu->memtrace->records, cpu->memtrace->bytes);
+    APEX_memtrace_close(cpu->memtrace);
+  }
+  if (cpu->lsq) {
+    APEX_lsq_report(cpu->lsq, stderr);
+    APEX_lsq_free(cpu->lsq);
+  }
+  if (cpu->prefetch) {
+    APEX_prefetch_report(cpu->prefetch, stderr);
+    APEX_prefetch_free(cpu->prefetch);
+  }
+  if (cpu->vpred) {
+    APEX_vpred_report(cpu, stderr);
+    APEX_vpred_free(cpu->vpred);
+  }
+  if (cpu->energy) {
+    APEX_energy_report(cpu->energy, stderr);
+    APEX_energy_free(cpu->energy);
+  }
+  if (cpu->analysis) {
+    APEX_analysis_compare(cpu->analysis, cpu, stderr);
+    APEX_analysis_free(cpu->analysis);
+  }
+  if (cpu->owns_code_memory) {
+    free(cpu->code_memory);
+  }
   free(cpu);
 }
 
+/* Arithmetic of the 32 bit datapath, wraps around instead of overflowing */
+static int
+wrap_add(int a, int b)
+{
+  return (int)((unsigned)a + (unsigned)b);
+}
+
+static int
+wrap_sub(int a, int b)
+{
+  return (int)((unsigned)a - (unsigned)b);
+}
+
 /* Converts the PC(4000 series) into
  * array index for code memory
  *
  * Note : You are not supposed to edit this function
  *
  */
-int
+static int
 get_code_index(int pc)
 {
-  return (pc - 4000) / 4;
+  return ((long)pc - 4000) / 4;
 }
 
 static void
@@ -152,358 +354,365 @@ print_instruction(CPU_Stage* stage)
  *
  */
 static void
-print_stage_content(char* name, CPU_Stage* stage)
+print_stage_content(APEX_CPU* cpu, const char* name, CPU_Stage* stage)
 {
+  PROFILE_OUTPUT_BEGIN(cpu);
   printf("%-15s: pc(%d) ", name, stage->pc);
+  if (cpu->smt) {
+    printf("T%d ", stage->thread);
+  }
   print_instruction(stage);
   printf("\n");
+  PROFILE_OUTPUT_END(cpu);
 }
 
 /*
- *  Fetch Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Sets or clears the stall flag of all stages in front of stage s
  */
-int
-fetch(APEX_CPU* cpu)
+static void
+stall_upstream(APEX_CPU* cpu, int s, int stalled)
 {
-  CPU_Stage* stage = &cpu->stage[F];
-  if (!stage->busy && !stage->stalled) {
-    /* Store current PC in fetch latch */
-    stage->pc = cpu->pc;
-
-    /* Index into code memory using this pc and copy all instruction fields into
-     * fetch latch
-     */
-    APEX_Instruction* current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
-
-    strcpy(stage->opcode, current_ins->opcode);
-    stage->rd = current_ins->rd;
-    stage->rs1 = current_ins->rs1;
-    stage->rs2 = current_ins->rs2;
-    stage->imm = current_ins->imm;
-    //stage->rd = current_ins->rd;
-
-    /* Update PC for next instruction */
-    cpu->pc += 4;
-
-    /* Copy data from fetch latch to decode latch*/
-    cpu->stage[DRF] = cpu->stage[F];
-
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Fetch", stage);
-    }
+  for (int i = 0; i < s; ++i) {
+    cpu->stage[i].stalled = stalled;
   }
-  else{
+}
 
-  //printf("..................In else part of fetch..................\n");
- // strcpy(cpu->stage[F].opcode,"NO-OP");
-  strcpy(stage->opcode,"NO-OP");
-  if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Fetch", stage);
-    }
+/*
+ * Squashes all instructions of the thread of stage s in front of it and
+ * refetches from pc
+ */
+static void
+flush_upstream(APEX_CPU* cpu, int s, int pc)
+{
+  int thread = cpu->stage[s].thread;
+  int held = 0;
+
+  for (int i = s - 1; i >= 0; --i) {
+    if (cpu->smt && cpu->stage[i].thread != thread) {
+      /* Other threads keep their instructions, and the stages in front of
+       * one waiting in decode stay stalled
+       */
+      held |= cpu->stage[i].stalled && !cpu->stage[i].busy;
+      continue;
+    }
+    if (cpu->telemetry && i > 0 && !cpu->stage[i].busy) {
+      cpu->telemetry->current.squashed++;
+    }
+    cpu->stage[i].busy = i > 0;
+    cpu->stage[i].stalled = held && cpu->stage[i].stalled;
+    cpu->stage_wait[i] = 0;
+  }
+  THREAD_PC(cpu, thread) = pc;
 
+  /* Stores past the last execute stage are only squashed from writeback */
+  if (cpu->lsq && cpu->pipeline[s].kind == STAGE_WRITEBACK) {
+    APEX_lsq_flush(cpu->lsq);
   }
-  return 0;
 }
 
 /*
- *  Decode Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Counts a cycle for which decode holds the instruction in stage for an
+ * operand
  */
-int
-decode(APEX_CPU* cpu)
+static void
+dependency_stall(APEX_CPU* cpu, CPU_Stage* stage)
 {
-  CPU_Stage* stage = &cpu->stage[DRF];
+  int index = get_code_index(stage->pc);
 
-  //printf("THe valu of stage->stalled::%d\n",stage->stalled);
-  if(stage->stalled) {
-    stage->stalled = 0;
-    //strcpy(cpu->stage[F].opcode, "NO-OP");
-    //printf("Opcode on fetch stage is::%s\n",cpu->stage[F].opcode);
+  TELEMETRY_COUNT(cpu, dependency_stalls);
+  if (cpu->stall_profile && index >= 0 && index < cpu->code_memory_size) {
+    cpu->stall_profile[index]++;
   }
+}
 
-  if (!stage->busy && !stage->stalled) {
-
-    /* Read data from register file for store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-    stage->rs1_value=stage->rs1;
-    stage->rs2_value=stage->rs2;
-    }
-
-    /* No Register file read needed for MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-    //printf("Val of rd in decode stage:: %d \n",cpu->regs_valid[stage->rd]);
-    //stage->buffer = cpu->regs[stage->imm];
-
-    stage->buffer = stage->imm;
-
-
-    //cpu->regs_valid[stage->rd] = 1;
-    }
-
-    if (strcmp(stage->opcode, "ADDL") == 0) {
-    printf("Validity of rs1:: %d\n",cpu->regs_valid[stage->rs1]);
-    printf("Validity of rs2:: %d\n",cpu->regs_valid[stage->rs2]);
-        if(cpu->regs_valid[stage->rs1] && cpu->regs_valid[stage->rs2]){
-        printf("::::::::::::::::::NOT In stalled::::::::::::::::");
-        cpu->stage[F].stalled=0;
-        cpu->stage[DRF].stalled=0;
-        stage->rs1_value=cpu->regs[stage->rs1];
-         cpu->regs_valid[stage->rd]=0;
-        }
-        else{
-        printf("::::::::::::::::::In stalled::::::::::::::::");
-        cpu->stage[F].stalled=1 ; //F stage needs to be stalled otherise it will take new instruction everytime.
-        cpu->stage[DRF].stalled=1;
-        cpu->clock_stalled_cycles++;
-        //cpu->clock_stalled_cycles=cpu->clock+cpu->clock_stalled_cycles;
-        //cpu->clock++;
-        //cpu->clock_stalled_cycles++;
-        //cpu->code_memory_size++;
-        //cpu->ins_completed++;
-        }
-
-    }
-
-
-    if (strcmp(stage->opcode, "SUB") == 0) {
-    stage->rs1_value=stage->rs1;
-    stage->rs2_value=stage->rs2;
-    }
-
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-    stage->rs1_value=stage->rs1;
-    //printf("DRF::Val of rs1 in load::%d\n",stage->rs1);
-    }
-
-    if (strcmp(stage->opcode, "JUMP") == 0) {
-        stage->rs1_value= cpu->regs[stage->rs1];
-
-    }
-
-
-    /* Copy data from decode latch to execute latch*/
-    cpu->stage[EX1] = cpu->stage[DRF];
-
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Decode/RF", stage);
-    }
+/*
+ * Load-use interlock of the value prediction framework for the consumer in
+ * decode stage s. Returns 1 if it has to wait, otherwise sets *producer to
+ * the LOAD whose predicted value it uses, if any.
+ */
+static int
+load_use_wait(APEX_CPU* cpu, int s, CPU_Stage** producer)
+{
+  *producer = APEX_vpred_producer(cpu, s, cpu->stage[s].rs1);
+  if (*producer && !(*producer)->vp_valid) {
+    /* Bubble into execute, fetch holds */
+    cpu->stage[s + 1].busy = 1;
+    stall_upstream(cpu, s, 1);
+    cpu->vpred->interlock_cycles++;
+    dependency_stall(cpu, &cpu->stage[s]);
+    return 1;
   }
+  stall_upstream(cpu, s, 0);
   return 0;
 }
 
 /*
- *  Execute Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Appends the access of a LOAD or STORE in stage to the memory trace
  */
-int
-execute1(APEX_CPU* cpu)
+static void
+trace_access(APEX_CPU* cpu, CPU_Stage* stage)
 {
-  CPU_Stage* stage = &cpu->stage[EX1];
-  if (!stage->busy && !stage->stalled) {
-
-    /* Store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-    }
+  APEX_Mem_Record record;
 
-    /* MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-    }
+  record.is_store = strcmp(stage->opcode, "STORE") == 0;
+  if (!record.is_store && strcmp(stage->opcode, "LOAD") != 0) {
+    return;
+  }
+  record.cycle = cpu->clock;
+  record.pc = stage->pc;
+  record.address = stage->mem_address;
+  record.value = record.is_store ? stage->rs1_value : stage->buffer;
+  APEX_memtrace_record(cpu->memtrace, &record);
+}
 
-    if (strcmp(stage->opcode, "ADDL") == 0) {
-    }
-    if (strcmp(stage->opcode, "SUB") == 0) {
-    }
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-    }
+/*
+ * Holds the pipeline for the latency of a LOAD or STORE in stage as
+ * modelled by the load/store queue
+ */
+static void
+lsq_access(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  if (strcmp(stage->opcode, "STORE") == 0) {
+    cpu->freeze_cycles += APEX_lsq_store(cpu, stage);
+  } else if (strcmp(stage->opcode, "LOAD") == 0) {
+    cpu->freeze_cycles += APEX_lsq_load(cpu, stage);
+  }
+}
 
-    /* Copy data from Execute latch to Memory latch*/
-    cpu->stage[EX2] = cpu->stage[EX1];
+/*
+ * Returns 1 if the access of stage is inside data memory, otherwise reports
+ * it (the first time only) and counts it, the access is then ignored and a
+ * LOAD reads 0
+ */
+static int
+valid_access(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  int words = sizeof(cpu->data_memory) / sizeof(cpu->data_memory[0]);
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Execute1", stage);
-    }
+  if (stage->mem_address >= 0 && stage->mem_address < words) {
+    return 1;
+  }
+  if (!cpu->bad_accesses++) {
+    fprintf(stderr,
+            "APEX_Error : pc(%d) %s accesses data memory address %d outside "
+            "0-%d, ignored\n",
+            stage->pc, stage->opcode, stage->mem_address, words - 1);
   }
   return 0;
 }
 
-int
-execute2(APEX_CPU* cpu)
+#if APEX_SELF_PROFILE
+/*
+ * Runs the function of stage s, timing it without its printing
+ */
+static void
+profile_stage(APEX_CPU* cpu, int s)
 {
-    CPU_Stage* stage = &cpu->stage[EX2];
-    if (!stage->busy && !stage->stalled) {
-
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-    }
-    if (strcmp(stage->opcode, "STORE") == 0) {
-    stage->mem_address=stage->rs2_value+stage->imm;
-    }
-
-    if (strcmp(stage->opcode, "ADDL") == 0) {
+  APEX_Profile* profile = cpu->profile;
+  unsigned long long output = profile->phase[PROFILE_OUTPUT];
+  unsigned long long start = APEX_profile_ticks();
 
-    stage->temp_result=(stage->rs1_value+stage->imm);
+  cpu->pipeline[s].function(cpu, s);
 
-    }
+  unsigned long long ticks = APEX_profile_ticks() - start -
+                             (profile->phase[PROFILE_OUTPUT] - output);
+  profile->stage[s] += ticks;
+  profile->staged += ticks;
+}
+#endif
 
-    if (strcmp(stage->opcode, "SUB") == 0) {
+/* The generic stages, which check every feature at runtime and are the
+ * ones the pipeline is assembled from
+ */
+#define VARIANT(name) APEX_##name
+#define VARIANT_LINKAGE
+#define VARIANT_FEATURES FEATURES_ALL
+#include "cpu_stages.h"
+
+/* Nothing but the pipeline: sweeps, the scheduler and the fuzzer */
+#define VARIANT(name) name##_quiet
+#define VARIANT_LINKAGE static
+#define VARIANT_FEATURES 0
+#include "cpu_stages.h"
+
+/* Stage messages of apex_sim */
+#define VARIANT(name) name##_trace
+#define VARIANT_LINKAGE static
+#define VARIANT_FEATURES FEATURE_DEBUG
+#include "cpu_stages.h"
+
+/* Cores of apex_mp */
+#define VARIANT(name) name##_multicore
+#define VARIANT_LINKAGE static
+#define VARIANT_FEATURES FEATURE_MEM_HANDLER
+#include "cpu_stages.h"
+
+/* libapex, which observes every data access */
+#define VARIANT(name) name##_library
+#define VARIANT_LINKAGE static
+#define VARIANT_FEATURES FEATURE_HOOKS
+#include "cpu_stages.h"
+
+typedef struct APEX_Variant
+{
+  const char* name;
+  int features;
+  int (*step)(APEX_CPU* cpu);
+  APEX_Stage_Function (*specialize)(APEX_Stage_Function function);
+} APEX_Variant;
+
+/* From the fewest features to all of them */
+static const APEX_Variant variants[] = {
+  { "quiet", 0, step_quiet, specialize_quiet },
+  { "trace", FEATURE_DEBUG, step_trace, specialize_trace },
+  { "multicore", FEATURE_MEM_HANDLER, step_multicore, specialize_multicore },
+  { "library", FEATURE_HOOKS, step_library, specialize_library },
+  { "generic", FEATURES_ALL, APEX_step, APEX_specialize },
+};
+
+#define NUM_VARIANTS (int)(sizeof(variants) / sizeof(variants[0]))
 
-    //printf("The value of rs1 is::%d\n",stage->rs1_value);
-    //printf("The value of rs2 is::%d\n",stage->rs2_value);
-    stage->temp_result=(stage->rs1_value-stage->rs2_value);
-    //printf("The value of test_resukt in SUB is::%d\n",stage->temp_result);
-    }
+/*
+ * Returns the features cpu is configured with
+ */
+static int
+features_in_use(APEX_CPU* cpu)
+{
+  int features = 0;
 
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-    stage->mem_address=stage->rs1_value+stage->imm;
-    printf("EX2::Val of address in load::%d\n",stage->mem_address);
-    }
-        cpu->stage[MEM1] = cpu->stage[EX2];
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Execute2", stage);
-        }
-    }
-    return 0;
+  if (ENABLE_DEBUG_MESSAGES && cpu->debug_messages) {
+    features |= FEATURE_DEBUG;
+  }
+  if (cpu->energy) {
+    features |= FEATURE_ENERGY;
+  }
+  if (cpu->telemetry) {
+    features |= FEATURE_TELEMETRY;
+  }
+  if (cpu->vpred) {
+    features |= FEATURE_VPRED;
+  }
+  if (cpu->lsq) {
+    features |= FEATURE_LSQ;
+  }
+  if (cpu->memtrace) {
+    features |= FEATURE_MEMTRACE;
+  }
+  if (cpu->retire_hook || cpu->access_hook) {
+    features |= FEATURE_HOOKS;
+  }
+  if (cpu->mem_handler) {
+    features |= FEATURE_MEM_HANDLER;
+  }
+  if (cpu->profile) {
+    features |= FEATURE_PROFILE;
+  }
+  if (cpu->smt) {
+    features |= FEATURE_SMT;
+  }
+  if (cpu->prefetch) {
+    features |= FEATURE_PREFETCH;
+  }
+  return features;
 }
 
 /*
- *  Memory Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Chooses the first variant which checks for every feature in use, or the
+ * generic one if cpu is not to be specialized
  */
-int
-memory1(APEX_CPU* cpu)
+static void
+select_variant(APEX_CPU* cpu)
 {
-  CPU_Stage* stage = &cpu->stage[MEM1];
-  if (!stage->busy && !stage->stalled) {
-
+  int features = cpu->specialize ? features_in_use(cpu) : FEATURES_ALL;
+  const APEX_Variant* variant = &variants[NUM_VARIANTS - 1];
 
-
-    /* Store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-    }
-
-    /* MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-    }
-
-    if (strcmp(stage->opcode, "ADDL") == 0) {
-    }
-
-     if (strcmp(stage->opcode, "SUB") == 0) {
-    }
-
-    if (strcmp(stage->opcode, "LOAD") == 0) {
+  for (int i = 0; i < NUM_VARIANTS; ++i) {
+    if (!(features & ~variants[i].features)) {
+      variant = &variants[i];
+      break;
     }
+  }
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    cpu->variant_stage[s] = variant->specialize(cpu->pipeline[s].function);
+  }
+  cpu->variant = variant;
+}
 
-    /* Copy data from decode latch to execute latch*/
-    cpu->stage[MEM2] = cpu->stage[MEM1];
-
-
-    if (ENABLE_DEBUG_MESSAGES) {
-
-      print_stage_content("Memory1", stage);
-
-    }
+const char*
+APEX_cpu_variant(APEX_CPU* cpu)
+{
+  if (!cpu->variant) {
+    select_variant(cpu);
   }
+  return cpu->variant->name;
+}
 
-  return 0;
+static int
+in_code(APEX_CPU* cpu, int pc)
+{
+  return pc >= 4000 && pc < 4000 + 4 * cpu->code_memory_size;
 }
+
+/*
+ * Returns 1 once the last instruction left the pipeline: fetch is outside
+ * code memory and every latch holds a bubble or an instruction outside of
+ * it
+ */
 int
-memory2(APEX_CPU* cpu)
+APEX_cpu_drained(APEX_CPU* cpu)
 {
-    CPU_Stage* stage = &cpu->stage[MEM2];
-  if (!stage->busy && !stage->stalled) {
-
-  if (strcmp(stage->opcode, "STORE") == 0) {
-  cpu->data_memory[stage->mem_address]=stage->rs1_value;
-
-
-    }
-
-    /* MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-    }
-
-    if (strcmp(stage->opcode, "ADDL") == 0) {
-    }
-
-    if (strcmp(stage->opcode, "SUB") == 0) {
-    }
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-    stage->buffer=cpu->data_memory[stage->mem_address];
-    }
-        cpu->stage[WB] = cpu->stage[MEM2];
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Memory2", stage);
-    }
-
-
-
-    }
+  if (cpu->freeze_cycles || in_code(cpu, cpu->pc) ||
+      (cpu->smt && !APEX_smt_done(cpu))) {
     return 0;
+  }
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    if (cpu->stage_wait[s] ||
+        (!cpu->stage[s].busy && in_code(cpu, cpu->stage[s].pc))) {
+      return 0;
+    }
+  }
+  return 1;
 }
 
 /*
- *  Writeback Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ *  Simulates one clock cycle with the variant of the stages for the
+ *  features in use, chosen on the first cycle
  */
 int
-writeback(APEX_CPU* cpu)
+APEX_cpu_step(APEX_CPU* cpu)
 {
-  CPU_Stage* stage = &cpu->stage[WB];
-  if (!stage->busy && !stage->stalled) {
-
-    /* Update register file */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-
-    //cpu->regs[stage->rd] = stage->imm;
-
-      cpu->regs[stage->rd] = stage->buffer;
-      cpu->regs_valid[stage->rd]=0;
-      //cpu->ins_completed++;
-
-//      printf("BUFFER::%d \n",stage->buffer);
-
-//      printf("Write Back::MOV: %d\n",cpu->regs[stage->rd]);
-    }
-
-    if (strcmp(stage->opcode, "STORE") == 0) {
-    }
-
-    if (strcmp(stage->opcode, "ADDL") == 0) {
-    cpu->regs[stage->rd]=stage->temp_result;
-    cpu->regs_valid[stage->rd]=1;
-
-    }
-
-    if (strcmp(stage->opcode, "SUB") == 0) {
-    cpu->regs[stage->rd]=stage->temp_result;
-    cpu->regs_valid[stage->rd]=0;
-    }
-
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-    cpu->regs[stage->rd]=stage->buffer;
-    printf("WB::Val of buffer in load::%d\n",stage->buffer);
-    cpu->regs_valid[stage->rd]=0;
-    }
-
-
-
-
-    cpu->ins_completed++;
-
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Writeback", stage);
+  /* Drivers other than APEX_cpu_run restore before their first cycle, a
+   * run whose checkpoint could not be restored does not go on from 0
+   */
+  if (cpu->replay && APEX_replay_start(cpu)) {
+    return -1;
+  }
+  if (!cpu->variant) {
+    select_variant(cpu);
+  }
+#if APEX_SELF_PROFILE
+  APEX_Profile* profile = cpu->profile;
+  if (profile) {
+    unsigned long long output = profile->phase[PROFILE_OUTPUT];
+    unsigned long long staged = profile->staged;
+    unsigned long long start = APEX_profile_ticks();
+
+    cpu->variant->step(cpu);
+
+    unsigned long long ticks = APEX_profile_ticks() - start;
+    profile->stepping += ticks;
+    profile->phase[PROFILE_STEP] += ticks - (profile->staged - staged) -
+                                    (profile->phase[PROFILE_OUTPUT] - output);
+    profile->cycles++;
+    if (cpu->replay) {
+      APEX_replay_step(cpu);
     }
+    return 0;
+  }
+#endif
+  cpu->variant->step(cpu);
+  if (cpu->replay) {
+    APEX_replay_step(cpu);
   }
   return 0;
 }
@@ -522,6 +731,27 @@ int no_of_cycles;
 //while (quit_flag!=1)
 //{
 int ch=cpu->command_num;
+
+#if APEX_SELF_PROFILE
+unsigned long long run_start = APEX_profile_ticks();
+#endif
+if (cpu->analyze) {
+  cpu->analysis = APEX_analyze(cpu, stderr);
+}
+if (cpu->ff_instructions && APEX_cpu_fast_forward(cpu)) {
+  return -1;
+}
+if (cpu->replay && APEX_replay_start(cpu)) {
+  return -1;
+}
+#if APEX_SELF_PROFILE
+/* Everything but the steps from here on is printing */
+unsigned long long setup_end = APEX_profile_ticks();
+unsigned long long stepping = cpu->profile ? cpu->profile->stepping : 0;
+if (cpu->profile) {
+  cpu->profile->phase[PROFILE_SETUP] += setup_end - run_start;
+}
+#endif
 //printf("Choose an option::\n");
 //printf("1.Enter s for simulate\n");
 //printf("2.Enter d for display\n");
@@ -586,20 +816,7 @@ switch(ch)
 
 
         for(int k = 0 ; k<cpu->clock_stalled_cycles;k++){
-         if (ENABLE_DEBUG_MESSAGES) {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock);
-      printf("--------------------------------\n");
-    }
-
-    writeback(cpu);
-    memory2(cpu);
-    memory1(cpu);
-    execute2(cpu);
-    execute1(cpu);
-    decode(cpu);
-    fetch(cpu);
-    cpu->clock++;
+    APEX_cpu_step(cpu);
         }
 
 
@@ -617,20 +834,11 @@ switch(ch)
       //==================================================================================================
     }
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock);
-      printf("--------------------------------\n");
+    APEX_cpu_step(cpu);
     }
-
-    writeback(cpu);
-    memory2(cpu);
-    memory1(cpu);
-    execute2(cpu);
-    execute1(cpu);
-    decode(cpu);
-    fetch(cpu);
-    cpu->clock++;
+    /* The other hardware threads run to their end as well */
+    while (cpu->smt && !APEX_cpu_drained(cpu)) {
+      APEX_cpu_step(cpu);
     }
 //==================================================================================================
     printf("=============== STATE OF ARCHITECTURAL REGISTER FILE ==========\n");
@@ -703,20 +911,7 @@ switch(ch)
       //==================================================================================================
     }
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock);
-      printf("--------------------------------\n");
-    }
-
-    writeback(cpu);
-    memory2(cpu);
-    memory1(cpu);
-    execute2(cpu);
-    execute1(cpu);
-    decode(cpu);
-    fetch(cpu);
-    cpu->clock++;
+    APEX_cpu_step(cpu);
     }
 
     //==================================================================================================
@@ -778,6 +973,13 @@ switch(ch)
 //    cpu->clock++;
 //  }
   //}
+#if APEX_SELF_PROFILE
+if (cpu->profile) {
+  cpu->profile->phase[PROFILE_OUTPUT] +=
+    APEX_profile_ticks() - setup_end - (cpu->profile->stepping - stepping);
+}
+#endif
+return 0;
 }
   return 0;
 }
@@ -8,7 +8,9 @@
  *  Gaurav Kothari (gkothar1@binghamton.edu)
  *  State University of New York, Binghamton
  */
+#include <stdio.h>
 
+/* Stage indices of the default 7 stage pipeline */
 enum
 {
   F,
@@ -47,10 +49,66 @@ typedef struct CPU_Stage
   int busy;		    // Flag to indicate, stage is performing some action
   int stalled;		// Flag to indicate, stage is stalled
   int temp_result;  // to compute the result for add
+  int mem_issued;     // LOAD accessed memory at address generation
+  int mem_forwarded;  // Early LOAD found its address in the store buffer
+  long mem_issue_cycle;
+  long mem_ready;     // Cycle the data of an early LOAD arrives
+  long vp_id;         // Number of a LOAD, for value prediction
+  int vp_valid;       // LOAD has a confident predicted value
+  int vp_value;
+  int ap_valid;       // LOAD has a confident predicted address
+  int ap_address;
+  long ap_cycle;      // Cycle the address was predicted
+  int ap_hit;         // Predicted address turned out right
+  int thread;         // Hardware thread of the instruction
 
 
 } CPU_Stage;
 
+/* Most stages a configured pipeline can have */
+#define APEX_MAX_STAGES 16
+
+/* Kinds of pipeline stages, a configured pipeline has one or more stages of
+ * every kind in this order and exactly one writeback stage
+ */
+enum
+{
+  STAGE_FETCH,
+  STAGE_DECODE,
+  STAGE_EXECUTE,
+  STAGE_MEMORY,
+  STAGE_WRITEBACK,
+  NUM_STAGE_KINDS
+};
+
+struct APEX_CPU;
+struct APEX_Program;
+
+/* Function implementing stage s of the pipeline */
+typedef int (*APEX_Stage_Function)(struct APEX_CPU* cpu, int s);
+
+/* Description of one configured pipeline stage */
+typedef struct APEX_Pipeline_Stage
+{
+  char name[16];                  // Name used in debug messages
+  int kind;                       // STAGE_FETCH ... STAGE_WRITEBACK
+  int latency;                    // Cycles an instruction spends in the stage
+  APEX_Stage_Function function;
+} APEX_Pipeline_Stage;
+
+/* Handler for data memory accesses which are serviced outside the core,
+ * returns the loaded value (ignored for stores)
+ */
+typedef int (*APEX_Mem_Handler)(struct APEX_CPU* cpu,
+                                int address,
+                                int is_store,
+                                int value);
+
+/* Called for every instruction leaving writeback and for every LOAD and
+ * STORE in the last memory stage, hook_context is for the caller
+ */
+typedef void (*APEX_Stage_Hook)(struct APEX_CPU* cpu, CPU_Stage* stage);
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -68,12 +126,16 @@ typedef struct APEX_CPU
   int regs[32];
   int regs_valid[32];
 
-  /* Array of 5 CPU_stage */
-  CPU_Stage stage[8];
+  /* Configured pipeline, stage latches and remaining cycles per stage */
+  APEX_Pipeline_Stage pipeline[APEX_MAX_STAGES];
+  int num_stages;
+  CPU_Stage stage[APEX_MAX_STAGES];
+  int stage_wait[APEX_MAX_STAGES];
 
   /* Code Memory where instructions are stored */
   APEX_Instruction* code_memory;
   int code_memory_size;
+  int owns_code_memory;   // 0 when the code is shared with other cpus
 
   /* Data Memory */
   int data_memory[4096];
@@ -81,39 +143,138 @@ typedef struct APEX_CPU
   /* Some stats */
   int ins_completed;
 
-} APEX_CPU;
+  /* Set to 0 to silence per-cycle stage messages at runtime */
+  int debug_messages;
+
+  /* Cycles for which the whole pipeline is held (blocking memory access) */
+  int freeze_cycles;
+
+  /* Instructions to fast-forward functionally before simulation starts */
+  long ff_instructions;
+  int ff_mode;
+
+  /* Optional external data memory, NULL to use data_memory above */
+  APEX_Mem_Handler mem_handler;
+  void* mem_context;
+
+  /* Trace of data memory accesses, NULL when not tracing */
+  struct APEX_Memtrace* memtrace;
+
+  /* Load/store queue timing, NULL for single cycle data accesses */
+  struct APEX_LSQ* lsq;
+
+  /* Data cache and its prefetcher, NULL for no cache */
+  struct APEX_Prefetch* prefetch;
+
+  /* Value and address prediction, NULL for neither (and no load-use
+   * interlock)
+   */
+  struct APEX_VPred* vpred;
+
+  /* Activity based energy model, NULL when not estimating energy */
+  struct APEX_Energy* energy;
+
+  /* Windowed telemetry streamed to a file, NULL when off */
+  struct APEX_Telemetry* telemetry;
+
+  /* Static analysis of the program, run before the simulation if set */
+  int analyze;
+  struct APEX_Analysis* analysis;
+
+  /* LOADs and STOREs outside data memory, ignored */
+  long bad_accesses;
+
+  /* Retire and data access hooks, NULL when not observed */
+  APEX_Stage_Hook retire_hook;
+  APEX_Stage_Hook access_hook;
+  void* hook_context;
 
-APEX_Instruction*
-create_code_memory(const char* filename, int* size);
+  /* Host time per stage, NULL when not profiling the simulator, and the
+   * time parsing the program took
+   */
+  struct APEX_Profile* profile;
+  unsigned long long parse_ticks;
+
+  /* Decode stall cycles per instruction, owned by the caller, NULL when
+   * not profiling
+   */
+  long* stall_profile;
+
+  /* Hardware threads sharing the pipeline, NULL for a single one */
+  struct APEX_SMT* smt;
+
+  /* Recording, restored checkpoint and traced cycles, NULL when none */
+  struct APEX_Replay* replay;
+
+  /* Stages specialized for the features in use, chosen on the first step.
+   * Reset variant to NULL after changing debug_messages, a model, a hook or
+   * mem_handler between steps, specialize 0 always uses the generic stages
+   */
+  int specialize;
+  const struct APEX_Variant* variant;
+  APEX_Stage_Function variant_stage[APEX_MAX_STAGES];
+
+} APEX_CPU;
 
 APEX_CPU*
 APEX_cpu_init(const char* filename);
 
+APEX_CPU*
+APEX_cpu_init_files(const char* const* filenames, int num_files);
+
+APEX_CPU*
+APEX_cpu_init_shared(APEX_Instruction* code_memory, int code_memory_size);
+
+APEX_CPU*
+APEX_cpu_init_program(const struct APEX_Program* program);
+
+void
+APEX_cpu_print_code_memory(APEX_CPU* cpu);
+
+int
+APEX_cpu_step(APEX_CPU* cpu);
+
 int
 APEX_cpu_run(APEX_CPU* cpu);
 
+int
+APEX_cpu_drained(APEX_CPU* cpu);
+
+/* Name of the variant of the stages cpu steps with */
+const char*
+APEX_cpu_variant(APEX_CPU* cpu);
+
 void
 APEX_cpu_stop(APEX_CPU* cpu);
 
 int
-fetch(APEX_CPU* cpu);
+APEX_cpu_set_option(APEX_CPU* cpu, const char* name, const char* value);
+
+void
+APEX_print_options(FILE* out);
+
+int
+APEX_pass_through(APEX_CPU* cpu, int s);
 
 int
-decode(APEX_CPU* cpu);
+APEX_fetch(APEX_CPU* cpu, int s);
 
 int
-execute1(APEX_CPU* cpu);
+APEX_decode(APEX_CPU* cpu, int s);
 
 int
-execute2(APEX_CPU* cpu);
+APEX_execute1(APEX_CPU* cpu, int s);
 
 int
-memory1(APEX_CPU* cpu);
+APEX_execute2(APEX_CPU* cpu, int s);
 
-//int
-//memory2(APEX_CPU* cpu);
+int
+APEX_memory1(APEX_CPU* cpu, int s);
+
+int
+APEX_memory2(APEX_CPU* cpu, int s);
 
 int
-writeback(APEX_CPU* cpu);
+APEX_writeback(APEX_CPU* cpu, int s);
 
 #endif
@@ -0,0 +1,628 @@
+/*
+ *  cpu_stages.h
+ *  Contains the pipeline stages and the step of the APEX cpu as a template,
+ *  included by cpu.c once for every variant of them.
+ *
+ *  Before every inclusion VARIANT(name) gives the names of the variant,
+ *  VARIANT_LINKAGE their linkage and VARIANT_FEATURES the features (see
+ *  cpu.c) it checks for at runtime. The checks of all other features are
+ *  constant false, so a variant for a configuration without energy model,
+ *  telemetry or predictors does not pay for them in the hot loop.
+ */
+#undef CPU_FEATURES
+#define CPU_FEATURES VARIANT_FEATURES
+
+/*
+ * Copies the latch of stage s into the latch of the next stage
+ */
+static void
+VARIANT(advance)(APEX_CPU* cpu, int s)
+{
+  cpu->stage[s + 1] = cpu->stage[s];
+  cpu->stage_wait[s + 1] = cpu->pipeline[s + 1].latency - 1;
+  ENERGY_EVENTS(cpu, EV_LATCH, 1);
+}
+
+/*
+ *  Stage without any function of its own, only delays the instruction
+ *  (extra fetch and decode stages of deeper pipelines)
+ */
+VARIANT_LINKAGE int
+VARIANT(pass_through)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  if (!stage->busy && !stage->stalled) {
+    VARIANT(advance)(cpu, s);
+
+    if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+  }
+  return 0;
+}
+
+/*
+ *  Fetch Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_LINKAGE int
+VARIANT(fetch)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  int thread = 0;
+
+  if (ENABLED(FEATURE_SMT, cpu->smt) && !stage->stalled) {
+    /* Fetch holds a bubble while no thread is inside the code */
+    thread = APEX_smt_select(cpu);
+    stage->busy = thread < 0;
+    if (stage->busy) {
+      cpu->stage[s + 1].busy = 1;
+    }
+  }
+  if (!stage->busy && !stage->stalled) {
+    /* Store current PC in fetch latch */
+    stage->pc = THREAD_PC(cpu, thread);
+    stage->thread = thread;
+
+    /* Index into code memory using this pc and copy all instruction fields into
+     * fetch latch
+     */
+    /* Past the end of code memory an empty instruction is fetched */
+    static const APEX_Instruction past_end;
+    int index = get_code_index(stage->pc);
+    const APEX_Instruction* current_ins = &past_end;
+    if (index >= 0 && index < cpu->code_memory_size) {
+      current_ins = &cpu->code_memory[index];
+    }
+
+    strcpy(stage->opcode, current_ins->opcode);
+    stage->rd = current_ins->rd;
+    stage->rs1 = current_ins->rs1;
+    stage->rs2 = current_ins->rs2;
+    stage->imm = current_ins->imm;
+    //stage->rd = current_ins->rd;
+    ENERGY_EVENTS(cpu, EV_FETCH, 1);
+
+    /* Update PC for next instruction */
+    THREAD_PC(cpu, thread) = wrap_add(stage->pc, 4);
+
+    /* Copy data from fetch latch to decode latch*/
+    VARIANT(advance)(cpu, s);
+
+    if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+  }
+  else{
+
+  //printf("..................In else part of fetch..................\n");
+ // strcpy(cpu->stage[F].opcode,"NO-OP");
+  strcpy(stage->opcode,"NO-OP");
+  if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+
+  }
+  return 0;
+}
+
+/*
+ *  Decode Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_LINKAGE int
+VARIANT(decode)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  int* regs = THREAD_REGS(cpu, stage->thread);
+  int* regs_valid = THREAD_VALID(cpu, stage->thread);
+
+  //printf("THe valu of stage->stalled::%d\n",stage->stalled);
+  if(stage->stalled) {
+    stage->stalled = 0;
+    //strcpy(cpu->stage[F].opcode, "NO-OP");
+    //printf("Opcode on fetch stage is::%s\n",cpu->stage[F].opcode);
+  }
+
+  if (!stage->busy && !stage->stalled) {
+    CPU_Stage* producer = NULL;
+
+    if (ENABLED(FEATURE_VPRED, cpu->vpred) &&
+        (strcmp(stage->opcode, "ADDL") == 0 ||
+         strcmp(stage->opcode, "JUMP") == 0)) {
+      if (load_use_wait(cpu, s, &producer)) {
+        return 0;
+      }
+    }
+
+    /* Read data from register file for store */
+    if (strcmp(stage->opcode, "STORE") == 0) {
+    stage->rs1_value=stage->rs1;
+    stage->rs2_value=stage->rs2;
+    ENERGY_EVENTS(cpu, EV_RF_READ, 2);
+    }
+
+    /* No Register file read needed for MOVC */
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+    //printf("Val of rd in decode stage:: %d \n",cpu->regs_valid[stage->rd]);
+    //stage->buffer = cpu->regs[stage->imm];
+
+    stage->buffer = stage->imm;
+
+
+    //cpu->regs_valid[stage->rd] = 1;
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+    if (DEBUG_MESSAGES(cpu)) {
+    printf("Validity of rs1:: %d\n",regs_valid[stage->rs1]);
+    printf("Validity of rs2:: %d\n",regs_valid[stage->rs2]);
+    }
+        if(regs_valid[stage->rs1] && regs_valid[stage->rs2]){
+        if (DEBUG_MESSAGES(cpu))
+        printf("::::::::::::::::::NOT In stalled::::::::::::::::");
+        stall_upstream(cpu, s, 0);
+        stage->stalled=0;
+        stage->rs1_value=regs[stage->rs1];
+         regs_valid[stage->rd]=0;
+        ENERGY_EVENTS(cpu, EV_RF_READ, 1);
+        }
+        else if (ENABLED(FEATURE_SMT, cpu->smt)) {
+          /* With hardware threads the waiting instruction does not move on,
+           * execute gets a bubble
+           */
+          cpu->clock_stalled_cycles++;
+          dependency_stall(cpu, stage);
+          APEX_smt_stall(cpu, s);
+          if (DEBUG_MESSAGES(cpu)) {
+            print_stage_content(cpu, cpu->pipeline[s].name, stage);
+          }
+          return 0;
+        }
+        else{
+        if (DEBUG_MESSAGES(cpu))
+        printf("::::::::::::::::::In stalled::::::::::::::::");
+        stall_upstream(cpu, s, 1); //F stage needs to be stalled otherise it will take new instruction everytime.
+        stage->stalled=1;
+        cpu->clock_stalled_cycles++;
+        dependency_stall(cpu, stage);
+        //cpu->clock_stalled_cycles=cpu->clock+cpu->clock_stalled_cycles;
+        //cpu->clock++;
+        //cpu->clock_stalled_cycles++;
+        //cpu->code_memory_size++;
+        //cpu->ins_completed++;
+        }
+
+    }
+
+
+    if (strcmp(stage->opcode, "SUB") == 0) {
+    stage->rs1_value=stage->rs1;
+    stage->rs2_value=stage->rs2;
+    ENERGY_EVENTS(cpu, EV_RF_READ, 2);
+    }
+
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    stage->rs1_value=stage->rs1;
+    //printf("DRF::Val of rs1 in load::%d\n",stage->rs1);
+    ENERGY_EVENTS(cpu, EV_RF_READ, 1);
+    if (ENABLED(FEATURE_VPRED, cpu->vpred)) {
+      APEX_vpred_decode_load(cpu, stage);
+    }
+    }
+
+    if (strcmp(stage->opcode, "JUMP") == 0) {
+        stage->rs1_value= regs[stage->rs1];
+        ENERGY_EVENTS(cpu, EV_RF_READ, 1);
+
+    }
+
+    /* Consumer issues speculatively with the predicted value */
+    if (producer) {
+      stage->rs1_value = producer->vp_value;
+      APEX_vpred_use(cpu, producer);
+    }
+
+
+    /* Copy data from decode latch to execute latch*/
+    VARIANT(advance)(cpu, s);
+
+    if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+  }
+  return 0;
+}
+
+/*
+ *  Execute Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_LINKAGE int
+VARIANT(execute1)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  if (!stage->busy && !stage->stalled) {
+
+    /* Store */
+    if (strcmp(stage->opcode, "STORE") == 0) {
+    }
+
+    /* MOVC */
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+    }
+    if (strcmp(stage->opcode, "SUB") == 0) {
+    }
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    }
+
+    /* Copy data from Execute latch to Memory latch*/
+    VARIANT(advance)(cpu, s);
+
+    if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+  }
+  return 0;
+}
+
+VARIANT_LINKAGE int
+VARIANT(execute2)(APEX_CPU* cpu, int s)
+{
+    CPU_Stage* stage = &cpu->stage[s];
+    if (!stage->busy && !stage->stalled) {
+
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+    }
+    if (strcmp(stage->opcode, "STORE") == 0) {
+    stage->mem_address=wrap_add(stage->rs2_value, stage->imm);
+    ENERGY_EVENTS(cpu, EV_ALU, 1);
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+
+    stage->temp_result=wrap_add(stage->rs1_value, stage->imm);
+    ENERGY_EVENTS(cpu, EV_ALU, 1);
+
+    }
+
+    if (strcmp(stage->opcode, "SUB") == 0) {
+
+    //printf("The value of rs1 is::%d\n",stage->rs1_value);
+    //printf("The value of rs2 is::%d\n",stage->rs2_value);
+    stage->temp_result=wrap_sub(stage->rs1_value, stage->rs2_value);
+    ENERGY_EVENTS(cpu, EV_ALU, 1);
+    //printf("The value of test_resukt in SUB is::%d\n",stage->temp_result);
+    }
+
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    stage->mem_address=wrap_add(stage->rs1_value, stage->imm);
+    ENERGY_EVENTS(cpu, EV_ALU, 1);
+    if (DEBUG_MESSAGES(cpu))
+    printf("EX2::Val of address in load::%d\n",stage->mem_address);
+    }
+    if (ENABLED(FEATURE_VPRED, cpu->vpred) &&
+        strcmp(stage->opcode, "LOAD") == 0) {
+      APEX_vpred_check_address(cpu, stage);
+    }
+
+    if (ENABLED(FEATURE_LSQ, cpu->lsq) &&
+        (strcmp(stage->opcode, "LOAD") == 0 ||
+         strcmp(stage->opcode, "STORE") == 0)) {
+      APEX_lsq_address_ready(cpu, stage);
+    }
+    if (ENABLED(FEATURE_PREFETCH, cpu->prefetch) &&
+        (strcmp(stage->opcode, "LOAD") == 0 ||
+         strcmp(stage->opcode, "STORE") == 0)) {
+      APEX_prefetch_observe(cpu, stage);
+    }
+        VARIANT(advance)(cpu, s);
+
+    /* JUMP is taken here, everything fetched behind it is squashed */
+    if (strcmp(stage->opcode, "JUMP") == 0) {
+      int target = wrap_add(stage->rs1_value, stage->imm);
+      ENERGY_EVENTS(cpu, EV_ALU, 1);
+      TELEMETRY_COUNT(cpu, jumps);
+      if (target != wrap_add(stage->pc, 4)) {
+        TELEMETRY_COUNT(cpu, redirects);
+      }
+      flush_upstream(cpu, s, target);
+    }
+        if (DEBUG_MESSAGES(cpu)) {
+            print_stage_content(cpu, cpu->pipeline[s].name, stage);
+        }
+    }
+    return 0;
+}
+
+/*
+ *  Memory Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_LINKAGE int
+VARIANT(memory1)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  if (!stage->busy && !stage->stalled) {
+
+
+
+    /* Store */
+    if (strcmp(stage->opcode, "STORE") == 0) {
+    }
+
+    /* MOVC */
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+    }
+
+     if (strcmp(stage->opcode, "SUB") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    }
+
+    /* Copy data from decode latch to execute latch*/
+    VARIANT(advance)(cpu, s);
+
+
+    if (DEBUG_MESSAGES(cpu)) {
+
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+
+    }
+  }
+
+  return 0;
+}
+
+VARIANT_LINKAGE int
+VARIANT(memory2)(APEX_CPU* cpu, int s)
+{
+    CPU_Stage* stage = &cpu->stage[s];
+  if (!stage->busy && !stage->stalled) {
+
+  if (strcmp(stage->opcode, "STORE") == 0) {
+  if (valid_access(cpu, stage)) {
+    if (ENABLED(FEATURE_MEM_HANDLER, cpu->mem_handler))
+      cpu->mem_handler(cpu, stage->mem_address, 1, stage->rs1_value);
+    else
+      cpu->data_memory[stage->mem_address]=stage->rs1_value;
+  }
+  ENERGY_EVENTS(cpu, EV_MEM_WRITE, 1);
+  TELEMETRY_COUNT(cpu, stores);
+
+
+    }
+
+    /* MOVC */
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "SUB") == 0) {
+    }
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    if (!valid_access(cpu, stage))
+      stage->buffer=0;
+    else if (ENABLED(FEATURE_MEM_HANDLER, cpu->mem_handler))
+      stage->buffer=cpu->mem_handler(cpu, stage->mem_address, 0, 0);
+    else
+      stage->buffer=cpu->data_memory[stage->mem_address];
+    ENERGY_EVENTS(cpu, EV_MEM_READ, 1);
+    TELEMETRY_COUNT(cpu, loads);
+    }
+    if (ENABLED(FEATURE_LSQ, cpu->lsq)) {
+      lsq_access(cpu, stage);
+    }
+    if (ENABLED(FEATURE_PREFETCH, cpu->prefetch)) {
+      cpu->freeze_cycles += APEX_prefetch_access(cpu, stage);
+    }
+    if (ENABLED(FEATURE_MEMTRACE, cpu->memtrace)) {
+      trace_access(cpu, stage);
+    }
+    if (ENABLED(FEATURE_HOOKS, cpu->access_hook) &&
+        (strcmp(stage->opcode, "STORE") == 0 ||
+         strcmp(stage->opcode, "LOAD") == 0)) {
+      cpu->access_hook(cpu, stage);
+    }
+        VARIANT(advance)(cpu, s);
+        if (DEBUG_MESSAGES(cpu)) {
+            print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+
+
+
+    }
+    return 0;
+}
+
+/*
+ *  Writeback Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_LINKAGE int
+VARIANT(writeback)(APEX_CPU* cpu, int s)
+{
+  CPU_Stage* stage = &cpu->stage[s];
+  int* regs = THREAD_REGS(cpu, stage->thread);
+  int* regs_valid = THREAD_VALID(cpu, stage->thread);
+  if (!stage->busy && !stage->stalled) {
+
+    /* Update register file */
+    if (strcmp(stage->opcode, "MOVC") == 0) {
+
+    //cpu->regs[stage->rd] = stage->imm;
+
+      regs[stage->rd] = stage->buffer;
+      regs_valid[stage->rd]=0;
+      ENERGY_EVENTS(cpu, EV_RF_WRITE, 1);
+      //cpu->ins_completed++;
+
+//      printf("BUFFER::%d \n",stage->buffer);
+
+//      printf("Write Back::MOV: %d\n",cpu->regs[stage->rd]);
+    }
+
+    if (strcmp(stage->opcode, "STORE") == 0) {
+    }
+
+    if (strcmp(stage->opcode, "ADDL") == 0) {
+    regs[stage->rd]=stage->temp_result;
+    regs_valid[stage->rd]=1;
+    ENERGY_EVENTS(cpu, EV_RF_WRITE, 1);
+
+    }
+
+    if (strcmp(stage->opcode, "SUB") == 0) {
+    regs[stage->rd]=stage->temp_result;
+    regs_valid[stage->rd]=0;
+    ENERGY_EVENTS(cpu, EV_RF_WRITE, 1);
+    }
+
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+    regs[stage->rd]=stage->buffer;
+    ENERGY_EVENTS(cpu, EV_RF_WRITE, 1);
+    if (DEBUG_MESSAGES(cpu))
+    printf("WB::Val of buffer in load::%d\n",stage->buffer);
+    regs_valid[stage->rd]=0;
+    if (ENABLED(FEATURE_VPRED, cpu->vpred) && APEX_vpred_validate(cpu, stage)) {
+      flush_upstream(cpu, s, wrap_add(stage->pc, 4));
+    }
+    }
+
+
+
+
+    cpu->ins_completed++;
+    if (ENABLED(FEATURE_SMT, cpu->smt)) {
+      cpu->smt->context[stage->thread].retired++;
+    }
+    if (ENABLED(FEATURE_ENERGY, cpu->energy)) {
+      cpu->energy->instructions++;
+    }
+    if (ENABLED(FEATURE_HOOKS, cpu->retire_hook)) {
+      cpu->retire_hook(cpu, stage);
+    }
+
+    if (DEBUG_MESSAGES(cpu)) {
+      print_stage_content(cpu, cpu->pipeline[s].name, stage);
+    }
+  }
+  return 0;
+}
+
+/*
+ *  Simulates one clock cycle of the APEX pipeline
+ *
+ *  Note : While the pipeline is frozen on a blocking memory access
+ *         no stage advances, only the clock does
+ */
+static int
+VARIANT(step)(APEX_CPU* cpu)
+{
+  if (ENABLED(FEATURE_ENERGY, cpu->energy) &&
+      ++cpu->energy->events[EV_CYCLE] == cpu->energy->window_end) {
+    APEX_energy_window(cpu->energy);
+  }
+  if (ENABLED(FEATURE_TELEMETRY, cpu->telemetry) &&
+      cpu->telemetry->current.cycles++ == cpu->telemetry->window) {
+    APEX_telemetry_window(cpu);
+  }
+
+  if (cpu->freeze_cycles > 0) {
+    TELEMETRY_COUNT(cpu, memory_stalls);
+    cpu->freeze_cycles--;
+    cpu->clock++;
+    return 0;
+  }
+
+  if (DEBUG_MESSAGES(cpu)) {
+    PROFILE_OUTPUT_BEGIN(cpu);
+    printf("--------------------------------\n");
+    printf("Clock Cycle #: %d\n", cpu->clock);
+    printf("--------------------------------\n");
+    PROFILE_OUTPUT_END(cpu);
+  }
+
+  /* Stages run from the last to the first, so every stage sees the latch
+   * its predecessor filled in the previous cycle
+   */
+  for (int s = cpu->num_stages - 1; s >= 0; --s) {
+    if (cpu->stage_wait[s] > 0) {
+      /* Multi cycle stage keeps its instruction, a bubble moves on and all
+       * stages in front of it hold
+       */
+      cpu->stage_wait[s]--;
+      if (s + 1 < cpu->num_stages) {
+        cpu->stage[s + 1].busy = 1;
+      }
+      break;
+    }
+    if (cpu->stage[s].busy && s + 1 < cpu->num_stages) {
+      /* Bubbles move on like instructions */
+      cpu->stage[s + 1].busy = 1;
+    }
+#if APEX_SELF_PROFILE
+    if (ENABLED(FEATURE_PROFILE, cpu->profile)) {
+      profile_stage(cpu, s);
+      continue;
+    }
+#endif
+    cpu->variant_stage[s](cpu, s);
+  }
+  cpu->clock++;
+  return 0;
+}
+
+/*
+ * Returns the function of this variant for the generic stage function
+ */
+static APEX_Stage_Function
+VARIANT(specialize)(APEX_Stage_Function function)
+{
+  static const struct
+  {
+    APEX_Stage_Function generic;
+    APEX_Stage_Function variant;
+  } functions[] = {
+    { APEX_pass_through, VARIANT(pass_through) },
+    { APEX_fetch, VARIANT(fetch) },
+    { APEX_decode, VARIANT(decode) },
+    { APEX_execute1, VARIANT(execute1) },
+    { APEX_execute2, VARIANT(execute2) },
+    { APEX_memory1, VARIANT(memory1) },
+    { APEX_memory2, VARIANT(memory2) },
+    { APEX_writeback, VARIANT(writeback) },
+  };
+
+  for (int i = 0; i < (int)(sizeof(functions) / sizeof(functions[0])); ++i) {
+    if (functions[i].generic == function) {
+      return functions[i].variant;
+    }
+  }
+  return function;
+}
+
+#undef CPU_FEATURES
+#define CPU_FEATURES FEATURES_ALL
+#undef VARIANT
+#undef VARIANT_LINKAGE
+#undef VARIANT_FEATURES
@@ -0,0 +1,171 @@
+/*
+ *  energy.c
+ *  Contains the activity based energy model
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "energy.h"
+
+static const char* event_names[NUM_ENERGY_EVENTS] = {
+  "fetch", "rf-read", "rf-write", "alu", "mem-read", "mem-write", "latch",
+  "cycle"
+};
+
+/* Default costs in pJ, roughly a small in-order core */
+static const double default_cost[NUM_ENERGY_EVENTS] = {
+  10.0, 2.0, 3.0, 4.0, 15.0, 18.0, 1.0, 5.0
+};
+
+APEX_Energy*
+APEX_energy_init(void)
+{
+  APEX_Energy* energy = calloc(1, sizeof(*energy));
+  if (!energy) {
+    return NULL;
+  }
+  memcpy(energy->cost, default_cost, sizeof(energy->cost));
+  energy->mhz = 1000.0;
+  APEX_energy_set_window(energy, 1000);
+  return energy;
+}
+
+/*
+ * Sets the costs of events from a list like "fetch:12,alu:3.5", events not
+ * in the list keep their cost. "default" keeps all of them.
+ */
+int
+APEX_energy_set_costs(APEX_Energy* energy, const char* costs)
+{
+  char list[256];
+  char* save;
+
+  if (!strcmp(costs, "default") || !strcmp(costs, "1")) {
+    return 0;
+  }
+  if (strlen(costs) >= sizeof(list)) {
+    return -1;
+  }
+  strcpy(list, costs);
+
+  for (char* item = strtok_r(list, ",", &save); item;
+       item = strtok_r(NULL, ",", &save)) {
+    char* value = strchr(item, ':');
+    char* end;
+    int event;
+
+    if (!value) {
+      return -1;
+    }
+    *value++ = '\0';
+    for (event = 0; event < NUM_ENERGY_EVENTS; ++event) {
+      if (!strcmp(item, event_names[event])) {
+        break;
+      }
+    }
+    double cost = strtod(value, &end);
+    if (event == NUM_ENERGY_EVENTS || end == value || *end || cost < 0) {
+      return -1;
+    }
+    energy->cost[event] = cost;
+  }
+  return 0;
+}
+
+double
+APEX_energy_total(APEX_Energy* energy)
+{
+  double total = 0;
+  for (int i = 0; i < NUM_ENERGY_EVENTS; ++i) {
+    total += energy->events[i] * energy->cost[i];
+  }
+  return total;
+}
+
+/*
+ * Sets the cycles per power sample, before the simulation starts
+ */
+void
+APEX_energy_set_window(APEX_Energy* energy, int window)
+{
+  energy->window = window;
+  energy->window_end = window;
+}
+
+/*
+ * Called by the step function when the cycle count reaches window_end
+ */
+void
+APEX_energy_window(APEX_Energy* energy)
+{
+  energy->window_end += energy->window;
+  if (energy->num_samples == energy->max_samples) {
+    int max = energy->max_samples ? 2 * energy->max_samples : 64;
+    double* samples = realloc(energy->samples, max * sizeof(double));
+    if (!samples) {
+      return;
+    }
+    energy->samples = samples;
+    energy->max_samples = max;
+  }
+  double total = APEX_energy_total(energy);
+  energy->samples[energy->num_samples++] = total - energy->window_start;
+  energy->window_start = total;
+}
+
+/* Power in mW of energy pJ spent in cycles at the clock frequency */
+static double
+power(APEX_Energy* energy, double pj, long cycles)
+{
+  return cycles ? pj * energy->mhz / cycles / 1000.0 : 0.0;
+}
+
+void
+APEX_energy_report(APEX_Energy* energy, FILE* out)
+{
+  long cycles = energy->events[EV_CYCLE];
+  double total = APEX_energy_total(energy);
+
+  for (int i = 0; i < NUM_ENERGY_EVENTS; ++i) {
+    double pj = energy->events[i] * energy->cost[i];
+    fprintf(out,
+            "APEX_ENERGY : %-9s %10ld x %6.2f pJ = %14.1f pJ (%5.1f%%)\n",
+            event_names[i], energy->events[i], energy->cost[i], pj,
+            total ? 100.0 * pj / total : 0.0);
+  }
+  fprintf(out,
+          "APEX_ENERGY : %ld instructions in %ld cycles, %.1f pJ, %.2f pJ per "
+          "instruction, average power %.3f mW at %.0f MHz\n",
+          energy->instructions, cycles, total,
+          energy->instructions ? total / energy->instructions : 0.0,
+          power(energy, total, cycles), energy->mhz);
+
+  if (!energy->num_samples) {
+    return;
+  }
+  double low = energy->samples[0];
+  double high = energy->samples[0];
+  for (int i = 0; i < energy->num_samples; ++i) {
+    double pj = energy->samples[i];
+    low = pj < low ? pj : low;
+    high = pj > high ? pj : high;
+    fprintf(out, "APEX_ENERGY : cycles %ld-%ld %.3f mW\n",
+            (long)i * energy->window, (long)(i + 1) * energy->window - 1,
+            power(energy, pj, energy->window));
+  }
+  fprintf(out,
+          "APEX_ENERGY : power over %d windows of %d cycles, min %.3f mW, "
+          "max %.3f mW\n",
+          energy->num_samples, energy->window,
+          power(energy, low, energy->window),
+          power(energy, high, energy->window));
+}
+
+void
+APEX_energy_free(APEX_Energy* energy)
+{
+  if (energy) {
+    free(energy->samples);
+    free(energy);
+  }
+}
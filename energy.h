@@ -0,0 +1,70 @@
+#ifndef _APEX_ENERGY_H_
+#define _APEX_ENERGY_H_
+/**
+ *  energy.h
+ *  Contains the activity based energy model.
+ *
+ *  The stage functions count events (instruction fetches, register file
+ *  reads and writes, ALU operations, data memory accesses, latch writes)
+ *  and every simulated cycle counts once for clock tree and leakage. The
+ *  energy of a run is the sum of the events times their configurable cost
+ *  in pJ. Every window cycles the energy of the window is kept, which gives
+ *  the power over time at the configured clock frequency.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* Events counted by the stage functions */
+enum
+{
+  EV_FETCH,       // Instruction read from code memory
+  EV_RF_READ,     // Register file read port
+  EV_RF_WRITE,
+  EV_ALU,         // Operation or address generation in execute
+  EV_MEM_READ,    // Data memory access
+  EV_MEM_WRITE,
+  EV_LATCH,       // Pipeline latch written
+  EV_CYCLE,       // Clock tree and leakage, every cycle
+  NUM_ENERGY_EVENTS
+};
+
+typedef struct APEX_Energy
+{
+  long events[NUM_ENERGY_EVENTS];
+  double cost[NUM_ENERGY_EVENTS];   // pJ per event
+  double mhz;                       // Clock frequency for power
+
+  long instructions;                // Retired in the detailed simulation
+
+  /* Energy of every completed window of window cycles */
+  int window;
+  long window_end;                  // Cycle count closing the window
+  double window_start;              // Total energy when the window began
+  double* samples;
+  int num_samples;
+  int max_samples;
+} APEX_Energy;
+
+APEX_Energy*
+APEX_energy_init(void);
+
+int
+APEX_energy_set_costs(APEX_Energy* energy, const char* costs);
+
+void
+APEX_energy_set_window(APEX_Energy* energy, int window);
+
+void
+APEX_energy_window(APEX_Energy* energy);
+
+double
+APEX_energy_total(APEX_Energy* energy);
+
+void
+APEX_energy_report(APEX_Energy* energy, FILE* out);
+
+void
+APEX_energy_free(APEX_Energy* energy);
+
+#endif
@@ -0,0 +1,429 @@
+/*
+ *  fastforward.c
+ *  Contains the functional fast-forward engine, used to skip over the start
+ *  of long programs before detailed simulation.
+ *
+ *  The engine mirrors the datapath of cpu.c: MOVC, ADDL and LOAD write rd,
+ *  SUB and STORE take their operands from the register specifiers, and in
+ *  addition JUMP transfers control to R[rs1] + imm. Execution stops when the
+ *  pc leaves code memory or the instruction budget is used up.
+ *
+ *  Blocks are interpreted until they become hot, then translated to host
+ *  code (jit_x86_64.c). The dispatcher patches the fall through exit of a
+ *  translated block to jump straight into its translated successor.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "fastforward.h"
+
+/* Size of the translation cache, it is flushed when full */
+#define FF_CODE_CAPACITY (1 << 20)
+
+/* Room needed to translate the largest block */
+#define FF_MAX_BLOCK_BYTES 2048
+
+static void
+predecode(const APEX_Instruction* ins, FF_Op* op)
+{
+  op->op = OP_NOP;
+  op->rd = ins->rd;
+  op->rs1 = ins->rs1;
+  op->rs2 = ins->rs2;
+  op->imm = ins->imm;
+
+  if (strcmp(ins->opcode, "MOVC") == 0) {
+    op->op = OP_MOVC;
+  } else if (strcmp(ins->opcode, "ADDL") == 0) {
+    op->op = OP_ADDL;
+  } else if (strcmp(ins->opcode, "SUB") == 0) {
+    op->op = OP_SUB;
+  } else if (strcmp(ins->opcode, "STORE") == 0) {
+    op->op = OP_STORE;
+  } else if (strcmp(ins->opcode, "LOAD") == 0) {
+    op->op = OP_LOAD;
+  } else if (strcmp(ins->opcode, "JUMP") == 0) {
+    op->op = OP_JUMP;
+  }
+}
+
+static int
+valid_reg(int r)
+{
+  return r >= 0 && r < 32;
+}
+
+static int
+valid_address(long address)
+{
+  return address >= 0 && address < FF_MEMORY_WORDS;
+}
+
+/*
+ * Returns 1 if op can execute without touching state out of range
+ */
+static int
+op_valid(const FF_Op* op)
+{
+  switch (op->op) {
+    case OP_MOVC:
+    case OP_SUB:
+      return valid_reg(op->rd);
+    case OP_ADDL:
+      return valid_reg(op->rd) && valid_reg(op->rs1);
+    case OP_STORE:
+      return valid_address((long)op->rs2 + op->imm);
+    case OP_LOAD:
+      return valid_reg(op->rd) && valid_address((long)op->rs1 + op->imm);
+    case OP_JUMP:
+      return valid_reg(op->rs1);
+  }
+  return 1;
+}
+
+static int
+pc_index(FF_Engine* engine, int pc)
+{
+  if (pc < 4000 || (pc - 4000) % 4) {
+    return -1;
+  }
+  int index = (pc - 4000) / 4;
+  return index < engine->code_size ? index : -1;
+}
+
+/*
+ * Executes the instruction at the pc, returns -1 on a fault
+ */
+static int
+interpret(FF_Engine* engine, FF_State* state)
+{
+  const FF_Op* op = &engine->ops[pc_index(engine, state->pc)];
+
+  if (!op_valid(op)) {
+    fprintf(stderr, "APEX_Error : Fast-forward fault at pc(%d)\n",
+            state->pc);
+    return -1;
+  }
+
+  state->pc += 4;
+  switch (op->op) {
+    case OP_MOVC:
+      state->regs[op->rd] = op->imm;
+      state->regs_valid[op->rd] = 0;
+      break;
+    case OP_ADDL:
+      state->regs[op->rd] = (int)((unsigned)state->regs[op->rs1] + op->imm);
+      state->regs_valid[op->rd] = 1;
+      break;
+    case OP_SUB:
+      state->regs[op->rd] = op->rs1 - op->rs2;
+      state->regs_valid[op->rd] = 0;
+      break;
+    case OP_STORE:
+      state->data_memory[op->rs2 + op->imm] = op->rs1;
+      break;
+    case OP_LOAD:
+      state->regs[op->rd] = state->data_memory[op->rs1 + op->imm];
+      state->regs_valid[op->rd] = 0;
+      break;
+    case OP_JUMP:
+      state->pc = (int)((unsigned)state->regs[op->rs1] + op->imm);
+      break;
+  }
+  state->budget--;
+  state->instructions++;
+  engine->stats.interpreted++;
+  return 0;
+}
+
+/*
+ * Returns the number of instructions of the basic block starting at index:
+ * up to and including a JUMP, stopping before an instruction which would
+ * fault and after FF_MAX_BLOCK instructions
+ */
+int
+APEX_ff_block_length(FF_Engine* engine, int index)
+{
+  int length = 0;
+  while (index + length < engine->code_size && length < FF_MAX_BLOCK) {
+    const FF_Op* op = &engine->ops[index + length];
+    if (!op_valid(op)) {
+      break;
+    }
+    length++;
+    if (op->op == OP_JUMP) {
+      break;
+    }
+  }
+  return length;
+}
+
+FF_Engine*
+APEX_ff_engine_init(const APEX_Instruction* code, int code_size, int mode)
+{
+  FF_Engine* engine = calloc(1, sizeof(*engine));
+  if (!engine) {
+    return NULL;
+  }
+
+  engine->mode = mode;
+  engine->hot_threshold = 8;
+  engine->code_size = code_size;
+  engine->ops = malloc(sizeof(FF_Op) * (code_size ? code_size : 1));
+  engine->blocks = calloc(code_size ? code_size : 1, sizeof(FF_Block*));
+  engine->counters = calloc(code_size ? code_size : 1, sizeof(int));
+  if (!engine->ops || !engine->blocks || !engine->counters) {
+    APEX_ff_engine_free(engine);
+    return NULL;
+  }
+
+  for (int i = 0; i < code_size; ++i) {
+    predecode(&code[i], &engine->ops[i]);
+  }
+
+#if defined(__x86_64__)
+  if (mode != FF_INTERPRET) {
+    void* buffer = mmap(NULL, FF_CODE_CAPACITY,
+                        PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+      fprintf(stderr, "APEX_CPU : No executable memory, interpreting\n");
+      engine->mode = FF_INTERPRET;
+    } else {
+      engine->code_buffer = buffer;
+      engine->code_capacity = FF_CODE_CAPACITY;
+    }
+  }
+#else
+  engine->mode = FF_INTERPRET;
+#endif
+  return engine;
+}
+
+static void
+flush_translations(FF_Engine* engine)
+{
+  for (int i = 0; i < engine->code_size; ++i) {
+    free(engine->blocks[i]);
+    engine->blocks[i] = NULL;
+  }
+  engine->code_used = 0;
+  engine->stats.flushes++;
+}
+
+static FF_Block*
+translate(FF_Engine* engine, int index, int length)
+{
+  if (engine->code_capacity - engine->code_used < FF_MAX_BLOCK_BYTES) {
+    flush_translations(engine);
+  }
+
+  FF_Block* block = malloc(sizeof(*block));
+  if (!block) {
+    return NULL;
+  }
+  block->pc = 4000 + index * 4;
+  block->length = length;
+
+  if (APEX_ff_translate(engine, index, length, block)) {
+    free(block);
+    return NULL;
+  }
+  engine->blocks[index] = block;
+  engine->stats.translations++;
+  return block;
+}
+
+/*
+ * Executes block on a copy of the state with the interpreter and compares
+ */
+static int
+check_block(FF_Engine* engine, const FF_State* before, const FF_State* after,
+            FF_State* shadow)
+{
+  memcpy(shadow, before, sizeof(*shadow));
+  long executed = after->instructions - before->instructions;
+  long interpreted = engine->stats.interpreted;
+
+  for (long i = 0; i < executed; ++i) {
+    if (pc_index(engine, shadow->pc) < 0 || interpret(engine, shadow)) {
+      break;
+    }
+  }
+  engine->stats.interpreted = interpreted;
+  engine->stats.checks++;
+
+  if (shadow->pc != after->pc ||
+      shadow->instructions != after->instructions ||
+      memcmp(shadow->regs, after->regs, sizeof(shadow->regs)) ||
+      memcmp(shadow->regs_valid, after->regs_valid,
+             sizeof(shadow->regs_valid)) ||
+      memcmp(shadow->data_memory, after->data_memory,
+             sizeof(shadow->data_memory))) {
+    fprintf(stderr,
+            "APEX_Error : Translated block at pc(%d) diverges from the "
+            "interpreter\n",
+            before->pc);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Runs up to the given number of instructions, returns 0 when the budget is
+ * used up or the pc leaves code memory, -1 on a fault
+ */
+int
+APEX_ff_run(FF_Engine* engine, FF_State* state, long instructions)
+{
+  FF_State* before = NULL;
+  FF_State* shadow = NULL;
+
+  if (engine->mode == FF_SELFCHECK) {
+    before = malloc(sizeof(*before));
+    shadow = malloc(sizeof(*shadow));
+    if (!before || !shadow) {
+      free(before);
+      free(shadow);
+      return -1;
+    }
+  }
+
+  int result = 0;
+  state->budget = instructions;
+
+  while (state->budget > 0) {
+    int index = pc_index(engine, state->pc);
+    if (index < 0) {
+      break;
+    }
+
+    FF_Block* block = engine->blocks[index];
+    if (block && state->budget >= block->length) {
+      long executed = state->instructions;
+
+      if (before) {
+        memcpy(before, state, sizeof(*before));
+      }
+      state->exit_site = NULL;
+      ((void (*)(FF_State*))block->entry)(state);
+      engine->stats.native += state->instructions - executed;
+      engine->stats.dispatches++;
+
+      if (before) {
+        if (check_block(engine, before, state, shadow)) {
+          result = -1;
+          break;
+        }
+      } else if (state->exit_site) {
+        int next = pc_index(engine, state->pc);
+        if (next >= 0 && engine->blocks[next]) {
+          APEX_ff_chain(state->exit_site, engine->blocks[next]);
+          engine->stats.chains++;
+        }
+      }
+      continue;
+    }
+
+    /* Cold block, or fewer instructions left than it has: interpret */
+    int length = APEX_ff_block_length(engine, index);
+    if (!block && engine->mode != FF_INTERPRET && length > 0 &&
+        ++engine->counters[index] >= engine->hot_threshold &&
+        translate(engine, index, length)) {
+      continue;
+    }
+
+    if (!length) {
+      length = 1;
+    }
+    for (int i = 0; i < length && state->budget > 0; ++i) {
+      if (interpret(engine, state)) {
+        result = -1;
+        break;
+      }
+      if (engine->ops[index + i].op == OP_JUMP) {
+        break;
+      }
+    }
+    if (result) {
+      break;
+    }
+  }
+
+  free(before);
+  free(shadow);
+  return result;
+}
+
+void
+APEX_ff_engine_free(FF_Engine* engine)
+{
+  if (!engine) {
+    return;
+  }
+  if (engine->blocks) {
+    for (int i = 0; i < engine->code_size; ++i) {
+      free(engine->blocks[i]);
+    }
+  }
+  if (engine->code_buffer) {
+    munmap(engine->code_buffer, engine->code_capacity);
+  }
+  free(engine->blocks);
+  free(engine->counters);
+  free(engine->ops);
+  free(engine);
+}
+
+/*
+ * This function fast-forwards cpu by cpu->ff_instructions instructions
+ * before detailed simulation starts, the architectural state is handed over
+ * to the (empty) pipeline
+ */
+int
+APEX_cpu_fast_forward(APEX_CPU* cpu)
+{
+  struct timespec start, end;
+
+  FF_Engine* engine =
+    APEX_ff_engine_init(cpu->code_memory, cpu->code_memory_size, cpu->ff_mode);
+  FF_State* state = calloc(1, sizeof(*state));
+  if (!engine || !state) {
+    APEX_ff_engine_free(engine);
+    free(state);
+    return -1;
+  }
+
+  memcpy(state->regs, cpu->regs, sizeof(state->regs));
+  memcpy(state->regs_valid, cpu->regs_valid, sizeof(state->regs_valid));
+  memcpy(state->data_memory, cpu->data_memory, sizeof(state->data_memory));
+  state->pc = cpu->pc;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int result = APEX_ff_run(engine, state, cpu->ff_instructions);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  memcpy(cpu->regs, state->regs, sizeof(state->regs));
+  memcpy(cpu->regs_valid, state->regs_valid, sizeof(state->regs_valid));
+  memcpy(cpu->data_memory, state->data_memory, sizeof(state->data_memory));
+  cpu->pc = state->pc;
+  cpu->ins_completed += state->instructions;
+
+  FF_Stats* s = &engine->stats;
+  fprintf(stderr,
+          "APEX_CPU : Fast-forwarded %ld instructions to pc(%d) in %.3f ms: "
+          "%ld interpreted, %ld translated (%ld blocks, %ld dispatches, "
+          "%ld chains, %ld flushes, %ld checked)\n",
+          state->instructions, state->pc,
+          (end.tv_sec - start.tv_sec) * 1e3 +
+            (end.tv_nsec - start.tv_nsec) / 1e6,
+          s->interpreted, s->native, s->translations, s->dispatches,
+          s->chains, s->flushes, s->checks);
+
+  APEX_ff_engine_free(engine);
+  free(state);
+  return result;
+}
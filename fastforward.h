@@ -0,0 +1,113 @@
+#ifndef _APEX_FASTFORWARD_H_
+#define _APEX_FASTFORWARD_H_
+/**
+ *  fastforward.h
+ *  Contains the functional fast-forward engine: an interpreter over
+ *  predecoded instructions and a translator of hot basic blocks to host
+ *  (x86-64) code, with a translation cache and block chaining
+ */
+#include "cpu.h"
+
+#define FF_MEMORY_WORDS 4096
+#define FF_MAX_BLOCK 64
+
+/* Fast-forward modes */
+enum
+{
+  FF_INTERPRET,   // Interpreter only
+  FF_JIT,         // Translate hot blocks
+  FF_SELFCHECK    // Translate, and check every block against the interpreter
+};
+
+/* Predecoded operations */
+enum
+{
+  OP_NOP,
+  OP_MOVC,
+  OP_ADDL,
+  OP_SUB,
+  OP_STORE,
+  OP_LOAD,
+  OP_JUMP
+};
+
+typedef struct FF_Op
+{
+  int op;
+  int rd;
+  int rs1;
+  int rs2;
+  int imm;
+} FF_Op;
+
+/* Architectural state, translated code addresses it relative to its base */
+typedef struct FF_State
+{
+  int regs[32];
+  int regs_valid[32];   // As left behind by writeback in cpu.c
+  int pc;
+  long budget;          // Instructions left to execute
+  long instructions;    // Instructions executed
+  void* exit_site;      // Chainable jump of the last block exit, or NULL
+  int data_memory[FF_MEMORY_WORDS];
+} FF_State;
+
+/* One translated basic block */
+typedef struct FF_Block
+{
+  int pc;
+  int length;           // Instructions in the block
+  unsigned char* entry; // Host code
+} FF_Block;
+
+typedef struct FF_Stats
+{
+  long interpreted;       // Instructions executed by the interpreter
+  long native;            // Instructions executed in translated code
+  long dispatches;        // Entries into translated code from the dispatcher
+  long translations;
+  long chains;            // Block exits patched to jump to their successor
+  long flushes;           // Translation cache flushes
+  long checks;            // Blocks compared against the interpreter
+} FF_Stats;
+
+typedef struct FF_Engine
+{
+  int mode;
+  int hot_threshold;      // Executions of a block before it is translated
+
+  FF_Op* ops;
+  int code_size;
+
+  /* Translation cache: host code buffer and blocks indexed by code index */
+  unsigned char* code_buffer;
+  size_t code_capacity;
+  size_t code_used;
+  FF_Block** blocks;
+  int* counters;
+
+  FF_Stats stats;
+} FF_Engine;
+
+FF_Engine*
+APEX_ff_engine_init(const APEX_Instruction* code, int code_size, int mode);
+
+int
+APEX_ff_run(FF_Engine* engine, FF_State* state, long instructions);
+
+void
+APEX_ff_engine_free(FF_Engine* engine);
+
+int
+APEX_ff_block_length(FF_Engine* engine, int index);
+
+int
+APEX_ff_translate(FF_Engine* engine, int index, int length, FF_Block* block);
+
+void
+APEX_ff_chain(void* exit_site, FF_Block* target);
+
+int
+APEX_cpu_fast_forward(APEX_CPU* cpu);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ *  fuzz.c
+ *  Contains the fuzzing harness of the parser and the pipeline
+ *
+ *  The first byte of an input selects the configuration, the rest is the
+ *  program text. Built with libFuzzer (APEX_LIBFUZZER) the fuzzer provides
+ *  main and coverage feedback. Otherwise the driver below runs inputs from
+ *  files, directories or stdin (for AFL) and can mutate a corpus at random.
+ */
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "analyze.h"
+#include "assembler.h"
+#include "cpu.h"
+#include "fastforward.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+/* Cycles simulated per input, programs with loops run forever */
+#define FUZZ_MAX_CYCLES 4096
+
+#define FUZZ_MAX_INPUT 65536
+
+static const char* pipelines[] = { "7", "5", "12",
+                                   "F,DRF,EX:2,EX,MEM:3,WB" };
+static const char* predictors[] = { NULL, "last", "stride", "context" };
+
+static FILE* devnull;
+
+/*
+ * Applies the configuration bits: pipeline (2), load/store queue (1),
+ * value predictor (2), fast-forward (1), energy (1), analysis (1)
+ */
+static int
+configure(APEX_CPU* cpu, unsigned config)
+{
+  int result = APEX_cpu_set_option(cpu, "pipeline", pipelines[config & 3]);
+
+  if (config & 4) {
+    result |= APEX_cpu_set_option(cpu, "mem-latency", "2");
+    result |= APEX_cpu_set_option(cpu, "store-buffer", "4");
+    result |= APEX_cpu_set_option(cpu, "load-issue",
+                                  config & 8 ? "mdp" : "speculative");
+  }
+  if (predictors[(config >> 3) & 3]) {
+    result |= APEX_cpu_set_option(cpu, "value-predict",
+                                  predictors[(config >> 3) & 3]);
+    result |= APEX_cpu_set_option(cpu, "address-predict", "stride");
+  }
+  if (config & 32) {
+    result |= APEX_cpu_set_option(cpu, "fast-forward", "64");
+    result |= APEX_cpu_set_option(cpu, "ff-mode", "selfcheck");
+  }
+  if (config & 64) {
+    result |= APEX_cpu_set_option(cpu, "energy", "default");
+    result |= APEX_cpu_set_option(cpu, "energy-window", "100");
+  }
+  if (config & 128) {
+    cpu->analysis = APEX_analyze(cpu, devnull);
+  }
+  return result;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  APEX_Program program;
+
+  if (size < 1) {
+    return 0;
+  }
+  if (!devnull) {
+    devnull = fopen("/dev/null", "w");
+  }
+
+  if (APEX_assemble_buffer((const char*)data + 1, size - 1, &program)) {
+    return 0;
+  }
+  APEX_CPU* cpu = APEX_cpu_init_program(&program);
+  if (!cpu) {
+    APEX_program_free(&program);
+    return 0;
+  }
+  cpu->owns_code_memory = 1;
+  free(program.data);
+  cpu->debug_messages = 0;
+
+  if (!configure(cpu, data[0]) &&
+      !(cpu->ff_instructions && APEX_cpu_fast_forward(cpu))) {
+    while ((cpu->ins_completed < cpu->code_memory_size ||
+            cpu->freeze_cycles) &&
+           cpu->clock < FUZZ_MAX_CYCLES) {
+      APEX_cpu_step(cpu);
+    }
+  }
+  APEX_cpu_stop(cpu);
+  return 0;
+}
+
+#ifndef APEX_LIBFUZZER
+
+/* Fragments inserted by the random mutator */
+static const char* dictionary[] = {
+  "MOVC,", "ADDL,", "SUB,", "STORE,", "LOAD,", "JUMP,", "HALT", "R0", "R31",
+  "R32", "R-1", "#0", "#4000", "#4096", "#-1", "#2147483647",
+  "#-2147483648", "#99999999999", ",", "\n", ",,,,,,,,", "\r\n", "loop:",
+  "#loop", "#loop+4", ".data\n", ".text\n", ".word ", ".space ", ";"
+};
+
+#define DICTIONARY_SIZE (int)(sizeof(dictionary) / sizeof(dictionary[0]))
+
+typedef struct Fuzz_Input
+{
+  uint8_t* data;
+  size_t size;
+} Fuzz_Input;
+
+static Fuzz_Input* corpus;
+static int corpus_size;
+
+/* Input being run, written out if a sanitizer reports an error */
+static uint8_t current[FUZZ_MAX_INPUT];
+static size_t current_size;
+
+#if defined(__SANITIZE_ADDRESS__)
+static void
+save_crash(void)
+{
+  FILE* fp = fopen("crash-input", "wb");
+  if (fp) {
+    fwrite(current, 1, current_size, fp);
+    fclose(fp);
+    fprintf(stderr, "APEX_FUZZ : input written to crash-input\n");
+  }
+}
+#endif
+
+static void
+run(const uint8_t* data, size_t size)
+{
+  memcpy(current, data, size);
+  current_size = size;
+  LLVMFuzzerTestOneInput(current, current_size);
+}
+
+static int
+add_file(const char* filename)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", filename);
+    return -1;
+  }
+
+  Fuzz_Input* inputs = realloc(corpus, (corpus_size + 1) * sizeof(*inputs));
+  uint8_t* data = malloc(FUZZ_MAX_INPUT);
+  if (!inputs || !data) {
+    fclose(fp);
+    free(data);
+    return -1;
+  }
+  corpus = inputs;
+  corpus[corpus_size].data = data;
+  corpus[corpus_size].size = fread(data, 1, FUZZ_MAX_INPUT, fp);
+  corpus_size++;
+  fclose(fp);
+  return 0;
+}
+
+/* Adds a file, or every file in a directory */
+static int
+add_path(const char* path)
+{
+  struct stat st;
+
+  if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+    return add_file(path);
+  }
+
+  DIR* dir = opendir(path);
+  if (!dir) {
+    return -1;
+  }
+  for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+    char name[4096];
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+    if (add_file(name)) {
+      closedir(dir);
+      return -1;
+    }
+  }
+  closedir(dir);
+  return 0;
+}
+
+/*
+ * Applies one to four random edits to buffer: flip a byte, insert a
+ * dictionary fragment, delete a range, duplicate a range or splice in part
+ * of another input
+ */
+static size_t
+mutate(uint8_t* buffer, size_t size)
+{
+  int edits = 1 + rand() % 4;
+
+  for (int i = 0; i < edits; ++i) {
+    size_t at = size ? rand() % size : 0;
+    size_t length = size - at ? 1 + rand() % (size - at) : 0;
+
+    switch (rand() % 5) {
+      case 0:
+        if (size) {
+          buffer[at] ^= 1 << (rand() % 8);
+        }
+        break;
+      case 1: {
+        const char* word = dictionary[rand() % DICTIONARY_SIZE];
+        size_t n = strlen(word);
+        if (size + n <= FUZZ_MAX_INPUT) {
+          memmove(buffer + at + n, buffer + at, size - at);
+          memcpy(buffer + at, word, n);
+          size += n;
+        }
+        break;
+      }
+      case 2:
+        length = length > 64 ? 64 : length;
+        memmove(buffer + at, buffer + at + length, size - at - length);
+        size -= length;
+        break;
+      case 3:
+        if (size + length <= FUZZ_MAX_INPUT) {
+          memmove(buffer + at + length, buffer + at, size - at);
+          size += length;
+        }
+        break;
+      default: {
+        Fuzz_Input* other = &corpus[rand() % corpus_size];
+        size_t from = other->size ? rand() % other->size : 0;
+        size_t n = other->size - from;
+        n = n > 256 ? 256 : n;
+        if (at + n <= FUZZ_MAX_INPUT) {
+          memcpy(buffer + at, other->data + from, n);
+          size = at + n > size ? at + n : size;
+        }
+        break;
+      }
+    }
+  }
+  return size;
+}
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_fuzz [-n iterations] [-s seed] "
+          "[file|directory ...]\n"
+          "  Runs every input once, stdin if none is given. With -n the "
+          "inputs are\n"
+          "  mutated at random for that many runs (no coverage feedback, "
+          "build with\n"
+          "  LIBFUZZER=1 for that). A failing input is written to "
+          "crash-input.\n");
+  exit(1);
+}
+
+int
+main(int argc, char* argv[])
+{
+  long iterations = 0;
+  unsigned seed = 1;
+  int i;
+
+#if defined(__SANITIZE_ADDRESS__)
+  __sanitizer_set_death_callback(save_crash);
+#endif
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+    if (i + 1 == argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-n")) {
+      iterations = atol(argv[i + 1]);
+    } else if (!strcmp(argv[i], "-s")) {
+      seed = strtoul(argv[i + 1], NULL, 0);
+    } else {
+      usage();
+    }
+  }
+  if (i == argc) {
+    add_file("/dev/stdin");
+  }
+  for (; i < argc; ++i) {
+    if (add_path(argv[i])) {
+      return 1;
+    }
+  }
+  if (!corpus_size) {
+    usage();
+  }
+
+  for (int c = 0; c < corpus_size; ++c) {
+    run(corpus[c].data, corpus[c].size);
+  }
+
+  static uint8_t buffer[FUZZ_MAX_INPUT];
+  srand(seed);
+  for (long n = 0; n < iterations; ++n) {
+    Fuzz_Input* input = &corpus[rand() % corpus_size];
+    memcpy(buffer, input->data, input->size);
+    run(buffer, mutate(buffer, input->size));
+  }
+  fprintf(stderr, "APEX_FUZZ : %d inputs, %ld mutations run\n",
+          corpus_size, iterations);
+
+  for (int c = 0; c < corpus_size; ++c) {
+    free(corpus[c].data);
+  }
+  free(corpus);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ *  fuzz_corpus.c
+ *  Generates the seed corpus of the fuzzing harness
+ *
+ *  Every seed is a configuration byte (see fuzz.c) followed by a program:
+ *  straight line code with dependencies between neighbours, loops closed by
+ *  a JUMP to a MOVC'd target, and accesses at the edges of data memory.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+static int
+reg(void)
+{
+  return rand() % 8;
+}
+
+static void
+write_instruction(FILE* fp, int index, int size)
+{
+  static const int edges[] = { 0, 1, 4095, 4096, -1, 99 };
+
+  switch (rand() % 8) {
+    case 0:
+      fprintf(fp, "MOVC,R%d,#%d\n", reg(), rand() % 100);
+      break;
+    case 1:
+    case 2:
+      fprintf(fp, "ADDL,R%d,R%d,#%d\n", reg(), reg(), rand() % 16);
+      break;
+    case 3:
+      fprintf(fp, "SUB,R%d,R%d,R%d\n", reg(), reg(), reg());
+      break;
+    case 4:
+      fprintf(fp, "STORE,R%d,R%d,#%d\n", reg(), reg(),
+              rand() % 4 ? rand() % 64 : edges[rand() % 6]);
+      break;
+    case 5:
+      fprintf(fp, "LOAD,R%d,R%d,#%d\n", reg(), reg(),
+              rand() % 4 ? rand() % 64 : edges[rand() % 6]);
+      break;
+    case 6:
+      if (index > 2 && rand() % 2) {
+        /* Backwards to a random earlier instruction */
+        fprintf(fp, "MOVC,R7,#%d\n", 4000 + 4 * (rand() % index));
+        fprintf(fp, "JUMP,R7,#0\n");
+        break;
+      }
+      fprintf(fp, "JUMP,R%d,#%d\n", reg(), 4000 + 4 * (rand() % size));
+      break;
+    default:
+      fprintf(fp, "ADDL,R%d,R%d,#1\n", index % 8, (index + 7) % 8);
+      break;
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr,
+            "APEX_Help : Usage ./apex_fuzz_corpus <directory> [seeds] "
+            "[random seed]\n");
+    return 1;
+  }
+  int seeds = argc > 2 ? atoi(argv[2]) : 64;
+  srand(argc > 3 ? strtoul(argv[3], NULL, 0) : 1);
+
+  if (mkdir(argv[1], 0755) && errno != EEXIST) {
+    fprintf(stderr, "APEX_Error : Unable to create %s\n", argv[1]);
+    return 1;
+  }
+
+  for (int n = 0; n < seeds; ++n) {
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/seed-%04d", argv[1], n);
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+      fprintf(stderr, "APEX_Error : Unable to create %s\n", filename);
+      return 1;
+    }
+
+    int size = 1 + rand() % 48;
+    fputc(rand() % 256, fp);
+    for (int i = 0; i < size; ++i) {
+      write_instruction(fp, i, size);
+    }
+    fclose(fp);
+  }
+  fprintf(stderr, "APEX_FUZZ : wrote %d seeds to %s\n", seeds, argv[1]);
+  return 0;
+}
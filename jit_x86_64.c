@@ -0,0 +1,232 @@
+/*
+ *  jit_x86_64.c
+ *  Contains the translator of APEX basic blocks to x86-64 host code.
+ *
+ *  Translated code is called as void block(FF_State* state), rdi holds the
+ *  state throughout and registers, pc and data memory are addressed as
+ *  [rdi + disp32]. A block first charges its length against the budget and
+ *  bails out to the dispatcher if the budget is too small. Its fall through
+ *  exit starts with a jmp rel32 which initially jumps to the exit stub right
+ *  behind it; APEX_ff_chain redirects it to the entry of the successor block.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "fastforward.h"
+
+#if defined(__x86_64__)
+
+typedef struct Emitter
+{
+  unsigned char* code;
+  size_t used;
+} Emitter;
+
+static void
+emit8(Emitter* e, int byte)
+{
+  e->code[e->used++] = (unsigned char)byte;
+}
+
+static void
+emit32(Emitter* e, int value)
+{
+  memcpy(&e->code[e->used], &value, 4);
+  e->used += 4;
+}
+
+static void
+emit64(Emitter* e, unsigned long value)
+{
+  memcpy(&e->code[e->used], &value, 8);
+  e->used += 8;
+}
+
+static int
+reg_offset(int r)
+{
+  return offsetof(FF_State, regs) + 4 * r;
+}
+
+static int
+valid_offset(int r)
+{
+  return offsetof(FF_State, regs_valid) + 4 * r;
+}
+
+static int
+mem_offset(int address)
+{
+  return offsetof(FF_State, data_memory) + 4 * address;
+}
+
+/* mov dword [rdi + disp], imm */
+static void
+store_imm(Emitter* e, int disp, int imm)
+{
+  emit8(e, 0xC7);
+  emit8(e, 0x87);
+  emit32(e, disp);
+  emit32(e, imm);
+}
+
+/* mov eax, [rdi + disp] */
+static void
+load_eax(Emitter* e, int disp)
+{
+  emit8(e, 0x8B);
+  emit8(e, 0x87);
+  emit32(e, disp);
+}
+
+/* mov [rdi + disp], eax */
+static void
+store_eax(Emitter* e, int disp)
+{
+  emit8(e, 0x89);
+  emit8(e, 0x87);
+  emit32(e, disp);
+}
+
+/* add eax, imm */
+static void
+add_eax(Emitter* e, int imm)
+{
+  emit8(e, 0x05);
+  emit32(e, imm);
+}
+
+/* <op> qword [rdi + disp], imm with op the /digit of opcode 81 */
+static void
+qword_imm(Emitter* e, int digit, int disp, int imm)
+{
+  emit8(e, 0x48);
+  emit8(e, 0x81);
+  emit8(e, 0x87 | digit << 3);
+  emit32(e, disp);
+  emit32(e, imm);
+}
+
+/* mov qword [rdi + exit_site], 0; ret */
+static void
+return_unchained(Emitter* e)
+{
+  emit8(e, 0x48);
+  emit8(e, 0xC7);
+  emit8(e, 0x87);
+  emit32(e, offsetof(FF_State, exit_site));
+  emit32(e, 0);
+  emit8(e, 0xC3);
+}
+
+/*
+ * Translates the block of length instructions at index into the translation
+ * cache, returns 0 on success
+ */
+int
+APEX_ff_translate(FF_Engine* engine, int index, int length, FF_Block* block)
+{
+  Emitter e = { engine->code_buffer + engine->code_used, 0 };
+  const FF_Op* ops = &engine->ops[index];
+  int pc = 4000 + index * 4;
+  int ends_in_jump = ops[length - 1].op == OP_JUMP;
+
+  /* cmp qword [budget], length; jl bail */
+  qword_imm(&e, 7, offsetof(FF_State, budget), length);
+  emit8(&e, 0x0F);
+  emit8(&e, 0x8C);
+  size_t bail_patch = e.used;
+  emit32(&e, 0);
+
+  /* sub qword [budget], length; add qword [instructions], length */
+  qword_imm(&e, 5, offsetof(FF_State, budget), length);
+  qword_imm(&e, 0, offsetof(FF_State, instructions), length);
+
+  for (int i = 0; i < length; ++i) {
+    const FF_Op* op = &ops[i];
+    switch (op->op) {
+      case OP_MOVC:
+        store_imm(&e, reg_offset(op->rd), op->imm);
+        store_imm(&e, valid_offset(op->rd), 0);
+        break;
+      case OP_ADDL:
+        load_eax(&e, reg_offset(op->rs1));
+        add_eax(&e, op->imm);
+        store_eax(&e, reg_offset(op->rd));
+        store_imm(&e, valid_offset(op->rd), 1);
+        break;
+      case OP_SUB:
+        store_imm(&e, reg_offset(op->rd), op->rs1 - op->rs2);
+        store_imm(&e, valid_offset(op->rd), 0);
+        break;
+      case OP_STORE:
+        store_imm(&e, mem_offset(op->rs2 + op->imm), op->rs1);
+        break;
+      case OP_LOAD:
+        load_eax(&e, mem_offset(op->rs1 + op->imm));
+        store_eax(&e, reg_offset(op->rd));
+        store_imm(&e, valid_offset(op->rd), 0);
+        break;
+      case OP_JUMP:
+        load_eax(&e, reg_offset(op->rs1));
+        add_eax(&e, op->imm);
+        store_eax(&e, offsetof(FF_State, pc));
+        return_unchained(&e);
+        break;
+    }
+  }
+
+  if (!ends_in_jump) {
+    /* jmp rel32, patched by APEX_ff_chain, initially to the stub below */
+    emit8(&e, 0xE9);
+    emit32(&e, 0);
+    unsigned char* exit_site = e.code + e.used - 5;
+
+    store_imm(&e, offsetof(FF_State, pc), pc + 4 * length);
+    /* mov rax, exit_site; mov [rdi + exit_site], rax; ret */
+    emit8(&e, 0x48);
+    emit8(&e, 0xB8);
+    emit64(&e, (unsigned long)exit_site);
+    emit8(&e, 0x48);
+    emit8(&e, 0x89);
+    emit8(&e, 0x87);
+    emit32(&e, offsetof(FF_State, exit_site));
+    emit8(&e, 0xC3);
+  }
+
+  /* bail: too few instructions left, the dispatcher interprets the rest */
+  int rel = (int)(e.used - (bail_patch + 4));
+  memcpy(&e.code[bail_patch], &rel, 4);
+  store_imm(&e, offsetof(FF_State, pc), pc);
+  return_unchained(&e);
+
+  block->entry = e.code;
+  engine->code_used += e.used;
+  return 0;
+}
+
+/*
+ * Redirects the exit jump at exit_site to the entry of target
+ */
+void
+APEX_ff_chain(void* exit_site, FF_Block* target)
+{
+  unsigned char* site = exit_site;
+  int rel = (int)(target->entry - (site + 5));
+  memcpy(site + 1, &rel, 4);
+}
+
+#else
+
+int
+APEX_ff_translate(FF_Engine* engine, int index, int length, FF_Block* block)
+{
+  return -1;
+}
+
+void
+APEX_ff_chain(void* exit_site, FF_Block* target)
+{
+}
+
+#endif
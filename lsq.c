@@ -0,0 +1,274 @@
+/*
+ *  lsq.c
+ *  Contains the timing model of the load/store queue
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsq.h"
+
+APEX_LSQ*
+APEX_lsq_init(void)
+{
+  return calloc(1, sizeof(APEX_LSQ));
+}
+
+/*
+ * Sets the number of store buffer entries, the buffer must be empty
+ */
+int
+APEX_lsq_resize(APEX_LSQ* lsq, int size)
+{
+  long* done = NULL;
+  int* addresses = NULL;
+
+  if (size < 0 || lsq->count) {
+    return -1;
+  }
+  if (size) {
+    done = calloc(size, sizeof(long));
+    addresses = calloc(size, sizeof(int));
+    if (!done || !addresses) {
+      free(done);
+      free(addresses);
+      return -1;
+    }
+  }
+  free(lsq->done);
+  free(lsq->addresses);
+  lsq->done = done;
+  lsq->addresses = addresses;
+  lsq->size = size;
+  lsq->head = 0;
+  return 0;
+}
+
+/* Removes the stores whose writes completed by cycle now */
+static void
+drain(APEX_LSQ* lsq, long now)
+{
+  while (lsq->count && lsq->done[lsq->head] <= now) {
+    lsq->head = (lsq->head + 1) % lsq->size;
+    lsq->count--;
+  }
+}
+
+static int
+buffered(APEX_LSQ* lsq, int address)
+{
+  for (int i = 0; i < lsq->count; ++i) {
+    if (lsq->addresses[(lsq->head + i) % lsq->size] == address) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+wait_index(int pc)
+{
+  return (pc / 4) % LSQ_WAIT_TABLE;
+}
+
+/*
+ * Called by the last execute stage once the address of a LOAD or STORE is
+ * known, issues the LOAD early depending on the load issue policy
+ */
+void
+APEX_lsq_address_ready(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_LSQ* lsq = cpu->lsq;
+
+  if (strcmp(stage->opcode, "STORE") == 0) {
+    lsq->stores_in_flight++;
+    return;
+  }
+
+  int issue = 0;
+  switch (lsq->load_issue) {
+    case LOAD_EARLY:
+      issue = !lsq->stores_in_flight;
+      break;
+    case LOAD_SPECULATIVE:
+      issue = 1;
+      break;
+    case LOAD_MDP:
+      issue = lsq->wait_table[wait_index(stage->pc)] < 2;
+      if (!issue && lsq->stores_in_flight) {
+        lsq->stats.predicted_waits++;
+      }
+      issue |= !lsq->stores_in_flight;
+      break;
+  }
+
+  /* A correctly predicted address was sent to memory in decode */
+  long issued = cpu->clock;
+  if (stage->ap_hit) {
+    issue = 1;
+    issued = stage->ap_cycle;
+  }
+
+  stage->mem_issued = issue;
+  if (issue) {
+    drain(lsq, cpu->clock);
+    stage->mem_forwarded = buffered(lsq, stage->mem_address);
+    stage->mem_issue_cycle = issued;
+    stage->mem_ready = issued + (stage->mem_forwarded ? 0 : lsq->latency);
+  }
+}
+
+/*
+ * Called when the pipeline is flushed, squashed stores never reach memory
+ */
+void
+APEX_lsq_flush(APEX_LSQ* lsq)
+{
+  lsq->stores_in_flight = 0;
+}
+
+/*
+ * Called by the last memory stage for a STORE, returns the cycles the
+ * pipeline has to wait
+ */
+int
+APEX_lsq_store(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_LSQ* lsq = cpu->lsq;
+  long now = cpu->clock;
+  int stall = 0;
+
+  lsq->stats.stores++;
+  if (lsq->stores_in_flight) {
+    lsq->stores_in_flight--;
+  }
+
+  int slot = lsq->recent_count++ % LSQ_RECENT_STORES;
+  lsq->recent_cycle[slot] = now;
+  lsq->recent_address[slot] = stage->mem_address;
+
+  if (!lsq->size) {
+    lsq->stats.store_stall_cycles += lsq->latency;
+    return lsq->latency;
+  }
+
+  drain(lsq, now);
+  if (lsq->count == lsq->size) {
+    /* Full, wait for the oldest write */
+    stall = lsq->done[lsq->head] - now;
+    drain(lsq, now + stall);
+  }
+
+  /* Writes drain one at a time, behind the youngest buffered one */
+  long start = now + stall;
+  if (lsq->count) {
+    long last = lsq->done[(lsq->head + lsq->count - 1) % lsq->size];
+    if (last > start) {
+      start = last;
+    }
+  }
+  int tail = (lsq->head + lsq->count) % lsq->size;
+  lsq->done[tail] = start + lsq->latency;
+  lsq->addresses[tail] = stage->mem_address;
+  lsq->count++;
+
+  lsq->stats.store_stall_cycles += stall;
+  return stall;
+}
+
+/* Returns 1 if a store which reached memory after cycle issued wrote
+ * address
+ */
+static int
+conflict(APEX_LSQ* lsq, long issued, int address)
+{
+  long oldest = lsq->recent_count > LSQ_RECENT_STORES
+                  ? lsq->recent_count - LSQ_RECENT_STORES
+                  : 0;
+  for (long i = lsq->recent_count - 1; i >= oldest; --i) {
+    int slot = i % LSQ_RECENT_STORES;
+    if (lsq->recent_cycle[slot] <= issued) {
+      break;
+    }
+    if (lsq->recent_address[slot] == address) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Called by the last memory stage for a LOAD, returns the cycles the
+ * pipeline has to wait for its data
+ */
+int
+APEX_lsq_load(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_LSQ* lsq = cpu->lsq;
+  long now = cpu->clock;
+  unsigned char* counter = &lsq->wait_table[wait_index(stage->pc)];
+  int stall;
+
+  lsq->stats.loads++;
+  drain(lsq, now);
+
+  if (stage->mem_issued &&
+      !conflict(lsq, stage->mem_issue_cycle, stage->mem_address)) {
+    lsq->stats.early++;
+    lsq->stats.forwarded += stage->mem_forwarded;
+    if (*counter) {
+      (*counter)--;
+    }
+    stall = stage->mem_ready > now ? stage->mem_ready - now : 0;
+  } else {
+    /* In order access, or replay of a conflicting early access */
+    int replay = stage->mem_issued;
+    if (replay) {
+      lsq->stats.violations++;
+      *counter = 3;
+    }
+    if (buffered(lsq, stage->mem_address)) {
+      lsq->stats.forwarded++;
+      stall = replay;
+    } else {
+      stall = replay + lsq->latency;
+    }
+  }
+
+  lsq->stats.load_stall_cycles += stall;
+  return stall;
+}
+
+void
+APEX_lsq_report(APEX_LSQ* lsq, FILE* out)
+{
+  static const char* policies[] = { "inorder", "early", "speculative",
+                                    "mdp" };
+  LSQ_Stats* stats = &lsq->stats;
+  long unhidden = stats->loads * lsq->latency;
+
+  fprintf(out,
+          "APEX_LSQ : latency %d, store buffer %d, loads %s: %ld loads "
+          "(%ld forwarded, %ld early, %ld replayed, %ld held by mdp), "
+          "%ld stores\n",
+          lsq->latency, lsq->size, policies[lsq->load_issue], stats->loads,
+          stats->forwarded, stats->early, stats->violations,
+          stats->predicted_waits, stats->stores);
+  fprintf(out,
+          "APEX_LSQ : load stall %ld cycles (%ld of %ld hidden), store stall "
+          "%ld cycles\n",
+          stats->load_stall_cycles,
+          unhidden > stats->load_stall_cycles
+            ? unhidden - stats->load_stall_cycles
+            : 0,
+          unhidden, stats->store_stall_cycles);
+}
+
+void
+APEX_lsq_free(APEX_LSQ* lsq)
+{
+  if (lsq) {
+    free(lsq->done);
+    free(lsq->addresses);
+    free(lsq);
+  }
+}
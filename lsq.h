@@ -0,0 +1,97 @@
+#ifndef _APEX_LSQ_H_
+#define _APEX_LSQ_H_
+/**
+ *  lsq.h
+ *  Contains the timing model of the load/store queue: a store buffer which
+ *  takes stores off the critical path and forwards their data to later
+ *  loads, early issue of loads at address generation and an optional
+ *  memory dependence predictor.
+ *
+ *  A data access takes latency cycles beyond the memory stage. Stores
+ *  enter the buffer in the last memory stage and drain to memory one at a
+ *  time; their data is written to data memory right away, the buffer only
+ *  tracks when the write completes. A LOAD may access memory as soon as its
+ *  address is computed in the last execute stage; older stores still in
+ *  the memory stages are not in the buffer yet and their addresses are
+ *  unknown to it. If one of them writes the address of an early load the
+ *  load is replayed from the last memory stage.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define LSQ_RECENT_STORES 64
+#define LSQ_WAIT_TABLE 256
+
+/* When loads access memory */
+enum
+{
+  LOAD_INORDER,       // In the last memory stage
+  LOAD_EARLY,         // At address generation if no older store is in flight
+  LOAD_SPECULATIVE,   // At address generation, replay on a conflict
+  LOAD_MDP            // Speculative unless the wait table predicts a conflict
+};
+
+typedef struct LSQ_Stats
+{
+  long loads;
+  long stores;
+  long forwarded;           // Loads served by the store buffer
+  long early;               // Loads issued at address generation
+  long predicted_waits;     // Loads held back by the dependence predictor
+  long violations;          // Early loads replayed after a store conflict
+  long load_stall_cycles;
+  long store_stall_cycles;  // Full buffer, or every store without a buffer
+} LSQ_Stats;
+
+typedef struct APEX_LSQ
+{
+  int latency;        // Cycles of a data access beyond the memory stage
+  int size;           // Store buffer entries, 0 for no buffer
+  int load_issue;
+
+  /* Store buffer: cycles at which the buffered writes complete, FIFO */
+  long* done;
+  int* addresses;
+  int head;
+  int count;
+
+  /* Stores past address generation but not yet in the memory stage */
+  int stores_in_flight;
+
+  /* Most recent stores, to detect conflicts with early loads */
+  long recent_cycle[LSQ_RECENT_STORES];
+  int recent_address[LSQ_RECENT_STORES];
+  long recent_count;
+
+  /* Load wait table: 2 bit counters indexed by load pc */
+  unsigned char wait_table[LSQ_WAIT_TABLE];
+
+  LSQ_Stats stats;
+} APEX_LSQ;
+
+APEX_LSQ*
+APEX_lsq_init(void);
+
+int
+APEX_lsq_resize(APEX_LSQ* lsq, int size);
+
+void
+APEX_lsq_address_ready(APEX_CPU* cpu, CPU_Stage* stage);
+
+int
+APEX_lsq_store(APEX_CPU* cpu, CPU_Stage* stage);
+
+int
+APEX_lsq_load(APEX_CPU* cpu, CPU_Stage* stage);
+
+void
+APEX_lsq_flush(APEX_LSQ* lsq);
+
+void
+APEX_lsq_report(APEX_LSQ* lsq, FILE* out);
+
+void
+APEX_lsq_free(APEX_LSQ* lsq);
+
+#endif
@@ -14,18 +14,64 @@
 int
 main(int argc, char const* argv[])
 {
+  /* Options of the form --name=value may appear anywhere, they are taken
+   * out of argv before the positional arguments are checked
+   */
+  const char* options[argc];
+  int num_options = 0;
+  int num_args = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--", 2)) {
+      options[num_options++] = argv[i] + 2;
+    } else {
+      argv[num_args++] = argv[i];
+    }
+  }
+  argc = num_args;
+
+  /* Every argument before the command is an input file, they are linked
+   * into one program
+   */
+  int command = 2;
+  while (command < argc && strcmp(argv[command], "display") &&
+         strcmp(argv[command], "simulate")) {
+    command++;
+  }
+  const char** files = argv + 1;
+  int num_files = command - 1;
+  argc -= num_files - 1;
+  argv += num_files - 1;
+
 printf("argc::%d\n",argc);
   if (!(argc == 3 || argc == 4)) {
-    fprintf(stderr, "APEX_Help : Usage ./apex_sim <input_file> command no.OfCycles(optional)\n");
+    fprintf(stderr, "APEX_Help : Usage ./apex_sim <input_file> [input_file ...] command no.OfCycles(optional) [--option=value ...]\n");
+    APEX_print_options(stderr);
     exit(1);
   }
 
-  APEX_CPU* cpu = APEX_cpu_init(argv[1]);
+  APEX_CPU* cpu = APEX_cpu_init_files(files, num_files);
   if (!cpu) {
     fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
     exit(1);
   }
 
+  for (int i = 0; i < num_options; ++i) {
+    char name[64];
+    const char* value = strchr(options[i], '=');
+    size_t len = value ? (size_t)(value - options[i]) : strlen(options[i]);
+
+    if (len >= sizeof(name)) {
+      len = sizeof(name) - 1;
+    }
+    memcpy(name, options[i], len);
+    name[len] = '\0';
+
+    if (APEX_cpu_set_option(cpu, name, value ? value + 1 : "1")) {
+      exit(1);
+    }
+  }
+  APEX_cpu_print_code_memory(cpu);
+
   if(!(strcmp(argv[2],"display"))){
   cpu->command_num=2; //2 for display
   }
@@ -59,7 +105,7 @@ printf("argc::%d\n",argc);
   }
 
 
-  APEX_cpu_run(cpu);
+  int status = APEX_cpu_run(cpu) ? 1 : 0;
   APEX_cpu_stop(cpu);
-  return 0;
+  return status;
 }
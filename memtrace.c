@@ -0,0 +1,338 @@
+/*
+ *  memtrace.c
+ *  Contains the writer and reader of data memory access traces
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memtrace.h"
+
+/* Largest encoded record: flags byte and four varints */
+#define MAX_RECORD_BYTES 26
+#define MAX_RAW_BYTES (MEMTRACE_BLOCK_RECORDS * MAX_RECORD_BYTES)
+#define MAX_PACKED_BYTES (MAX_RAW_BYTES + MAX_RAW_BYTES / 128 + 16)
+
+/* LZ parameters: matches of 4..131 bytes within the last 64 KB */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH 131
+#define LZ_MAX_LITERALS 128
+#define LZ_HASH_BITS 12
+
+/*
+ * LZ compression of a block. A token byte below 0x80 starts a run of
+ * token + 1 literal bytes, otherwise it is a match of (token & 0x7f) + 4
+ * bytes at the 16 bit little endian offset which follows.
+ */
+static size_t
+lz_compress(const unsigned char* in, size_t len, unsigned char* out)
+{
+  uint32_t table[1 << LZ_HASH_BITS];
+  size_t pos = 0;
+  size_t literals = 0;
+  size_t n = 0;
+
+  memset(table, 0xff, sizeof(table));
+
+  while (pos < len) {
+    size_t match_len = 0;
+    size_t offset = 0;
+
+    if (pos + LZ_MIN_MATCH <= len) {
+      uint32_t word;
+      memcpy(&word, in + pos, 4);
+      uint32_t hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+      uint32_t candidate = table[hash];
+      table[hash] = pos;
+
+      if (candidate != 0xffffffffu && pos - candidate <= 0xffff &&
+          !memcmp(in + candidate, in + pos, LZ_MIN_MATCH)) {
+        offset = pos - candidate;
+        match_len = LZ_MIN_MATCH;
+        while (pos + match_len < len && match_len < LZ_MAX_MATCH &&
+               in[candidate + match_len] == in[pos + match_len]) {
+          match_len++;
+        }
+      }
+    }
+
+    if (!match_len) {
+      pos++;
+      literals++;
+      if (literals == LZ_MAX_LITERALS || pos == len) {
+        out[n++] = literals - 1;
+        memcpy(out + n, in + pos - literals, literals);
+        n += literals;
+        literals = 0;
+      }
+      continue;
+    }
+
+    if (literals) {
+      out[n++] = literals - 1;
+      memcpy(out + n, in + pos - literals, literals);
+      n += literals;
+      literals = 0;
+    }
+    out[n++] = 0x80 | (match_len - LZ_MIN_MATCH);
+    out[n++] = offset & 0xff;
+    out[n++] = offset >> 8;
+    pos += match_len;
+  }
+  return n;
+}
+
+/*
+ * Returns the decompressed size, or -1 if the input is corrupt
+ */
+static long
+lz_decompress(const unsigned char* in, size_t len, unsigned char* out,
+              size_t capacity)
+{
+  size_t pos = 0;
+  size_t n = 0;
+
+  while (pos < len) {
+    unsigned token = in[pos++];
+    if (token < 0x80) {
+      size_t count = token + 1;
+      if (pos + count > len || n + count > capacity) {
+        return -1;
+      }
+      memcpy(out + n, in + pos, count);
+      pos += count;
+      n += count;
+    } else {
+      size_t count = (token & 0x7f) + LZ_MIN_MATCH;
+      if (pos + 2 > len) {
+        return -1;
+      }
+      size_t offset = in[pos] | in[pos + 1] << 8;
+      pos += 2;
+      if (!offset || offset > n || n + count > capacity) {
+        return -1;
+      }
+      /* Byte by byte, matches may overlap their own output */
+      for (size_t i = 0; i < count; ++i, ++n) {
+        out[n] = out[n - offset];
+      }
+    }
+  }
+  return n;
+}
+
+static size_t
+put_varint(unsigned char* out, uint64_t value)
+{
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+static int
+get_varint(APEX_Memtrace* trace, uint64_t* value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (trace->raw_pos >= trace->raw_len) {
+      return -1;
+    }
+    unsigned char byte = trace->raw[trace->raw_pos++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static uint64_t
+zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t
+unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void
+put_u32(unsigned char* out, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i) {
+    out[i] = value >> (8 * i);
+  }
+}
+
+static uint32_t
+get_u32(const unsigned char* in)
+{
+  return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+APEX_Memtrace*
+APEX_memtrace_open(const char* filename, int writing)
+{
+  APEX_Memtrace* trace = calloc(1, sizeof(*trace));
+  if (!trace) {
+    return NULL;
+  }
+
+  trace->writing = writing;
+  trace->raw = malloc(MAX_RAW_BYTES);
+  trace->packed = malloc(MAX_PACKED_BYTES);
+  trace->fp = fopen(filename, writing ? "wb" : "rb");
+  if (!trace->raw || !trace->packed || !trace->fp) {
+    APEX_memtrace_close(trace);
+    return NULL;
+  }
+
+  char magic[8];
+  if (writing) {
+    fwrite(MEMTRACE_MAGIC, 1, 8, trace->fp);
+  } else if (fread(magic, 1, 8, trace->fp) != 8 ||
+             memcmp(magic, MEMTRACE_MAGIC, 8)) {
+    fprintf(stderr, "APEX_Error : %s is not a memory trace\n", filename);
+    APEX_memtrace_close(trace);
+    return NULL;
+  }
+  trace->bytes = 8;
+  return trace;
+}
+
+/*
+ * Compresses and writes out the records of the current block
+ */
+void
+APEX_memtrace_flush(APEX_Memtrace* trace)
+{
+  unsigned char header[12];
+
+  if (!trace->block_records) {
+    return;
+  }
+
+  size_t packed_len = lz_compress(trace->raw, trace->raw_len, trace->packed);
+  put_u32(header, trace->block_records);
+  put_u32(header + 4, trace->raw_len);
+  put_u32(header + 8, packed_len);
+  fwrite(header, 1, sizeof(header), trace->fp);
+  fwrite(trace->packed, 1, packed_len, trace->fp);
+
+  trace->bytes += sizeof(header) + packed_len;
+  trace->block_records = 0;
+  trace->raw_len = 0;
+  memset(&trace->last, 0, sizeof(trace->last));
+}
+
+void
+APEX_memtrace_record(APEX_Memtrace* trace, const APEX_Mem_Record* record)
+{
+  unsigned char* out = trace->raw + trace->raw_len;
+  size_t n = 0;
+
+  out[n++] = record->is_store ? 1 : 0;
+  n += put_varint(out + n, record->cycle - trace->last.cycle);
+  n += put_varint(out + n, zigzag((int64_t)record->pc - trace->last.pc));
+  n += put_varint(out + n,
+                  zigzag((int64_t)record->address - trace->last.address));
+  n += put_varint(out + n, zigzag((int64_t)record->value - trace->last.value));
+
+  trace->raw_len += n;
+  trace->last = *record;
+  trace->records++;
+
+  if (++trace->block_records == MEMTRACE_BLOCK_RECORDS) {
+    APEX_memtrace_flush(trace);
+  }
+}
+
+static int
+read_block(APEX_Memtrace* trace)
+{
+  unsigned char header[12];
+
+  size_t got = fread(header, 1, sizeof(header), trace->fp);
+  if (!got) {
+    return 0;
+  }
+
+  uint32_t records = get_u32(header);
+  uint32_t raw_len = get_u32(header + 4);
+  uint32_t packed_len = get_u32(header + 8);
+  if (got != sizeof(header) || !records ||
+      records > MEMTRACE_BLOCK_RECORDS || raw_len > MAX_RAW_BYTES ||
+      packed_len > MAX_PACKED_BYTES ||
+      fread(trace->packed, 1, packed_len, trace->fp) != packed_len ||
+      lz_decompress(trace->packed, packed_len, trace->raw, MAX_RAW_BYTES) !=
+        (long)raw_len) {
+    return -1;
+  }
+
+  trace->bytes += sizeof(header) + packed_len;
+  trace->block_records = records;
+  trace->raw_len = raw_len;
+  trace->raw_pos = 0;
+  memset(&trace->last, 0, sizeof(trace->last));
+  return 1;
+}
+
+/*
+ * Reads the next record, returns 1 on success, 0 at the end of the trace
+ * and -1 if the trace is corrupt
+ */
+int
+APEX_memtrace_next(APEX_Memtrace* trace, APEX_Mem_Record* record)
+{
+  uint64_t cycle, pc, address, value;
+
+  if (!trace->block_records) {
+    int result = read_block(trace);
+    if (result <= 0) {
+      return result;
+    }
+  }
+
+  if (trace->raw_pos >= trace->raw_len) {
+    return -1;
+  }
+  unsigned char flags = trace->raw[trace->raw_pos++];
+  if (get_varint(trace, &cycle) || get_varint(trace, &pc) ||
+      get_varint(trace, &address) || get_varint(trace, &value)) {
+    return -1;
+  }
+
+  record->is_store = flags & 1;
+  record->cycle = trace->last.cycle + (long)cycle;
+  record->pc = trace->last.pc + unzigzag(pc);
+  record->address = trace->last.address + unzigzag(address);
+  record->value = trace->last.value + unzigzag(value);
+
+  trace->last = *record;
+  trace->records++;
+  trace->block_records--;
+  return 1;
+}
+
+void
+APEX_memtrace_close(APEX_Memtrace* trace)
+{
+  if (!trace) {
+    return;
+  }
+  if (trace->fp) {
+    if (trace->writing) {
+      APEX_memtrace_flush(trace);
+    }
+    fclose(trace->fp);
+  }
+  free(trace->raw);
+  free(trace->packed);
+  free(trace);
+}
@@ -0,0 +1,63 @@
+#ifndef _APEX_MEMTRACE_H_
+#define _APEX_MEMTRACE_H_
+/**
+ *  memtrace.h
+ *  Contains the compact binary trace of data memory accesses.
+ *
+ *  A trace file is the magic "APEXMTR1" followed by blocks of up to
+ *  MEMTRACE_BLOCK_RECORDS records. Within a block every record is a flags
+ *  byte (bit 0 set for stores) and varints of the cycle delta and the zigzag
+ *  encoded pc, address and value deltas to the previous record. Every block
+ *  is LZ compressed on its own and starts with three little endian 32 bit
+ *  words: number of records, raw size and compressed size.
+ */
+#include <stdio.h>
+
+#define MEMTRACE_MAGIC "APEXMTR1"
+#define MEMTRACE_BLOCK_RECORDS 4096
+
+/* One data memory access */
+typedef struct APEX_Mem_Record
+{
+  long cycle;
+  int pc;
+  int address;
+  int is_store;
+  int value;    // Stored or loaded value
+} APEX_Mem_Record;
+
+typedef struct APEX_Memtrace
+{
+  FILE* fp;
+  int writing;
+
+  /* Current block, raw and compressed */
+  unsigned char* raw;
+  size_t raw_len;
+  size_t raw_pos;
+  unsigned char* packed;
+  int block_records;
+
+  /* Delta base, reset at every block */
+  APEX_Mem_Record last;
+
+  long records;
+  long bytes;   // Bytes written or read, including headers
+} APEX_Memtrace;
+
+APEX_Memtrace*
+APEX_memtrace_open(const char* filename, int writing);
+
+void
+APEX_memtrace_record(APEX_Memtrace* trace, const APEX_Mem_Record* record);
+
+void
+APEX_memtrace_flush(APEX_Memtrace* trace);
+
+int
+APEX_memtrace_next(APEX_Memtrace* trace, APEX_Mem_Record* record);
+
+void
+APEX_memtrace_close(APEX_Memtrace* trace);
+
+#endif
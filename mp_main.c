@@ -0,0 +1,98 @@
+/*
+ *  mp_main.c
+ *  Driver for the multicore APEX simulation
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "multicore.h"
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_mp [options] <input_file> "
+          "[<input_file> ...]\n"
+          "  -p mesi|moesi   coherence protocol (default mesi)\n"
+          "  -n cores        number of cores, input files are reused round "
+          "robin (default: one core per file)\n"
+          "  -t threads      host threads (default 1)\n"
+          "  -q cycles       synchronization quantum (default 100)\n"
+          "  -c s:w:l        L1 sets:ways:words per line (default 16:2:4)\n"
+          "  -m cycles       miss latency to shared memory (default 10)\n"
+          "  -x cycles       cache to cache / upgrade latency (default 4)\n");
+  exit(1);
+}
+
+int
+main(int argc, char* argv[])
+{
+  MC_Config config;
+  int num_cores = 0;
+  int opt;
+
+  APEX_system_default_config(&config);
+
+  while ((opt = getopt(argc, argv, "p:n:t:q:c:m:x:")) != -1) {
+    switch (opt) {
+      case 'p':
+        if (!strcmp(optarg, "mesi")) {
+          config.protocol = COHERENCE_MESI;
+        } else if (!strcmp(optarg, "moesi")) {
+          config.protocol = COHERENCE_MOESI;
+        } else {
+          usage();
+        }
+        break;
+      case 'n':
+        num_cores = atoi(optarg);
+        break;
+      case 't':
+        config.num_threads = atoi(optarg);
+        break;
+      case 'q':
+        config.quantum = atoi(optarg);
+        break;
+      case 'c':
+        if (APEX_cache_parse_geometry(optarg, &config.sets, &config.ways,
+                                      &config.line_words)) {
+          usage();
+        }
+        break;
+      case 'm':
+        config.miss_latency = atoi(optarg);
+        break;
+      case 'x':
+        config.c2c_latency = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  int num_files = argc - optind;
+  if (num_files <= 0 || num_cores < 0 || config.quantum <= 0) {
+    usage();
+  }
+  if (!num_cores) {
+    num_cores = num_files;
+  }
+
+  const char* filenames[num_cores];
+  for (int i = 0; i < num_cores; ++i) {
+    filenames[i] = argv[optind + i % num_files];
+  }
+
+  APEX_System* sys = APEX_system_init(filenames, num_cores, &config);
+  if (!sys) {
+    fprintf(stderr, "APEX_Error : Unable to initialize system\n");
+    exit(1);
+  }
+
+  int status = APEX_system_run(sys) ? 1 : 0;
+  APEX_system_report(sys);
+  APEX_system_stop(sys);
+  return status;
+}
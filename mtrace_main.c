@@ -0,0 +1,493 @@
+/*
+ *  mtrace_main.c
+ *  Offline analysis of data memory access traces written with --memtrace:
+ *  reuse distances, miss ratio curves, set associative miss classification,
+ *  working set per window and per pc access patterns
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "memtrace.h"
+
+#define DATA_WORDS 4096
+#define MAX_CACHES 16
+#define NUM_LINE_SIZES 5
+#define TOP_PCS 10
+#define MAX_REUSE (NUM_LINE_SIZES + MAX_CACHES)
+
+static const int line_sizes[NUM_LINE_SIZES] = { 1, 2, 4, 8, 16 };
+
+/* Reuse (LRU stack) distances of one line size */
+typedef struct Reuse
+{
+  int line_words;
+  long cold;                  // First touches of a line
+  long hist[DATA_WORDS + 1];  // Accesses by number of distinct lines between
+} Reuse;
+
+/* Accesses of one pc */
+typedef struct Pc_Stats
+{
+  int pc;
+  long loads;
+  long stores;
+  long same_stride;   // Accesses with the same stride as the one before
+  long unit_stride;   // Accesses at most one word from the one before
+} Pc_Stats;
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_mtrace [options] <trace_file>\n"
+          "  -c s:w:l   cache sets:ways:words per line to simulate, may be "
+          "repeated\n"
+          "             (default 16:1:4, 16:2:4, 16:4:4, 64:2:4)\n"
+          "  -w n       working set window in accesses (default 1000)\n"
+          "  -l words   line size of the working set (default 4)\n"
+          "  -v         print the working set of every window\n");
+  exit(1);
+}
+
+/*
+ * Computes the reuse distance of every access with a Fenwick tree which
+ * marks the most recent access of every line
+ */
+static void
+compute_reuse(const APEX_Mem_Record* records, long n, Reuse* reuse)
+{
+  long* tree = calloc(n + 1, sizeof(long));
+  long last[DATA_WORDS];
+
+  for (int i = 0; i < DATA_WORDS; ++i) {
+    last[i] = -1;
+  }
+
+  for (long t = 0; t < n; ++t) {
+    int line = records[t].address / reuse->line_words;
+    long prev = last[line];
+
+    if (prev < 0) {
+      reuse->cold++;
+    } else {
+      /* Marks in (prev, t) are the distinct lines touched since prev */
+      long distance = 0;
+      for (long i = t; i > 0; i -= i & -i) {
+        distance += tree[i];
+      }
+      for (long i = prev + 1; i > 0; i -= i & -i) {
+        distance -= tree[i];
+      }
+      reuse->hist[distance]++;
+      for (long i = prev + 1; i <= n; i += i & -i) {
+        tree[i]--;
+      }
+    }
+    for (long i = t + 1; i <= n; i += i & -i) {
+      tree[i]++;
+    }
+    last[line] = t;
+  }
+  free(tree);
+}
+
+/*
+ * Misses of a fully associative LRU cache of capacity lines
+ */
+static long
+lru_misses(const Reuse* reuse, long capacity)
+{
+  long misses = reuse->cold;
+  for (long d = capacity; d <= DATA_WORDS; ++d) {
+    misses += reuse->hist[d];
+  }
+  return misses;
+}
+
+static Reuse*
+get_reuse(Reuse** reuses, const APEX_Mem_Record* records, long n,
+          int line_words)
+{
+  for (int i = 0; i < MAX_REUSE && reuses[i]; ++i) {
+    if (reuses[i]->line_words == line_words) {
+      return reuses[i];
+    }
+  }
+  for (int i = 0; i < MAX_REUSE; ++i) {
+    if (!reuses[i]) {
+      reuses[i] = calloc(1, sizeof(Reuse));
+      reuses[i]->line_words = line_words;
+      compute_reuse(records, n, reuses[i]);
+      return reuses[i];
+    }
+  }
+  return NULL;
+}
+
+static double
+percent(long part, long whole)
+{
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void
+print_summary(const APEX_Mem_Record* records, long n, long skipped,
+              const APEX_Memtrace* trace)
+{
+  long loads = 0;
+  long words = 0;
+  char touched[DATA_WORDS] = { 0 };
+
+  for (long i = 0; i < n; ++i) {
+    loads += !records[i].is_store;
+    if (!touched[records[i].address]) {
+      touched[records[i].address] = 1;
+      words++;
+    }
+  }
+
+  printf("=============== MEMORY TRACE ===============\n");
+  printf("Accesses        : %ld (%ld loads, %ld stores)\n", n, loads,
+         n - loads);
+  if (skipped) {
+    printf("Out of range    : %ld accesses ignored\n", skipped);
+  }
+  if (n) {
+    printf("Cycles          : %ld to %ld\n", records[0].cycle,
+           records[n - 1].cycle);
+  }
+  printf("Distinct words  : %ld\n", words);
+  printf("Trace size      : %ld bytes (%.2f bytes per access)\n",
+         trace->bytes, n ? (double)trace->bytes / n : 0.0);
+}
+
+static void
+print_reuse(Reuse** reuses, long n)
+{
+  printf("\n=============== REUSE DISTANCE (%% of accesses) ===============\n");
+  printf("%-12s", "distance");
+  for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+    printf(" %7dw", line_sizes[j]);
+  }
+  printf("\n");
+
+  for (int lo = 0; lo < DATA_WORDS; lo = lo ? lo * 2 : 1) {
+    int hi = lo ? lo * 2 - 1 : 0;
+    char label[24];
+    if (lo == hi) {
+      snprintf(label, sizeof(label), "%d", lo);
+    } else {
+      snprintf(label, sizeof(label), "%d-%d", lo, hi);
+    }
+    printf("%-12s", label);
+    for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+      long count = 0;
+      for (int d = lo; d <= hi; ++d) {
+        count += reuses[j]->hist[d];
+      }
+      printf(" %7.2f%%", percent(count, n));
+    }
+    printf("\n");
+  }
+
+  printf("%-12s", "cold");
+  for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+    printf(" %7.2f%%", percent(reuses[j]->cold, n));
+  }
+  printf("\n");
+}
+
+static void
+print_miss_curve(Reuse** reuses, long n)
+{
+  printf("\n=============== LRU MISS RATIO (fully associative) "
+         "===============\n");
+  printf("%-12s", "words");
+  for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+    printf(" %7dw", line_sizes[j]);
+  }
+  printf("\n");
+
+  for (int words = 1; words <= DATA_WORDS; words *= 2) {
+    printf("%-12d", words);
+    for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+      if (words < line_sizes[j]) {
+        printf(" %8s", "-");
+      } else {
+        long misses = lru_misses(reuses[j], words / line_sizes[j]);
+        printf(" %7.2f%%", percent(misses, n));
+      }
+    }
+    printf("\n");
+  }
+}
+
+/*
+ * Simulates every cache and splits its misses into compulsory, capacity
+ * (misses of the fully associative cache of the same size) and conflict
+ */
+static void
+print_caches(Reuse** reuses, const APEX_Mem_Record* records, long n,
+             const int (*geometry)[3], int num_caches)
+{
+  printf("\n=============== SET ASSOCIATIVE LRU ===============\n");
+  printf("%-12s %9s %9s %8s %11s %9s %9s\n", "sets:ways:l", "hits",
+         "misses", "miss %", "compulsory", "capacity", "conflict");
+
+  for (int c = 0; c < num_caches; ++c) {
+    APEX_Cache* cache =
+      APEX_cache_init(geometry[c][0], geometry[c][1], geometry[c][2]);
+    if (!cache) {
+      continue;
+    }
+
+    for (long i = 0; i < n; ++i) {
+      int line_address = APEX_cache_line_address(cache, records[i].address);
+      APEX_Cache_Line* line = APEX_cache_lookup(cache, line_address);
+      if (line) {
+        cache->hits++;
+        APEX_cache_touch(cache, line);
+      } else {
+        cache->misses++;
+        APEX_cache_fill(cache, line_address, LINE_E, NULL);
+      }
+    }
+
+    Reuse* reuse = get_reuse(reuses, records, n, geometry[c][2]);
+    long full = lru_misses(reuse, (long)geometry[c][0] * geometry[c][1]);
+    char label[40];
+    snprintf(label, sizeof(label), "%d:%d:%d", geometry[c][0], geometry[c][1],
+             geometry[c][2]);
+    printf("%-12s %9ld %9ld %7.2f%% %11ld %9ld %9ld\n", label, cache->hits,
+           cache->misses, percent(cache->misses, n), reuse->cold,
+           full - reuse->cold, cache->misses - full);
+    APEX_cache_free(cache);
+  }
+}
+
+static void
+print_working_set(const APEX_Mem_Record* records, long n, long window,
+                  int line_words, int verbose)
+{
+  char words[DATA_WORDS];
+  char lines[DATA_WORDS];
+  long windows = 0;
+  long sum_words = 0, sum_lines = 0;
+  long max_words = 0, max_lines = 0;
+
+  printf("\n=============== WORKING SET (%ld accesses, %d word lines) "
+         "===============\n",
+         window, line_words);
+  if (verbose) {
+    printf("%-8s %-12s %9s %9s\n", "window", "first cycle", "words", "lines");
+  }
+
+  for (long start = 0; start < n; start += window) {
+    long distinct_words = 0, distinct_lines = 0;
+    memset(words, 0, sizeof(words));
+    memset(lines, 0, sizeof(lines));
+
+    for (long i = start; i < n && i < start + window; ++i) {
+      int address = records[i].address;
+      if (!words[address]) {
+        words[address] = 1;
+        distinct_words++;
+      }
+      if (!lines[address / line_words]) {
+        lines[address / line_words] = 1;
+        distinct_lines++;
+      }
+    }
+
+    if (verbose) {
+      printf("%-8ld %-12ld %9ld %9ld\n", windows, records[start].cycle,
+             distinct_words, distinct_lines);
+    }
+    windows++;
+    sum_words += distinct_words;
+    sum_lines += distinct_lines;
+    if (distinct_words > max_words) {
+      max_words = distinct_words;
+    }
+    if (distinct_lines > max_lines) {
+      max_lines = distinct_lines;
+    }
+  }
+
+  printf("Windows         : %ld\n", windows);
+  printf("Words           : avg %.1f, max %ld\n",
+         windows ? (double)sum_words / windows : 0.0, max_words);
+  printf("Lines           : avg %.1f, max %ld\n",
+         windows ? (double)sum_lines / windows : 0.0, max_lines);
+}
+
+static int
+compare_pc(const void* a, const void* b)
+{
+  const APEX_Mem_Record* x = *(const APEX_Mem_Record* const*)a;
+  const APEX_Mem_Record* y = *(const APEX_Mem_Record* const*)b;
+  if (x->pc != y->pc) {
+    return x->pc < y->pc ? -1 : 1;
+  }
+  /* Records are in trace order, keep it within a pc */
+  return x < y ? -1 : x > y;
+}
+
+static int
+compare_accesses(const void* a, const void* b)
+{
+  const Pc_Stats* x = a;
+  const Pc_Stats* y = b;
+  long ax = x->loads + x->stores;
+  long ay = y->loads + y->stores;
+  if (ax != ay) {
+    return ax > ay ? -1 : 1;
+  }
+  return x->pc - y->pc;
+}
+
+static void
+print_pcs(const APEX_Mem_Record* records, long n)
+{
+  const APEX_Mem_Record** order = malloc(n * sizeof(*order));
+  Pc_Stats* pcs = calloc(n, sizeof(*pcs));
+  int num_pcs = 0;
+
+  for (long i = 0; i < n; ++i) {
+    order[i] = &records[i];
+  }
+  qsort(order, n, sizeof(*order), compare_pc);
+
+  for (long i = 0; i < n; ++i) {
+    if (!i || order[i]->pc != order[i - 1]->pc) {
+      pcs[num_pcs++].pc = order[i]->pc;
+    }
+    Pc_Stats* pc = &pcs[num_pcs - 1];
+    if (order[i]->is_store) {
+      pc->stores++;
+    } else {
+      pc->loads++;
+    }
+    if (i && order[i - 1]->pc == pc->pc) {
+      int stride = order[i]->address - order[i - 1]->address;
+      if (stride >= -1 && stride <= 1) {
+        pc->unit_stride++;
+      }
+      if (i > 1 && order[i - 2]->pc == pc->pc &&
+          stride == order[i - 1]->address - order[i - 2]->address) {
+        pc->same_stride++;
+      }
+    }
+  }
+  qsort(pcs, num_pcs, sizeof(*pcs), compare_accesses);
+
+  printf("\n=============== ACCESSES BY PC ===============\n");
+  printf("%-8s %9s %9s %12s %12s\n", "pc", "loads", "stores", "same stride",
+         "unit stride");
+  for (int i = 0; i < num_pcs && i < TOP_PCS; ++i) {
+    long accesses = pcs[i].loads + pcs[i].stores;
+    printf("%-8d %9ld %9ld %11.2f%% %11.2f%%\n", pcs[i].pc, pcs[i].loads,
+           pcs[i].stores, percent(pcs[i].same_stride, accesses),
+           percent(pcs[i].unit_stride, accesses));
+  }
+  free(order);
+  free(pcs);
+}
+
+int
+main(int argc, char* argv[])
+{
+  int geometry[MAX_CACHES][3];
+  int num_caches = 0;
+  long window = 1000;
+  int line_words = 4;
+  int verbose = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "c:w:l:v")) != -1) {
+    switch (opt) {
+      case 'c':
+        if (num_caches == MAX_CACHES ||
+            APEX_cache_parse_geometry(optarg, &geometry[num_caches][0],
+                                      &geometry[num_caches][1],
+                                      &geometry[num_caches][2]) ||
+            geometry[num_caches][2] > DATA_WORDS) {
+          usage();
+        }
+        num_caches++;
+        break;
+      case 'w':
+        window = atol(optarg);
+        break;
+      case 'l':
+        line_words = atoi(optarg);
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind != argc - 1 || window <= 0 || line_words <= 0 ||
+      line_words > DATA_WORDS) {
+    usage();
+  }
+  if (!num_caches) {
+    static const int defaults[][3] = {
+      { 16, 1, 4 }, { 16, 2, 4 }, { 16, 4, 4 }, { 64, 2, 4 }
+    };
+    num_caches = sizeof(defaults) / sizeof(defaults[0]);
+    memcpy(geometry, defaults, sizeof(defaults));
+  }
+
+  APEX_Memtrace* trace = APEX_memtrace_open(argv[optind], 0);
+  if (!trace) {
+    fprintf(stderr, "APEX_Error : Unable to open trace %s\n", argv[optind]);
+    return 1;
+  }
+
+  /* Only accesses within data memory are analyzed */
+  APEX_Mem_Record* records = NULL;
+  APEX_Mem_Record record;
+  long n = 0, capacity = 0, skipped = 0;
+  int result;
+  while ((result = APEX_memtrace_next(trace, &record)) == 1) {
+    if (record.address < 0 || record.address >= DATA_WORDS) {
+      skipped++;
+      continue;
+    }
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 4096;
+      records = realloc(records, capacity * sizeof(*records));
+    }
+    records[n++] = record;
+  }
+  if (result < 0) {
+    fprintf(stderr, "APEX_Error : Trace %s is corrupt after %ld accesses\n",
+            argv[optind], trace->records);
+  }
+
+  /* Reuse distances per line size, more are added for simulated caches */
+  Reuse* reuses[MAX_REUSE] = { NULL };
+  for (int j = 0; j < NUM_LINE_SIZES; ++j) {
+    get_reuse(reuses, records, n, line_sizes[j]);
+  }
+
+  print_summary(records, n, skipped, trace);
+  print_reuse(reuses, n);
+  print_miss_curve(reuses, n);
+  print_caches(reuses, records, n, (const int(*)[3])geometry, num_caches);
+  print_working_set(records, n, window, line_words, verbose);
+  print_pcs(records, n);
+
+  for (int i = 0; i < MAX_REUSE && reuses[i]; ++i) {
+    free(reuses[i]);
+  }
+  free(records);
+  APEX_memtrace_close(trace);
+  return result < 0;
+}
@@ -0,0 +1,545 @@
+/*
+ *  multicore.c
+ *  Contains the multicore APEX simulation: N cores, each running its own
+ *  program, share one data memory through private L1 caches kept coherent
+ *  with MESI or MOESI.
+ *
+ *  Cores are simulated in parallel on host threads using quantum based
+ *  synchronization. During a quantum every core runs its pipeline on its own
+ *  and only logs its data memory accesses; loads observe the shared memory as
+ *  of the last synchronization plus the core's own stores. At the end of the
+ *  quantum all logs are replayed in global (cycle, core) order through the
+ *  coherence protocol, which commits the stores, updates every L1 and charges
+ *  the miss latencies to the cores as pipeline freeze cycles. The result is
+ *  deterministic and independent of the number of host threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "multicore.h"
+
+/* Argument of a host thread */
+typedef struct MC_Worker
+{
+  APEX_System* sys;
+  int tid;
+} MC_Worker;
+
+void
+APEX_system_default_config(MC_Config* config)
+{
+  config->protocol = COHERENCE_MESI;
+  config->quantum = 100;
+  config->num_threads = 1;
+  config->sets = 16;
+  config->ways = 2;
+  config->line_words = 4;
+  config->miss_latency = 10;
+  config->c2c_latency = 4;
+  config->max_cycles = 10000000;
+}
+
+/*
+ * Memory handler installed in every core, runs on the core's host thread
+ * while the shared state is read only
+ */
+static int
+mc_mem_access(APEX_CPU* cpu, int address, int is_store, int value)
+{
+  MC_Core* core = cpu->mem_context;
+
+  if (address < 0 || address >= MC_MEMORY_WORDS) {
+    return 0;
+  }
+
+  if (core->log_len == core->log_capacity) {
+    int capacity = core->log_capacity * 2;
+    MC_Access* log = realloc(core->log, sizeof(*log) * capacity);
+    if (!log) {
+      /* The access cannot take part in the quantum, the core stops here
+       * and the run fails rather than go on with a wrong value
+       */
+      if (!core->failed) {
+        fprintf(stderr,
+                "APEX_Error : Core %d out of memory logging its accesses, "
+                "stopped at cycle %d\n",
+                core->id, cpu->clock);
+      }
+      core->failed = 1;
+      return 0;
+    }
+    core->log = log;
+    core->log_capacity = capacity;
+  }
+
+  MC_Access* access = &core->log[core->log_len++];
+  access->cycle = cpu->clock;
+  access->address = address;
+  access->value = value;
+  access->is_store = is_store;
+
+  if (is_store) {
+    return 0;
+  }
+
+  /* Own stores of this quantum are visible to later loads right away */
+  for (int i = core->log_len - 2; i >= 0; --i) {
+    if (core->log[i].is_store && core->log[i].address == address) {
+      return core->log[i].value;
+    }
+  }
+  return core->sys->memory[address];
+}
+
+/*
+ * Creates a cpu for core i and preloads the data sections of its program
+ * into the shared memory. Programs may only preload the same word with the
+ * same value. preloaded_by records which core preloaded each word, plus 1.
+ */
+static APEX_CPU*
+load_program(APEX_System* sys, int i, const char* filename, int* preloaded_by)
+{
+  APEX_Program program;
+  if (APEX_assemble(&filename, 1, 0, &program)) {
+    return NULL;
+  }
+
+  for (int a = 0; a < program.data_size; ++a) {
+    int other = preloaded_by[a] - 1;
+    if (other >= 0 && sys->memory[a] != program.data[a]) {
+      fprintf(stderr,
+              "APEX_Error : Core %d preloads memory[%d] with %d, core %d "
+              "with %d\n",
+              i, a, program.data[a], other, sys->memory[a]);
+      APEX_program_free(&program);
+      return NULL;
+    }
+    sys->memory[a] = program.data[a];
+    preloaded_by[a] = i + 1;
+  }
+
+  APEX_CPU* cpu = APEX_cpu_init_program(&program);
+  if (!cpu) {
+    APEX_program_free(&program);
+    return NULL;
+  }
+  cpu->owns_code_memory = 1;
+  free(program.data);
+  return cpu;
+}
+
+APEX_System*
+APEX_system_init(const char** filenames, int num_cores,
+                 const MC_Config* config)
+{
+  if (num_cores <= 0 || config->quantum <= 0) {
+    return NULL;
+  }
+
+  APEX_System* sys = calloc(1, sizeof(*sys));
+  if (!sys) {
+    return NULL;
+  }
+  sys->config = *config;
+  if (sys->config.num_threads <= 0) {
+    sys->config.num_threads = 1;
+  }
+  if (sys->config.num_threads > num_cores) {
+    sys->config.num_threads = num_cores;
+  }
+
+  sys->cores = calloc(num_cores, sizeof(MC_Core));
+  if (!sys->cores) {
+    free(sys);
+    return NULL;
+  }
+  sys->num_cores = num_cores;
+
+  int preloaded_by[MC_MEMORY_WORDS] = { 0 };
+  for (int i = 0; i < num_cores; ++i) {
+    MC_Core* core = &sys->cores[i];
+    core->id = i;
+    core->sys = sys;
+    core->cpu = load_program(sys, i, filenames[i], preloaded_by);
+    core->l1 = APEX_cache_init(config->sets, config->ways, config->line_words);
+    core->log_capacity = config->quantum + 1;
+    core->log = malloc(sizeof(MC_Access) * core->log_capacity);
+
+    if (!core->cpu || !core->l1 || !core->log) {
+      fprintf(stderr, "APEX_Error : Unable to initialize core %d (%s)\n", i,
+              filenames[i]);
+      APEX_system_stop(sys);
+      return NULL;
+    }
+
+    core->cpu->debug_messages = 0;
+    core->cpu->mem_handler = mc_mem_access;
+    core->cpu->mem_context = core;
+  }
+  return sys;
+}
+
+static int
+core_done(APEX_System* sys, MC_Core* core)
+{
+  APEX_CPU* cpu = core->cpu;
+  if (core->failed || cpu->clock >= sys->config.max_cycles) {
+    return 1;
+  }
+  /* The last instructions may still have a memory access to log */
+  return APEX_cpu_drained(cpu);
+}
+
+/*
+ * GetS: other holders supply or share the line.
+ * Returns the number of other caches holding the line.
+ */
+static int
+snoop_read(APEX_System* sys, MC_Core* core, int line_address, int* supplied)
+{
+  int holders = 0;
+  for (int i = 0; i < sys->num_cores; ++i) {
+    MC_Core* other = &sys->cores[i];
+    if (other == core) {
+      continue;
+    }
+    APEX_Cache_Line* line = APEX_cache_lookup(other->l1, line_address);
+    if (!line) {
+      continue;
+    }
+    holders++;
+
+    switch (line->state) {
+      case LINE_M:
+        if (sys->config.protocol == COHERENCE_MOESI) {
+          line->state = LINE_O;
+        } else {
+          line->state = LINE_S;
+          other->stats.writebacks++;
+        }
+        *supplied = 1;
+        break;
+      case LINE_E:
+        line->state = LINE_S;
+        *supplied = 1;
+        break;
+      case LINE_O:
+        *supplied = 1;
+        break;
+    }
+  }
+  return holders;
+}
+
+/*
+ * GetM / Upgrade: every other copy of the line is invalidated
+ */
+static void
+snoop_write(APEX_System* sys, MC_Core* core, int line_address, int* supplied)
+{
+  for (int i = 0; i < sys->num_cores; ++i) {
+    MC_Core* other = &sys->cores[i];
+    if (other == core) {
+      continue;
+    }
+    APEX_Cache_Line* line = APEX_cache_lookup(other->l1, line_address);
+    if (!line) {
+      continue;
+    }
+    if (line->state != LINE_S) {
+      *supplied = 1;
+    }
+    line->state = LINE_I;
+    other->stats.invalidations_received++;
+    core->stats.invalidations_sent++;
+  }
+}
+
+static APEX_Cache_Line*
+install(MC_Core* core, int line_address, int state)
+{
+  APEX_Cache_Line victim;
+  APEX_Cache_Line* line =
+    APEX_cache_fill(core->l1, line_address, state, &victim);
+
+  /* Dirty lines are written back to shared memory on eviction */
+  if (victim.state == LINE_M || victim.state == LINE_O) {
+    core->stats.writebacks++;
+  }
+  return line;
+}
+
+static void
+replay_access(APEX_System* sys, MC_Core* core, MC_Access* access)
+{
+  APEX_Cache* l1 = core->l1;
+  int line_address = APEX_cache_line_address(l1, access->address);
+  APEX_Cache_Line* line = APEX_cache_lookup(l1, line_address);
+  int supplied = 0;
+  int latency = 0;
+
+  if (access->is_store) {
+    core->stats.stores++;
+    sys->memory[access->address] = access->value;
+
+    if (line && (line->state == LINE_M || line->state == LINE_E)) {
+      core->stats.hits++;
+      l1->hits++;
+      line->state = LINE_M;
+    } else if (line) {
+      /* S or O: ownership is gained without a data transfer */
+      core->stats.upgrades++;
+      core->stats.hits++;
+      l1->hits++;
+      int owned = 0;
+      snoop_write(sys, core, line_address, &owned);
+      line->state = LINE_M;
+      latency = sys->config.c2c_latency;
+    } else {
+      core->stats.misses++;
+      core->stats.get_m++;
+      l1->misses++;
+      snoop_write(sys, core, line_address, &supplied);
+      line = install(core, line_address, LINE_M);
+      latency =
+        supplied ? sys->config.c2c_latency : sys->config.miss_latency;
+    }
+  } else {
+    core->stats.loads++;
+
+    if (line) {
+      core->stats.hits++;
+      l1->hits++;
+    } else {
+      core->stats.misses++;
+      core->stats.get_s++;
+      l1->misses++;
+      int holders = snoop_read(sys, core, line_address, &supplied);
+      line = install(core, line_address, holders ? LINE_S : LINE_E);
+      latency =
+        supplied ? sys->config.c2c_latency : sys->config.miss_latency;
+    }
+  }
+
+  if (supplied) {
+    core->stats.cache_to_cache++;
+  }
+  APEX_cache_touch(l1, line);
+  core->cpu->freeze_cycles += latency;
+}
+
+/*
+ * Merges the logs of all cores in (cycle, core) order and replays them
+ */
+static void
+replay_quantum(APEX_System* sys)
+{
+  int pos[sys->num_cores];
+  memset(pos, 0, sizeof(pos));
+
+  for (;;) {
+    MC_Core* next = NULL;
+    for (int i = 0; i < sys->num_cores; ++i) {
+      MC_Core* core = &sys->cores[i];
+      if (pos[i] == core->log_len) {
+        continue;
+      }
+      if (!next || core->log[pos[i]].cycle < next->log[pos[next->id]].cycle) {
+        next = core;
+      }
+    }
+    if (!next) {
+      break;
+    }
+    replay_access(sys, next, &next->log[pos[next->id]++]);
+  }
+
+  for (int i = 0; i < sys->num_cores; ++i) {
+    sys->cores[i].log_len = 0;
+  }
+}
+
+static void*
+worker(void* arg)
+{
+  MC_Worker* w = arg;
+  APEX_System* sys = w->sys;
+
+  /* Held until every host thread was created */
+  pthread_mutex_lock(&sys->start_lock);
+  pthread_mutex_unlock(&sys->start_lock);
+  if (sys->aborted) {
+    return NULL;
+  }
+
+  for (;;) {
+    long until = (long)(sys->quanta + 1) * sys->config.quantum;
+
+    for (int i = w->tid; i < sys->num_cores; i += sys->config.num_threads) {
+      MC_Core* core = &sys->cores[i];
+      while (core->cpu->clock < until && !core_done(sys, core)) {
+        if (APEX_cpu_step(core->cpu)) {
+          core->failed = 1;
+        }
+      }
+    }
+
+    pthread_barrier_wait(&sys->barrier);
+    if (w->tid == 0) {
+      replay_quantum(sys);
+      sys->quanta++;
+      sys->finished = 1;
+      for (int i = 0; i < sys->num_cores; ++i) {
+        if (!core_done(sys, &sys->cores[i])) {
+          sys->finished = 0;
+        }
+      }
+    }
+    pthread_barrier_wait(&sys->barrier);
+
+    if (sys->finished) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Runs all cores to completion, returns 0 on success and -1 if a core was
+ * stopped
+ */
+int
+APEX_system_run(APEX_System* sys)
+{
+  int num_threads = sys->config.num_threads;
+  pthread_t threads[num_threads];
+  MC_Worker workers[num_threads];
+
+  if (pthread_barrier_init(&sys->barrier, NULL, num_threads)) {
+    return -1;
+  }
+  pthread_mutex_init(&sys->start_lock, NULL);
+
+  /* The threads started wait for the rest, without all of them none runs */
+  int started = 1;
+  sys->aborted = 0;
+  pthread_mutex_lock(&sys->start_lock);
+  for (; started < num_threads; ++started) {
+    workers[started].sys = sys;
+    workers[started].tid = started;
+    if (pthread_create(&threads[started], NULL, worker, &workers[started])) {
+      fprintf(stderr, "APEX_Error : Unable to create host thread %d\n",
+              started);
+      sys->aborted = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sys->start_lock);
+
+  workers[0].sys = sys;
+  workers[0].tid = 0;
+  worker(&workers[0]);
+
+  for (int t = 1; t < started; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+  pthread_mutex_destroy(&sys->start_lock);
+  pthread_barrier_destroy(&sys->barrier);
+
+  if (sys->aborted) {
+    for (int i = 0; i < sys->num_cores; ++i) {
+      sys->cores[i].failed = 1;
+    }
+    return -1;
+  }
+
+  for (int i = 0; i < sys->num_cores; ++i) {
+    if (sys->cores[i].failed) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static double
+ratio(long num, long den)
+{
+  return den ? (double)num / den : 0.0;
+}
+
+void
+APEX_system_report(APEX_System* sys)
+{
+  MC_Stats total;
+  long instructions = 0;
+  int max_clock = 0;
+  double sum_ipc = 0.0;
+
+  memset(&total, 0, sizeof(total));
+
+  printf("=============== MULTICORE SIMULATION ==========\n");
+  printf("Protocol %s, %d cores, %d host threads, quantum %d cycles, "
+         "L1 %d sets x %d ways x %d words\n",
+         sys->config.protocol == COHERENCE_MOESI ? "MOESI" : "MESI",
+         sys->num_cores, sys->config.num_threads, sys->config.quantum,
+         sys->config.sets, sys->config.ways, sys->config.line_words);
+  printf("%-5s %9s %9s %7s %7s %7s %8s %8s %8s %8s %8s %8s %8s\n", "core",
+         "cycles", "insns", "IPC", "loads", "stores", "hits", "misses",
+         "upgrades", "inv_sent", "inv_recv", "wbacks", "c2c");
+
+  for (int i = 0; i < sys->num_cores; ++i) {
+    MC_Core* core = &sys->cores[i];
+    MC_Stats* s = &core->stats;
+    double ipc = ratio(core->cpu->ins_completed, core->cpu->clock);
+
+    printf("%-5d %9d %9d %7.3f %7ld %7ld %8ld %8ld %8ld %8ld %8ld %8ld %8ld\n",
+           i, core->cpu->clock, core->cpu->ins_completed, ipc, s->loads,
+           s->stores, s->hits, s->misses, s->upgrades, s->invalidations_sent,
+           s->invalidations_received, s->writebacks, s->cache_to_cache);
+
+    total.loads += s->loads;
+    total.stores += s->stores;
+    total.hits += s->hits;
+    total.misses += s->misses;
+    total.get_s += s->get_s;
+    total.get_m += s->get_m;
+    total.upgrades += s->upgrades;
+    total.invalidations_sent += s->invalidations_sent;
+    total.writebacks += s->writebacks;
+    total.cache_to_cache += s->cache_to_cache;
+    instructions += core->cpu->ins_completed;
+    sum_ipc += ipc;
+    if (core->cpu->clock > max_clock) {
+      max_clock = core->cpu->clock;
+    }
+  }
+
+  printf("Total instructions %ld in %d cycles, aggregate IPC %.3f "
+         "(sum of per core IPC %.3f)\n",
+         instructions, max_clock, ratio(instructions, max_clock), sum_ipc);
+  printf("Coherence traffic : %ld bus transactions (%ld GetS, %ld GetM, "
+         "%ld Upgrade, %ld Writeback), %ld invalidations, %ld cache to cache "
+         "transfers\n",
+         total.get_s + total.get_m + total.upgrades + total.writebacks,
+         total.get_s, total.get_m, total.upgrades, total.writebacks, total.invalidations_sent,
+         total.cache_to_cache);
+  printf("L1 hit rate %.3f, %d quanta\n",
+         ratio(total.hits, total.loads + total.stores), sys->quanta);
+}
+
+void
+APEX_system_stop(APEX_System* sys)
+{
+  for (int i = 0; i < sys->num_cores; ++i) {
+    MC_Core* core = &sys->cores[i];
+    if (core->cpu) {
+      APEX_cpu_stop(core->cpu);
+    }
+    APEX_cache_free(core->l1);
+    free(core->log);
+  }
+  free(sys->cores);
+  free(sys);
+}
@@ -0,0 +1,118 @@
+#ifndef _APEX_MULTICORE_H_
+#define _APEX_MULTICORE_H_
+/**
+ *  multicore.h
+ *  Contains data structures for simulating several APEX cores which share
+ *  one data memory through private, coherent L1 caches
+ */
+#include <pthread.h>
+
+#include "cache.h"
+#include "cpu.h"
+
+#define MC_MEMORY_WORDS 4096
+
+/* Coherence protocol kept between the L1 caches */
+enum
+{
+  COHERENCE_MESI,
+  COHERENCE_MOESI
+};
+
+/* One data memory access issued by a core during a quantum */
+typedef struct MC_Access
+{
+  int cycle;    // Core clock at which memory2 issued the access
+  int address;  // Data memory word address
+  int value;    // Stored value (stores only)
+  int is_store;
+} MC_Access;
+
+/* Per core coherence statistics */
+typedef struct MC_Stats
+{
+  long loads;
+  long stores;
+  long hits;
+  long misses;
+  long get_s;         // Read misses
+  long get_m;         // Write misses
+  long upgrades;      // Writes to S or O lines
+  long invalidations_sent;
+  long invalidations_received;
+  long writebacks;
+  long cache_to_cache;
+} MC_Stats;
+
+struct APEX_System;
+
+/* Model of one core with its private L1 */
+typedef struct MC_Core
+{
+  int id;
+  APEX_CPU* cpu;
+  APEX_Cache* l1;
+  struct APEX_System* sys;
+
+  /* Accesses of the current quantum, replayed in global order at its end */
+  MC_Access* log;
+  int log_len;
+  int log_capacity;
+
+  /* Stopped because an access could not be logged, a step failed or the
+   * host threads could not be created
+   */
+  int failed;
+
+  MC_Stats stats;
+} MC_Core;
+
+/* Configuration of a multicore simulation */
+typedef struct MC_Config
+{
+  int protocol;       // COHERENCE_MESI or COHERENCE_MOESI
+  int quantum;        // Cycles simulated between two synchronizations
+  int num_threads;    // Host threads, cores are distributed round robin
+  int sets;           // L1 geometry
+  int ways;
+  int line_words;
+  int miss_latency;   // Cycles to fetch a line from shared memory
+  int c2c_latency;    // Cycles to fetch a line from another L1 or upgrade
+  long max_cycles;    // Safety limit on simulated cycles per core
+} MC_Config;
+
+/* Model of the whole system */
+typedef struct APEX_System
+{
+  MC_Config config;
+  int num_cores;
+  MC_Core* cores;
+
+  /* Shared data memory, only written while all cores are synchronized */
+  int memory[MC_MEMORY_WORDS];
+
+  int quanta;
+  int finished;
+  pthread_barrier_t barrier;
+  pthread_mutex_t start_lock;
+  int aborted;            // A host thread could not be created, none ran
+} APEX_System;
+
+void
+APEX_system_default_config(MC_Config* config);
+
+APEX_System*
+APEX_system_init(const char** filenames, int num_cores,
+                 const MC_Config* config);
+
+/* Returns 0 on success, -1 if a core had to be stopped */
+int
+APEX_system_run(APEX_System* sys);
+
+void
+APEX_system_report(APEX_System* sys);
+
+void
+APEX_system_stop(APEX_System* sys);
+
+#endif
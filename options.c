@@ -0,0 +1,546 @@
+/*
+ *  options.c
+ *  Contains the runtime options of the APEX cpu, set from the command line
+ *  as --name=value
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "energy.h"
+#include "fastforward.h"
+#include "lsq.h"
+#include "memtrace.h"
+#include "pipeline.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "replay.h"
+#include "smt.h"
+#include "telemetry.h"
+#include "vpred.h"
+
+/* Description of one runtime option */
+typedef struct APEX_Option
+{
+  const char* name;
+  const char* help;
+  int (*set)(APEX_CPU* cpu, const char* value);
+} APEX_Option;
+
+static int
+parse_long(const char* value, long min, long max, long* result)
+{
+  char* end;
+  long number = strtol(value, &end, 10);
+  if (end == value || *end || number < min || number > max) {
+    return -1;
+  }
+  *result = number;
+  return 0;
+}
+
+static int
+set_fast_forward(APEX_CPU* cpu, const char* value)
+{
+  return parse_long(value, 0, LONG_MAX, &cpu->ff_instructions);
+}
+
+static int
+set_ff_mode(APEX_CPU* cpu, const char* value)
+{
+  if (!strcmp(value, "interp")) {
+    cpu->ff_mode = FF_INTERPRET;
+  } else if (!strcmp(value, "jit")) {
+    cpu->ff_mode = FF_JIT;
+  } else if (!strcmp(value, "selfcheck")) {
+    cpu->ff_mode = FF_SELFCHECK;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static int
+set_memtrace(APEX_CPU* cpu, const char* value)
+{
+  APEX_memtrace_close(cpu->memtrace);
+  cpu->memtrace = APEX_memtrace_open(value, 1);
+  return cpu->memtrace ? 0 : -1;
+}
+
+/* The data cache times accesses on its own, not on top of the load/store
+ * queue
+ */
+static int
+no_cache_and_lsq(APEX_CPU* cpu, int lsq)
+{
+  if (lsq ? cpu->prefetch != NULL : cpu->lsq != NULL) {
+    fprintf(stderr,
+            "APEX_Error : The data cache does not work with the load/store "
+            "queue\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* The load/store queue is created by the first option which configures it */
+static APEX_LSQ*
+get_lsq(APEX_CPU* cpu)
+{
+  if (!cpu->lsq && !no_cache_and_lsq(cpu, 1)) {
+    cpu->lsq = APEX_lsq_init();
+  }
+  return cpu->lsq;
+}
+
+static int
+set_mem_latency(APEX_CPU* cpu, const char* value)
+{
+  long latency;
+  if (parse_long(value, 0, 1000, &latency) || !get_lsq(cpu)) {
+    return -1;
+  }
+  cpu->lsq->latency = latency;
+  return 0;
+}
+
+static int
+set_store_buffer(APEX_CPU* cpu, const char* value)
+{
+  long size;
+  if (parse_long(value, 0, 1024, &size) || !get_lsq(cpu)) {
+    return -1;
+  }
+  return APEX_lsq_resize(cpu->lsq, size);
+}
+
+static int
+set_load_issue(APEX_CPU* cpu, const char* value)
+{
+  static const char* policies[] = { "inorder", "early", "speculative",
+                                    "mdp" };
+  for (int i = 0; i < (int)(sizeof(policies) / sizeof(policies[0])); ++i) {
+    if (!strcmp(value, policies[i])) {
+      if (!get_lsq(cpu)) {
+        return -1;
+      }
+      cpu->lsq->load_issue = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* The data cache is created by the first option which configures it */
+static APEX_Prefetch*
+get_prefetch(APEX_CPU* cpu)
+{
+  if (!cpu->prefetch && !no_cache_and_lsq(cpu, 0)) {
+    cpu->prefetch = APEX_prefetch_init();
+  }
+  return cpu->prefetch;
+}
+
+static int
+set_dcache(APEX_CPU* cpu, const char* value)
+{
+  if (!get_prefetch(cpu)) {
+    return -1;
+  }
+  return APEX_prefetch_set_cache(cpu->prefetch, value);
+}
+
+static int
+set_dcache_miss(APEX_CPU* cpu, const char* value)
+{
+  long latency;
+  if (parse_long(value, 0, 1000, &latency) || !get_prefetch(cpu)) {
+    return -1;
+  }
+  cpu->prefetch->miss_latency = latency;
+  return 0;
+}
+
+static int
+set_prefetch(APEX_CPU* cpu, const char* value)
+{
+  if (!get_prefetch(cpu)) {
+    return -1;
+  }
+  return APEX_prefetch_set_kind(cpu->prefetch, value);
+}
+
+static int
+set_prefetch_degree(APEX_CPU* cpu, const char* value)
+{
+  long degree;
+  if (parse_long(value, 1, PREFETCH_MAX_DEGREE, &degree) ||
+      !get_prefetch(cpu)) {
+    return -1;
+  }
+  cpu->prefetch->degree = degree;
+  return 0;
+}
+
+/* The predictors match producers by register, not by hardware thread */
+static int
+no_threads(APEX_CPU* cpu)
+{
+  if (cpu->smt) {
+    fprintf(stderr,
+            "APEX_Error : Value and address prediction do not work with "
+            "--threads\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+set_value_predict(APEX_CPU* cpu, const char* value)
+{
+  if (no_threads(cpu)) {
+    return -1;
+  }
+  if (!cpu->vpred && !(cpu->vpred = APEX_vpred_init())) {
+    return -1;
+  }
+  return APEX_vpred_set_value(cpu->vpred, value);
+}
+
+static int
+set_address_predict(APEX_CPU* cpu, const char* value)
+{
+  if (no_threads(cpu)) {
+    return -1;
+  }
+  if (!cpu->vpred && !(cpu->vpred = APEX_vpred_init())) {
+    return -1;
+  }
+  return APEX_vpred_set_address(cpu->vpred, value);
+}
+
+/* The energy model is created by the first option which configures it */
+static APEX_Energy*
+get_energy(APEX_CPU* cpu)
+{
+  if (!cpu->energy) {
+    cpu->energy = APEX_energy_init();
+  }
+  return cpu->energy;
+}
+
+static int
+set_energy(APEX_CPU* cpu, const char* value)
+{
+  if (!get_energy(cpu)) {
+    return -1;
+  }
+  return APEX_energy_set_costs(cpu->energy, value);
+}
+
+static int
+set_energy_window(APEX_CPU* cpu, const char* value)
+{
+  long window;
+  if (parse_long(value, 1, INT_MAX, &window) || !get_energy(cpu)) {
+    return -1;
+  }
+  APEX_energy_set_window(cpu->energy, window);
+  return 0;
+}
+
+static int
+set_energy_mhz(APEX_CPU* cpu, const char* value)
+{
+  long mhz;
+  if (parse_long(value, 1, 100000, &mhz) || !get_energy(cpu)) {
+    return -1;
+  }
+  cpu->energy->mhz = mhz;
+  return 0;
+}
+
+static int
+set_telemetry(APEX_CPU* cpu, const char* value)
+{
+  if (cpu->telemetry) {
+    APEX_telemetry_close(cpu);
+  }
+  cpu->telemetry = APEX_telemetry_open(value);
+  return cpu->telemetry ? 0 : -1;
+}
+
+/* Window and format apply to the file opened by --telemetry before them */
+static int
+set_telemetry_window(APEX_CPU* cpu, const char* value)
+{
+  long window;
+  if (!cpu->telemetry || parse_long(value, 1, INT_MAX - 1, &window)) {
+    return -1;
+  }
+  APEX_telemetry_set_window(cpu->telemetry, window);
+  return 0;
+}
+
+static int
+set_telemetry_format(APEX_CPU* cpu, const char* value)
+{
+  if (!cpu->telemetry) {
+    return -1;
+  }
+  return APEX_telemetry_set_format(cpu->telemetry, value);
+}
+
+static int
+set_analyze(APEX_CPU* cpu, const char* value)
+{
+  long analyze;
+  if (parse_long(value, 0, 1, &analyze)) {
+    return -1;
+  }
+  cpu->analyze = analyze;
+  return 0;
+}
+
+static int
+set_self_profile(APEX_CPU* cpu, const char* value)
+{
+  long enable;
+  if (parse_long(value, 0, 1, &enable)) {
+    return -1;
+  }
+#if APEX_SELF_PROFILE
+  if (enable && !cpu->profile) {
+    cpu->profile = APEX_profile_init();
+    if (!cpu->profile) {
+      return -1;
+    }
+    cpu->profile->phase[PROFILE_PARSE] = cpu->parse_ticks;
+  } else if (!enable) {
+    free(cpu->profile);
+    cpu->profile = NULL;
+  }
+  return 0;
+#else
+  if (enable) {
+    fprintf(stderr,
+            "APEX_Error : Simulator built without the self-profiler\n");
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+static int
+set_threads(APEX_CPU* cpu, const char* value)
+{
+  long threads;
+  if (parse_long(value, 1, APEX_MAX_THREADS, &threads)) {
+    return -1;
+  }
+  if (threads > 1 && cpu->vpred) {
+    fprintf(stderr,
+            "APEX_Error : --threads does not work with value or address "
+            "prediction\n");
+    return -1;
+  }
+  APEX_smt_free(cpu->smt);
+  cpu->smt = NULL;
+  if (threads > 1 && !(cpu->smt = APEX_smt_init(threads))) {
+    return -1;
+  }
+  return 0;
+}
+
+/* The policy applies to the threads of --threads before it */
+static int
+set_thread_policy(APEX_CPU* cpu, const char* value)
+{
+  if (!cpu->smt) {
+    return -1;
+  }
+  return APEX_smt_set_policy(cpu->smt, value);
+}
+
+static int
+set_specialize(APEX_CPU* cpu, const char* value)
+{
+  long specialize;
+  if (parse_long(value, 0, 1, &specialize)) {
+    return -1;
+  }
+  cpu->specialize = specialize;
+  return 0;
+}
+
+/* Record and replay is set up by the first option which configures it */
+static APEX_Replay*
+get_replay(APEX_CPU* cpu)
+{
+  if (!cpu->replay) {
+    cpu->replay = APEX_replay_init();
+  }
+  return cpu->replay;
+}
+
+static int
+set_record(APEX_CPU* cpu, const char* value)
+{
+  if (!get_replay(cpu)) {
+    return -1;
+  }
+  return APEX_replay_set_record(cpu->replay, value);
+}
+
+static int
+set_record_interval(APEX_CPU* cpu, const char* value)
+{
+  long interval;
+  if (parse_long(value, 1, INT_MAX, &interval) || !get_replay(cpu)) {
+    return -1;
+  }
+  cpu->replay->interval = interval;
+  return 0;
+}
+
+static int
+set_checkpoint_interval(APEX_CPU* cpu, const char* value)
+{
+  long interval;
+  if (parse_long(value, 0, INT_MAX, &interval) || !get_replay(cpu)) {
+    return -1;
+  }
+  cpu->replay->checkpoint_interval = interval;
+  return 0;
+}
+
+static int
+set_record_from(APEX_CPU* cpu, const char* value)
+{
+  if (!get_replay(cpu)) {
+    return -1;
+  }
+  return parse_long(value, 0, INT_MAX, &cpu->replay->record_from);
+}
+
+static int
+set_restore(APEX_CPU* cpu, const char* value)
+{
+  if (!get_replay(cpu)) {
+    return -1;
+  }
+  return APEX_replay_set_restore(cpu->replay, value);
+}
+
+static int
+set_trace_from(APEX_CPU* cpu, const char* value)
+{
+  if (!get_replay(cpu)) {
+    return -1;
+  }
+  return parse_long(value, 0, INT_MAX, &cpu->replay->trace_from);
+}
+
+static const APEX_Option options[] = {
+  { "pipeline",
+    "stages as F,DRF,EX,MEM,WB with optional :latency, or 5, 7, 12",
+    APEX_pipeline_configure },
+  { "fast-forward", "instructions to execute functionally first",
+    set_fast_forward },
+  { "ff-mode", "interp, jit (default) or selfcheck", set_ff_mode },
+  { "memtrace", "file to write the data memory access trace to",
+    set_memtrace },
+  { "mem-latency", "cycles of a data access beyond the memory stage",
+    set_mem_latency },
+  { "store-buffer", "store buffer entries, 0 for none", set_store_buffer },
+  { "load-issue", "inorder (default), early, speculative or mdp",
+    set_load_issue },
+  { "dcache", "data cache as sets:ways:words (default 64:2:4)",
+    set_dcache },
+  { "dcache-miss", "cycles an access missing the data cache waits (default 10)",
+    set_dcache_miss },
+  { "prefetch", "none (default), next-line, stride or stream, adds a cache",
+    set_prefetch },
+  { "prefetch-degree",
+    "lines prefetched ahead, stream buffer depth, 1 to 8 (default 2)",
+    set_prefetch_degree },
+  { "value-predict",
+    "none, last, stride or context, adds a load-use interlock",
+    set_value_predict },
+  { "address-predict", "none or stride", set_address_predict },
+  { "energy",
+    "default or costs in pJ as event:cost,... of fetch, rf-read, rf-write, "
+    "alu, mem-read, mem-write, latch, cycle",
+    set_energy },
+  { "energy-window", "cycles per power sample (default 1000)",
+    set_energy_window },
+  { "energy-mhz", "clock frequency for power (default 1000)",
+    set_energy_mhz },
+  { "telemetry", "file to stream per window statistics to",
+    set_telemetry },
+  { "telemetry-window", "cycles per telemetry record (default 1000)",
+    set_telemetry_window },
+  { "telemetry-format", "csv (default) or line (InfluxDB line protocol)",
+    set_telemetry_format },
+  { "analyze", "1 to analyze dependencies and cycle bounds first",
+    set_analyze },
+  { "self-profile", "1 to report host time per stage of the simulator",
+    set_self_profile },
+  { "threads", "hardware threads sharing the pipeline, 1 (default) to 8",
+    set_threads },
+  { "thread-policy", "rr (default), icount or switch (on a decode stall)",
+    set_thread_policy },
+  { "specialize",
+    "0 to step with the generic stages instead of ones compiled for the "
+    "features in use",
+    set_specialize },
+  { "record",
+    "file to record a hash of the architectural state and checkpoints to",
+    set_record },
+  { "record-interval", "cycles per recorded hash (default 1000)",
+    set_record_interval },
+  { "record-from", "first cycle to record a hash of (default 0)",
+    set_record_from },
+  { "checkpoint-interval",
+    "cycles per recorded checkpoint (default 100000), 0 for none",
+    set_checkpoint_interval },
+  { "restore",
+    "file:cycle, start from the last checkpoint at or before cycle",
+    set_restore },
+  { "trace-from", "cycle to print stage messages from, quiet before",
+    set_trace_from },
+};
+
+#define NUM_OPTIONS (int)(sizeof(options) / sizeof(options[0]))
+
+/*
+ * This function sets option name of cpu, returns 0 on success
+ */
+int
+APEX_cpu_set_option(APEX_CPU* cpu, const char* name, const char* value)
+{
+  for (int i = 0; i < NUM_OPTIONS; ++i) {
+    if (!strcmp(name, options[i].name)) {
+      if (options[i].set(cpu, value)) {
+        fprintf(stderr, "APEX_Error : Invalid value '%s' for --%s\n", value,
+                name);
+        return -1;
+      }
+      /* The stages are specialized again for the new configuration */
+      cpu->variant = NULL;
+      return 0;
+    }
+  }
+  fprintf(stderr, "APEX_Error : Unknown option --%s\n", name);
+  return -1;
+}
+
+void
+APEX_print_options(FILE* out)
+{
+  for (int i = 0; i < NUM_OPTIONS; ++i) {
+    fprintf(out, "  --%s=<%s>\n", options[i].name, options[i].help);
+  }
+}
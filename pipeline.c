@@ -0,0 +1,183 @@
+/*
+ *  pipeline.c
+ *  Contains functions to assemble the APEX pipeline from a description
+ *  of its stages.
+ *
+ *  A description is a comma separated list of stages, each one a stage kind
+ *  (F, DRF, EX, MEM, WB) with an optional number and an optional latency,
+ *  e.g. "F,DRF,EX:2,MEM,WB" or "F1,F2,DRF,EX1,EX2,MEM1,MEM2,WB". Kinds have
+ *  to appear in pipeline order. Within a group of stages of the same kind the
+ *  first fetch stage, and the last stage of every other kind, does the work;
+ *  the other stages only delay the instruction.
+ *  The presets "5", "7" and "12" name common pipelines.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+static const struct
+{
+  const char* name;
+  const char* spec;
+} presets[] = {
+  { "5", "F,DRF,EX,MEM,WB" },
+  { "7", "F,DRF,EX1,EX2,MEM1,MEM2,WB" },
+  { "12", "F1,F2,DRF1,DRF2,EX1,EX2,EX3,EX4,MEM1,MEM2,MEM3,WB" },
+};
+
+static const struct
+{
+  const char* token;
+  const char* name;
+} kinds[NUM_STAGE_KINDS] = {
+  [STAGE_FETCH] = { "F", "Fetch" },
+  [STAGE_DECODE] = { "DRF", "Decode/RF" },
+  [STAGE_EXECUTE] = { "EX", "Execute" },
+  [STAGE_MEMORY] = { "MEM", "Memory" },
+  [STAGE_WRITEBACK] = { "WB", "Writeback" },
+};
+
+/*
+ * Parses one "KIND[number][:latency]" token, returns 0 on success
+ */
+static int
+parse_stage(const char* token, APEX_Pipeline_Stage* stage)
+{
+  for (int k = 0; k < NUM_STAGE_KINDS; ++k) {
+    size_t len = strlen(kinds[k].token);
+    if (strncmp(token, kinds[k].token, len)) {
+      continue;
+    }
+
+    const char* suffix = token + len;
+    size_t digits = 0;
+    while (isdigit((unsigned char)suffix[digits])) {
+      digits++;
+    }
+    if (digits > 3) {
+      return -1;
+    }
+
+    stage->kind = k;
+    stage->latency = 1;
+    snprintf(stage->name, sizeof(stage->name), "%s%.*s", kinds[k].name,
+             (int)digits, suffix);
+
+    if (suffix[digits] == ':') {
+      char* end;
+      long latency = strtol(suffix + digits + 1, &end, 10);
+      if (*end || latency < 1 || latency > 1000) {
+        return -1;
+      }
+      stage->latency = latency;
+    } else if (suffix[digits]) {
+      return -1;
+    }
+    return 0;
+  }
+  return -1;
+}
+
+static APEX_Stage_Function
+stage_function(APEX_Pipeline_Stage* stages, int n, int s)
+{
+  int kind = stages[s].kind;
+  int first = s == 0 || stages[s - 1].kind != kind;
+  int last = s == n - 1 || stages[s + 1].kind != kind;
+
+  switch (kind) {
+    case STAGE_FETCH:
+      return first ? APEX_fetch : APEX_pass_through;
+    case STAGE_DECODE:
+      return last ? APEX_decode : APEX_pass_through;
+    case STAGE_EXECUTE:
+      return last ? APEX_execute2 : APEX_execute1;
+    case STAGE_MEMORY:
+      return last ? APEX_memory2 : APEX_memory1;
+    default:
+      return APEX_writeback;
+  }
+}
+
+/*
+ * This function assembles the pipeline of cpu from spec and empties all
+ * stage latches. Returns 0 on success, the pipeline is left unchanged on
+ * error.
+ */
+int
+APEX_pipeline_configure(APEX_CPU* cpu, const char* spec)
+{
+  APEX_Pipeline_Stage stages[APEX_MAX_STAGES];
+  char buffer[256];
+  int n = 0;
+
+  if (!spec) {
+    return -1;
+  }
+  if (cpu->clock) {
+    fprintf(stderr,
+            "APEX_Error : Pipeline can only be configured before simulation\n");
+    return -1;
+  }
+
+  for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); ++i) {
+    if (!strcmp(spec, presets[i].name)) {
+      spec = presets[i].spec;
+    }
+  }
+
+  if (strlen(spec) >= sizeof(buffer)) {
+    fprintf(stderr, "APEX_Error : Pipeline description too long\n");
+    return -1;
+  }
+  strcpy(buffer, spec);
+
+  char* save;
+  for (char* token = strtok_r(buffer, ",", &save); token;
+       token = strtok_r(NULL, ",", &save)) {
+    if (n == APEX_MAX_STAGES) {
+      fprintf(stderr, "APEX_Error : Pipeline has more than %d stages\n",
+              APEX_MAX_STAGES);
+      return -1;
+    }
+    if (parse_stage(token, &stages[n])) {
+      fprintf(stderr, "APEX_Error : Invalid pipeline stage '%s'\n", token);
+      return -1;
+    }
+    if (n && stages[n].kind < stages[n - 1].kind) {
+      fprintf(stderr, "APEX_Error : Pipeline stage '%s' out of order\n",
+              token);
+      return -1;
+    }
+    if (n && stages[n].kind > stages[n - 1].kind + 1) {
+      fprintf(stderr, "APEX_Error : Pipeline is missing a %s stage\n",
+              kinds[stages[n - 1].kind + 1].token);
+      return -1;
+    }
+    n++;
+  }
+
+  if (!n || stages[0].kind != STAGE_FETCH ||
+      stages[n - 1].kind != STAGE_WRITEBACK ||
+      (n > 1 && stages[n - 2].kind == STAGE_WRITEBACK)) {
+    fprintf(stderr, "APEX_Error : Pipeline must run from F to a single WB\n");
+    return -1;
+  }
+
+  for (int s = 0; s < n; ++s) {
+    stages[s].function = stage_function(stages, n, s);
+    cpu->pipeline[s] = stages[s];
+  }
+  cpu->num_stages = n;
+
+  /* Make all stages busy except Fetch stage, initally to start the pipeline */
+  memset(cpu->stage, 0, sizeof(cpu->stage));
+  memset(cpu->stage_wait, 0, sizeof(cpu->stage_wait));
+  for (int i = 1; i < n; ++i) {
+    cpu->stage[i].busy = 1;
+  }
+  return 0;
+}
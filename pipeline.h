@@ -0,0 +1,16 @@
+#ifndef _APEX_PIPELINE_H_
+#define _APEX_PIPELINE_H_
+/**
+ *  pipeline.h
+ *  Contains functions to assemble the APEX pipeline from a description
+ *  of its stages
+ */
+#include "cpu.h"
+
+/* F, DRF, EX1, EX2, MEM1, MEM2, WB with single cycle latencies */
+#define APEX_DEFAULT_PIPELINE "7"
+
+int
+APEX_pipeline_configure(APEX_CPU* cpu, const char* spec);
+
+#endif
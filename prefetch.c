@@ -0,0 +1,346 @@
+/*
+ *  prefetch.c
+ *  Contains the data cache of a single cpu and its hardware prefetchers
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+#define DATA_WORDS (int)(sizeof(((APEX_CPU*)0)->data_memory) / sizeof(int))
+
+static const char* kinds[] = { "none", "next-line", "stride", "stream" };
+
+#define NUM_KINDS (int)(sizeof(kinds) / sizeof(kinds[0]))
+
+APEX_Prefetch*
+APEX_prefetch_init(void)
+{
+  APEX_Prefetch* prefetch = calloc(1, sizeof(*prefetch));
+  if (!prefetch) {
+    return NULL;
+  }
+  prefetch->miss_latency = 10;
+  prefetch->degree = 2;
+  if (APEX_prefetch_set_cache(prefetch, "64:2:4")) {
+    free(prefetch);
+    return NULL;
+  }
+  return prefetch;
+}
+
+int
+APEX_prefetch_set_cache(APEX_Prefetch* prefetch, const char* geometry)
+{
+  int sets;
+  int ways;
+  int line_words;
+
+  if (APEX_cache_parse_geometry(geometry, &sets, &ways, &line_words)) {
+    return -1;
+  }
+  APEX_Cache* cache = APEX_cache_init(sets, ways, line_words);
+  unsigned char* prefetched = calloc((size_t)sets * ways, 1);
+  long* ready = calloc((size_t)sets * ways, sizeof(long));
+  if (!cache || !prefetched || !ready) {
+    APEX_cache_free(cache);
+    free(prefetched);
+    free(ready);
+    return -1;
+  }
+  APEX_cache_free(prefetch->cache);
+  free(prefetch->prefetched);
+  free(prefetch->ready);
+  prefetch->cache = cache;
+  prefetch->prefetched = prefetched;
+  prefetch->ready = ready;
+  return 0;
+}
+
+int
+APEX_prefetch_set_kind(APEX_Prefetch* prefetch, const char* name)
+{
+  for (int i = 0; i < NUM_KINDS; ++i) {
+    if (!strcmp(name, kinds[i])) {
+      prefetch->kind = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int
+line_index(APEX_Prefetch* prefetch, APEX_Cache_Line* line)
+{
+  return line - prefetch->cache->lines;
+}
+
+static int
+line_in_memory(APEX_Prefetch* prefetch, int line)
+{
+  return line >= 0 && line * prefetch->cache->line_words < DATA_WORDS;
+}
+
+/*
+ * Installs line for an access or a prefetch, a prefetched line it evicts
+ * was never used
+ */
+static APEX_Cache_Line*
+fill(APEX_Prefetch* prefetch, int line)
+{
+  APEX_Cache_Line victim;
+  APEX_Cache_Line* filled =
+    APEX_cache_fill(prefetch->cache, line, LINE_E, &victim);
+  int i = line_index(prefetch, filled);
+
+  if (victim.state != LINE_I && prefetch->prefetched[i]) {
+    prefetch->stats.evicted++;
+  }
+  prefetch->prefetched[i] = 0;
+  return filled;
+}
+
+static void
+prefetch_line(APEX_Prefetch* prefetch, int line, long now)
+{
+  if (!line_in_memory(prefetch, line) ||
+      APEX_cache_lookup(prefetch->cache, line)) {
+    return;
+  }
+  int i = line_index(prefetch, fill(prefetch, line));
+  prefetch->prefetched[i] = 1;
+  prefetch->ready[i] = now + prefetch->miss_latency;
+  prefetch->stats.issued++;
+}
+
+static void
+stream_push(APEX_Prefetch* prefetch, Prefetch_Stream* stream, long now)
+{
+  if (!line_in_memory(prefetch, stream->next)) {
+    return;
+  }
+  int tail = (stream->head + stream->count) % PREFETCH_MAX_DEGREE;
+  stream->lines[tail] = stream->next++;
+  stream->ready[tail] = now + prefetch->miss_latency;
+  stream->count++;
+  prefetch->stats.issued++;
+}
+
+/* Restarts the least recently used stream buffer after line */
+static void
+stream_allocate(APEX_Prefetch* prefetch, int line, long now)
+{
+  Prefetch_Stream* stream = &prefetch->stream[0];
+  for (int b = 1; b < PREFETCH_STREAMS; ++b) {
+    if (prefetch->stream[b].last_use < stream->last_use) {
+      stream = &prefetch->stream[b];
+    }
+  }
+  prefetch->stats.evicted += stream->count;
+  stream->head = 0;
+  stream->count = 0;
+  stream->next = line + 1;
+  stream->last_use = ++prefetch->tick;
+  for (int k = 0; k < prefetch->degree; ++k) {
+    stream_push(prefetch, stream, now);
+  }
+}
+
+/* Stream buffer whose head is line, NULL if none */
+static Prefetch_Stream*
+stream_head(APEX_Prefetch* prefetch, int line)
+{
+  for (int b = 0; b < PREFETCH_STREAMS; ++b) {
+    Prefetch_Stream* stream = &prefetch->stream[b];
+    if (stream->count && stream->lines[stream->head] == line) {
+      return stream;
+    }
+  }
+  return NULL;
+}
+
+static void
+train_stride(APEX_Prefetch* prefetch, int pc, int address, long now)
+{
+  Prefetch_Stride* entry =
+    &prefetch->stride[(pc / 4) % PREFETCH_STRIDE_ENTRIES];
+
+  if (entry->pc != pc) {
+    entry->pc = pc;
+    entry->address = address;
+    entry->stride = 0;
+    entry->confidence = 0;
+    return;
+  }
+  int stride = address - entry->address;
+  entry->address = address;
+  if (stride == entry->stride) {
+    if (entry->confidence < 3) {
+      entry->confidence++;
+    }
+  } else if (entry->confidence) {
+    entry->confidence--;
+  } else {
+    entry->stride = stride;
+  }
+  if (!entry->stride || entry->confidence < 2) {
+    return;
+  }
+
+  int line = APEX_cache_line_address(prefetch->cache, address);
+  for (int k = 1; k <= prefetch->degree; ++k) {
+    long target = address + (long)k * entry->stride;
+    if (target < 0 || target >= DATA_WORDS) {
+      break;
+    }
+    int target_line = APEX_cache_line_address(prefetch->cache, target);
+    if (target_line != line) {
+      prefetch_line(prefetch, target_line, now);
+    }
+  }
+}
+
+/*
+ * Called by the last execute stage once the address of a LOAD or STORE is
+ * known
+ */
+void
+APEX_prefetch_observe(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Prefetch* prefetch = cpu->prefetch;
+  int address = stage->mem_address;
+  long now = cpu->clock;
+
+  if (address < 0 || address >= DATA_WORDS) {
+    return;
+  }
+  int line = APEX_cache_line_address(prefetch->cache, address);
+  APEX_Cache_Line* cached = APEX_cache_lookup(prefetch->cache, line);
+
+  switch (prefetch->kind) {
+    case PREFETCH_NEXT_LINE:
+      /* Tagged, on a miss or the first use of a prefetched line */
+      if (!cached || prefetch->prefetched[line_index(prefetch, cached)]) {
+        for (int k = 1; k <= prefetch->degree; ++k) {
+          prefetch_line(prefetch, line + k, now);
+        }
+      }
+      break;
+    case PREFETCH_STRIDE:
+      train_stride(prefetch, stage->pc, address, now);
+      break;
+    case PREFETCH_STREAM:
+      if (!cached && !stream_head(prefetch, line)) {
+        stream_allocate(prefetch, line, now);
+      }
+      break;
+  }
+}
+
+/* An access uses a prefetched line arriving at ready, returns the wait */
+static int
+use_prefetch(APEX_Prefetch* prefetch, long ready, long now)
+{
+  prefetch->stats.useful++;
+  if (ready <= now) {
+    return 0;
+  }
+  prefetch->stats.late++;
+  prefetch->stats.late_cycles += ready - now;
+  return ready - now;
+}
+
+/*
+ * Called by the last memory stage for a LOAD or STORE
+ */
+int
+APEX_prefetch_access(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Prefetch* prefetch = cpu->prefetch;
+  int address = stage->mem_address;
+  long now = cpu->clock;
+  int stall = 0;
+
+  if ((strcmp(stage->opcode, "LOAD") != 0 &&
+       strcmp(stage->opcode, "STORE") != 0) ||
+      address < 0 || address >= DATA_WORDS) {
+    return 0;
+  }
+  prefetch->stats.accesses++;
+
+  int line = APEX_cache_line_address(prefetch->cache, address);
+  APEX_Cache_Line* cached = APEX_cache_lookup(prefetch->cache, line);
+  if (cached) {
+    int i = line_index(prefetch, cached);
+    APEX_cache_touch(prefetch->cache, cached);
+    if (prefetch->prefetched[i]) {
+      prefetch->prefetched[i] = 0;
+      stall = use_prefetch(prefetch, prefetch->ready[i], now);
+    }
+  } else {
+    /* A miss takes the line from the head of a stream buffer if it is
+     * there, the buffer then fetches one more
+     */
+    Prefetch_Stream* stream = stream_head(prefetch, line);
+    if (stream) {
+      stall = use_prefetch(prefetch, stream->ready[stream->head], now);
+      stream->head = (stream->head + 1) % PREFETCH_MAX_DEGREE;
+      stream->count--;
+      stream->last_use = ++prefetch->tick;
+      stream_push(prefetch, stream, now);
+    } else {
+      prefetch->stats.misses++;
+      stall = prefetch->miss_latency;
+    }
+    fill(prefetch, line);
+  }
+  prefetch->stats.stall_cycles += stall;
+  return stall;
+}
+
+void
+APEX_prefetch_report(APEX_Prefetch* prefetch, FILE* out)
+{
+  Prefetch_Stats* stats = &prefetch->stats;
+  APEX_Cache* cache = prefetch->cache;
+
+  fprintf(out,
+          "APEX_PREFETCH : cache %d sets x %d ways x %d words, miss %d "
+          "cycles, %s prefetcher, degree %d\n",
+          cache->sets, cache->ways, cache->line_words, prefetch->miss_latency,
+          kinds[prefetch->kind], prefetch->degree);
+  fprintf(out,
+          "APEX_PREFETCH : %ld accesses, %ld misses (%.2f%%), %ld stall "
+          "cycles\n",
+          stats->accesses, stats->misses,
+          stats->accesses ? 100.0 * stats->misses / stats->accesses : 0.0,
+          stats->stall_cycles);
+  if (prefetch->kind == PREFETCH_NONE) {
+    return;
+  }
+  fprintf(out,
+          "APEX_PREFETCH : %ld prefetches, %ld used: accuracy %.2f%%, "
+          "coverage %.2f%%, timeliness %.2f%% (%ld late by %.1f cycles on "
+          "average), %ld evicted unused\n",
+          stats->issued, stats->useful,
+          stats->issued ? 100.0 * stats->useful / stats->issued : 0.0,
+          stats->useful + stats->misses
+            ? 100.0 * stats->useful / (stats->useful + stats->misses)
+            : 0.0,
+          stats->useful ? 100.0 * (stats->useful - stats->late) / stats->useful
+                        : 0.0,
+          stats->late,
+          stats->late ? (double)stats->late_cycles / stats->late : 0.0,
+          stats->evicted);
+}
+
+void
+APEX_prefetch_free(APEX_Prefetch* prefetch)
+{
+  if (prefetch) {
+    APEX_cache_free(prefetch->cache);
+    free(prefetch->prefetched);
+    free(prefetch->ready);
+    free(prefetch);
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+/**
+ *  prefetch.h
+ *  Contains the data cache of a single cpu and its hardware prefetchers.
+ *
+ *  The cache keeps tags only (see cache.h), data lives in data memory. A
+ *  LOAD or STORE which misses holds the pipeline in the last memory stage
+ *  for the miss latency, stores allocate their line and there is no store
+ *  buffer (that is the load/store queue, which does not work with the
+ *  cache). The prefetcher sees the address of every LOAD and STORE once the last
+ *  execute stage computed it:
+ *    next-line  fetches the lines after one missing or first used
+ *               after its prefetch
+ *    stride     fetches ahead along the stride of the same pc, once it
+ *               repeated
+ *    stream     fills a stream buffer with the lines after one missing,
+ *               a miss on the head of a buffer takes the line from it
+ *  Prefetched lines arrive the miss latency after they were issued, an
+ *  access using one earlier waits for the rest.
+ *
+ *  Accuracy is the share of prefetched lines used before they were
+ *  evicted or dropped, coverage the share of misses a prefetch saved and
+ *  timeliness the share of used prefetches which arrived in time.
+ */
+#include <stdio.h>
+
+#include "cache.h"
+#include "cpu.h"
+
+#define PREFETCH_STRIDE_ENTRIES 64
+#define PREFETCH_STREAMS 4
+#define PREFETCH_MAX_DEGREE 8
+
+enum
+{
+  PREFETCH_NONE,
+  PREFETCH_NEXT_LINE,
+  PREFETCH_STRIDE,
+  PREFETCH_STREAM
+};
+
+/* Last address and stride of the LOADs and STOREs of one pc */
+typedef struct Prefetch_Stride
+{
+  int pc;
+  int address;
+  int stride;
+  int confidence;     // 2 bit counter, prefetches from 2 on
+} Prefetch_Stride;
+
+/* FIFO of lines prefetched after a miss */
+typedef struct Prefetch_Stream
+{
+  int lines[PREFETCH_MAX_DEGREE];
+  long ready[PREFETCH_MAX_DEGREE];
+  int head;
+  int count;
+  int next;           // Line to prefetch when the head is taken
+  unsigned long last_use;
+} Prefetch_Stream;
+
+typedef struct Prefetch_Stats
+{
+  long accesses;
+  long misses;            // Demand misses left
+  long stall_cycles;
+  long issued;
+  long useful;            // Prefetched lines used by an access
+  long late;              // Of them, not there yet
+  long late_cycles;
+  long evicted;           // Prefetched lines evicted or dropped unused
+} Prefetch_Stats;
+
+typedef struct APEX_Prefetch
+{
+  APEX_Cache* cache;
+  int miss_latency;
+  int kind;
+  int degree;             // Lines fetched ahead, depth of stream buffers
+
+  /* Per cache line: prefetched and not used yet, cycle it arrives */
+  unsigned char* prefetched;
+  long* ready;
+
+  Prefetch_Stride stride[PREFETCH_STRIDE_ENTRIES];
+  Prefetch_Stream stream[PREFETCH_STREAMS];
+  unsigned long tick;
+
+  Prefetch_Stats stats;
+} APEX_Prefetch;
+
+APEX_Prefetch*
+APEX_prefetch_init(void);
+
+/* Replaces the cache by an empty one of the geometry sets:ways:words */
+int
+APEX_prefetch_set_cache(APEX_Prefetch* prefetch, const char* geometry);
+
+int
+APEX_prefetch_set_kind(APEX_Prefetch* prefetch, const char* name);
+
+/* Trains the prefetcher on the address of a LOAD or STORE in stage */
+void
+APEX_prefetch_observe(APEX_CPU* cpu, CPU_Stage* stage);
+
+/* Accesses the cache for the LOAD or STORE in stage, returns the cycles
+ * the pipeline has to wait
+ */
+int
+APEX_prefetch_access(APEX_CPU* cpu, CPU_Stage* stage);
+
+void
+APEX_prefetch_report(APEX_Prefetch* prefetch, FILE* out);
+
+void
+APEX_prefetch_free(APEX_Prefetch* prefetch);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ *  profile.c
+ *  Contains the self-profiler of the simulator
+ */
+#include <stdlib.h>
+
+#include "profile.h"
+
+#if APEX_SELF_PROFILE
+
+static const char* phase_names[NUM_PROFILE_PHASES] = { "parse", "setup",
+                                                       "step", "output" };
+
+static const struct
+{
+  APEX_Stage_Function function;
+  const char* name;
+} functions[] = {
+  { APEX_fetch, "fetch" },
+  { APEX_decode, "decode" },
+  { APEX_execute1, "execute1" },
+  { APEX_execute2, "execute2" },
+  { APEX_memory1, "memory1" },
+  { APEX_memory2, "memory2" },
+  { APEX_writeback, "writeback" },
+  { APEX_pass_through, "pass_through" },
+};
+
+#define NUM_FUNCTIONS (int)(sizeof(functions) / sizeof(functions[0]))
+
+APEX_Profile*
+APEX_profile_init(void)
+{
+  APEX_Profile* profile = calloc(1, sizeof(*profile));
+  if (!profile) {
+    return NULL;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &profile->start_time);
+  profile->start_ticks = APEX_profile_ticks();
+  return profile;
+}
+
+static const char*
+function_name(APEX_Stage_Function function)
+{
+  for (int i = 0; i < NUM_FUNCTIONS; ++i) {
+    if (functions[i].function == function) {
+      return functions[i].name;
+    }
+  }
+  return "?";
+}
+
+static void
+print_line(FILE* out, const char* name, const char* function,
+           unsigned long long ticks, long cycles, unsigned long long total)
+{
+  fprintf(out,
+          "APEX_PROFILE : %-15s %-12s %14llu ticks %10.1f per cycle "
+          "(%5.1f%%)\n",
+          name, function, ticks, cycles ? (double)ticks / cycles : 0.0,
+          total ? 100.0 * ticks / total : 0.0);
+}
+
+void
+APEX_profile_report(APEX_Profile* profile, APEX_CPU* cpu, FILE* out)
+{
+  struct timespec now;
+  unsigned long long total = 0;
+  long cycles = profile->cycles;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double ns = (now.tv_sec - profile->start_time.tv_sec) * 1e9 +
+              (now.tv_nsec - profile->start_time.tv_nsec);
+  double rate = ns > 0 ? (APEX_profile_ticks() - profile->start_ticks) / ns
+                       : 0.0;
+
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    total += profile->stage[s];
+  }
+  for (int p = 0; p < NUM_PROFILE_PHASES; ++p) {
+    total += profile->phase[p];
+  }
+
+  fprintf(out,
+          "APEX_PROFILE : %ld cycles stepped, %llu host ticks (%.3f ms at "
+          "%.2f ticks per ns), %.1f ticks per cycle\n",
+          cycles, total, rate > 0 ? total / rate / 1e6 : 0.0, rate,
+          cycles ? (double)total / cycles : 0.0);
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    print_line(out, cpu->pipeline[s].name,
+               function_name(cpu->pipeline[s].function), profile->stage[s],
+               cycles, total);
+  }
+  for (int p = 0; p < NUM_PROFILE_PHASES; ++p) {
+    print_line(out, phase_names[p], "", profile->phase[p], cycles, total);
+  }
+}
+
+#endif
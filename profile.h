@@ -0,0 +1,69 @@
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+/**
+ *  profile.h
+ *  Contains the self-profiler of the simulator.
+ *
+ *  With --self-profile every stage function call is timed with the time
+ *  stamp counter, printing excluded, and the host cycles per simulated
+ *  cycle of every stage are reported at exit together with the time spent
+ *  parsing the program, in fast-forward and analysis, and printing. Build
+ *  with APEX_SELF_PROFILE=0 (make SELF_PROFILE=0) to compile all of it
+ *  out of the simulator.
+ */
+#ifndef APEX_SELF_PROFILE
+#define APEX_SELF_PROFILE 1
+#endif
+
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "cpu.h"
+
+/* Time outside the pipeline stages */
+enum
+{
+  PROFILE_PARSE,        // Reading the program
+  PROFILE_SETUP,        // Static analysis and fast-forward
+  PROFILE_STEP,         // APEX_cpu_step beyond its stage functions
+  PROFILE_OUTPUT,       // Printing code memory, stage contents and state
+  NUM_PROFILE_PHASES
+};
+
+typedef struct APEX_Profile
+{
+  unsigned long long stage[APEX_MAX_STAGES];
+  unsigned long long phase[NUM_PROFILE_PHASES];
+  unsigned long long staged;    // Sum of stage[]
+  unsigned long long stepping;  // Total inside APEX_cpu_step
+  long cycles;                  // Simulated cycles stepped
+
+  /* Time stamp counter rate, from the wall clock over the whole run */
+  unsigned long long start_ticks;
+  struct timespec start_time;
+} APEX_Profile;
+
+/* Host time stamp, the time stamp counter where there is one */
+static inline unsigned long long
+APEX_profile_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+APEX_Profile*
+APEX_profile_init(void);
+
+void
+APEX_profile_report(APEX_Profile* profile, APEX_CPU* cpu, FILE* out);
+
+#endif
@@ -0,0 +1,443 @@
+/*
+ *  replay.c
+ *  Contains record and replay of simulation runs
+ *
+ *  A recording starts with a header and holds tagged records:
+ *    'H' cycle hash             hash of the state once cycle was simulated
+ *    'C' cycle size state       checkpoint of the cpu at cycle
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "smt.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* Layout of the cpu in the build which wrote the recording, a checkpoint
+ * is only restored by the same layout
+ */
+typedef struct Replay_Header
+{
+  char magic[8];
+  int cpu_size;
+  int stage_size;
+  long interval;
+  long checkpoint_interval;
+} Replay_Header;
+
+APEX_Replay*
+APEX_replay_init(void)
+{
+  APEX_Replay* replay = calloc(1, sizeof(*replay));
+  if (!replay) {
+    return NULL;
+  }
+  replay->interval = 1000;
+  replay->checkpoint_interval = 100000;
+  replay->trace_from = -1;
+  return replay;
+}
+
+int
+APEX_replay_set_record(APEX_Replay* replay, const char* path)
+{
+  if (replay->record) {
+    fclose(replay->record);
+    free(replay->record_path);
+  }
+  replay->record_path = strdup(path);
+  replay->record = fopen(path, "wb");
+  if (!replay->record) {
+    fprintf(stderr, "APEX_Error : Unable to open recording %s\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+int
+APEX_replay_set_restore(APEX_Replay* replay, const char* spec)
+{
+  const char* colon = strrchr(spec, ':');
+  char* end;
+
+  if (!colon || colon == spec) {
+    return -1;
+  }
+  long cycle = strtol(colon + 1, &end, 10);
+  if (end == colon + 1 || *end || cycle < 0) {
+    return -1;
+  }
+  free(replay->restore_path);
+  replay->restore_path = strndup(spec, colon - spec);
+  replay->restore_cycle = cycle;
+  return 0;
+}
+
+static unsigned long long
+hash_ints(unsigned long long hash, const int* values, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    hash ^= (unsigned)values[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+/*
+ * FNV-1a of the architectural state, the same in every build which
+ * simulates the same way whatever its latches look like
+ */
+unsigned long long
+APEX_replay_hash(APEX_CPU* cpu)
+{
+  unsigned long long hash = FNV_OFFSET;
+
+  hash = hash_ints(hash, &cpu->pc, 1);
+  hash = hash_ints(hash, cpu->regs, 32);
+  hash = hash_ints(hash, cpu->data_memory, 4096);
+  hash = hash_ints(hash, &cpu->ins_completed, 1);
+  if (cpu->smt) {
+    for (int t = 1; t < cpu->smt->num_threads; ++t) {
+      hash = hash_ints(hash, &cpu->smt->context[t].pc, 1);
+      hash = hash_ints(hash, cpu->smt->context[t].regs, 32);
+    }
+  }
+  return hash;
+}
+
+/* The models which keep timing state outside the cpu */
+static int
+checkpoints_cover(APEX_CPU* cpu)
+{
+  return !cpu->lsq && !cpu->prefetch && !cpu->vpred && !cpu->mem_handler;
+}
+
+static int
+num_threads(APEX_CPU* cpu)
+{
+  return cpu->smt ? cpu->smt->num_threads : 1;
+}
+
+static long
+checkpoint_size(APEX_CPU* cpu)
+{
+  /* Shape, clock, stalled cycles and pc first */
+  long size = 2 * sizeof(int) + 3 * sizeof(int) + sizeof(cpu->regs) +
+              sizeof(cpu->regs_valid) +
+              cpu->num_stages * (sizeof(CPU_Stage) + sizeof(int)) +
+              sizeof(cpu->data_memory) + 2 * sizeof(int) + sizeof(long);
+  if (cpu->smt) {
+    size += sizeof(APEX_SMT);
+  }
+  return size;
+}
+
+/*
+ * Copies the state of the cpu to or from fp, write selects the direction
+ */
+static int
+transfer_state(APEX_CPU* cpu, FILE* fp, int write)
+{
+#define FIELD(ptr, size)                                                      \
+  if ((write ? fwrite((ptr), (size), 1, fp) : fread((ptr), (size), 1, fp)) != \
+      1) {                                                                    \
+    return -1;                                                                \
+  }
+  FIELD(&cpu->clock, sizeof(cpu->clock));
+  FIELD(&cpu->clock_stalled_cycles, sizeof(cpu->clock_stalled_cycles));
+  FIELD(&cpu->pc, sizeof(cpu->pc));
+  FIELD(cpu->regs, sizeof(cpu->regs));
+  FIELD(cpu->regs_valid, sizeof(cpu->regs_valid));
+  FIELD(cpu->stage, cpu->num_stages * sizeof(CPU_Stage));
+  FIELD(cpu->stage_wait, cpu->num_stages * sizeof(int));
+  FIELD(cpu->data_memory, sizeof(cpu->data_memory));
+  FIELD(&cpu->ins_completed, sizeof(cpu->ins_completed));
+  FIELD(&cpu->freeze_cycles, sizeof(cpu->freeze_cycles));
+  FIELD(&cpu->bad_accesses, sizeof(cpu->bad_accesses));
+  if (cpu->smt) {
+    FIELD(cpu->smt, sizeof(APEX_SMT));
+  }
+#undef FIELD
+  return 0;
+}
+
+static void
+write_hash(APEX_Replay* replay, APEX_CPU* cpu)
+{
+  long cycle = cpu->clock;
+  unsigned long long hash = APEX_replay_hash(cpu);
+
+  fputc('H', replay->record);
+  fwrite(&cycle, sizeof(cycle), 1, replay->record);
+  fwrite(&hash, sizeof(hash), 1, replay->record);
+  replay->hashes++;
+}
+
+static void
+write_checkpoint(APEX_Replay* replay, APEX_CPU* cpu)
+{
+  long cycle = cpu->clock;
+  long size = checkpoint_size(cpu);
+  int shape[2] = { cpu->num_stages, num_threads(cpu) };
+
+  fputc('C', replay->record);
+  fwrite(&cycle, sizeof(cycle), 1, replay->record);
+  fwrite(&size, sizeof(size), 1, replay->record);
+  fwrite(shape, sizeof(shape), 1, replay->record);
+  transfer_state(cpu, replay->record, 1);
+  replay->checkpoints++;
+}
+
+/*
+ * Reads the next record of fp, the state of a checkpoint is skipped and
+ * its offset left in *offset. Returns 1 at the end of the recording.
+ */
+static int
+next_record(FILE* fp, int* tag, long* cycle, unsigned long long* hash,
+            long* offset)
+{
+  long size;
+
+  *tag = fgetc(fp);
+  if (*tag == EOF) {
+    return 1;
+  }
+  if (fread(cycle, sizeof(*cycle), 1, fp) != 1) {
+    return -1;
+  }
+  if (*tag == 'H') {
+    return fread(hash, sizeof(*hash), 1, fp) == 1 ? 0 : -1;
+  }
+  if (*tag == 'C' && fread(&size, sizeof(size), 1, fp) == 1) {
+    *offset = ftell(fp);
+    return fseek(fp, size, SEEK_CUR) ? -1 : 0;
+  }
+  return -1;
+}
+
+static FILE*
+open_recording(const char* path, Replay_Header* header)
+{
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open recording %s\n", path);
+    return NULL;
+  }
+  if (fread(header, sizeof(*header), 1, fp) != 1 ||
+      memcmp(header->magic, REPLAY_MAGIC, sizeof(header->magic))) {
+    fprintf(stderr, "APEX_Error : %s is not a recording\n", path);
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+/*
+ * Loads the last checkpoint at or before the restore cycle
+ */
+static int
+restore(APEX_CPU* cpu, APEX_Replay* replay)
+{
+  Replay_Header header;
+  int tag;
+  long cycle;
+  unsigned long long hash;
+  long offset = -1;
+  long found = -1;
+  long found_cycle = 0;
+  int status;
+
+  if (!checkpoints_cover(cpu)) {
+    fprintf(stderr,
+            "APEX_Error : Checkpoints do not cover the load/store queue, the "
+            "data cache, the predictors or external memory\n");
+    return -1;
+  }
+  FILE* fp = open_recording(replay->restore_path, &header);
+  if (!fp) {
+    return -1;
+  }
+  if (header.cpu_size != (int)sizeof(APEX_CPU) ||
+      header.stage_size != (int)sizeof(CPU_Stage)) {
+    fprintf(stderr, "APEX_Error : %s was recorded by a different build\n",
+            replay->restore_path);
+    fclose(fp);
+    return -1;
+  }
+  while (!(status = next_record(fp, &tag, &cycle, &hash, &offset))) {
+    if (tag == 'C' && cycle <= replay->restore_cycle) {
+      found = offset;
+      found_cycle = cycle;
+    }
+  }
+  if (status < 0 || found < 0) {
+    fprintf(stderr, "APEX_Error : No checkpoint at or before cycle %ld in %s\n",
+            replay->restore_cycle, replay->restore_path);
+    fclose(fp);
+    return -1;
+  }
+
+  int shape[2];
+  if (fseek(fp, found, SEEK_SET) || fread(shape, sizeof(shape), 1, fp) != 1 ||
+      shape[0] != cpu->num_stages || shape[1] != num_threads(cpu)) {
+    fprintf(stderr,
+            "APEX_Error : Checkpoint at cycle %ld of %s has another pipeline "
+            "or number of threads\n",
+            found_cycle, replay->restore_path);
+    fclose(fp);
+    return -1;
+  }
+  status = transfer_state(cpu, fp, 0);
+  fclose(fp);
+  if (status) {
+    fprintf(stderr, "APEX_Error : Truncated checkpoint in %s\n",
+            replay->restore_path);
+    return -1;
+  }
+  return 0;
+}
+
+int
+APEX_replay_start(APEX_CPU* cpu)
+{
+  APEX_Replay* replay = cpu->replay;
+
+  if (replay->started) {
+    return replay->failed ? -1 : 0;
+  }
+  replay->started = 1;
+  if (replay->restore_path && restore(cpu, replay)) {
+    replay->failed = 1;
+    /* Not restored, a recording would not match its cycles */
+    if (replay->record) {
+      fclose(replay->record);
+      replay->record = NULL;
+    }
+    return -1;
+  }
+  if (replay->trace_from >= 0) {
+    cpu->debug_messages = cpu->clock >= replay->trace_from;
+    cpu->variant = NULL;
+  }
+  if (!replay->record) {
+    return 0;
+  }
+
+  if (replay->checkpoint_interval && !checkpoints_cover(cpu)) {
+    fprintf(stderr,
+            "APEX_REPLAY : No checkpoints with the load/store queue, the data "
+            "cache, the predictors or external memory\n");
+    replay->checkpoint_interval = 0;
+  }
+  Replay_Header header = { .cpu_size = sizeof(APEX_CPU),
+                           .stage_size = sizeof(CPU_Stage),
+                           .interval = replay->interval,
+                           .checkpoint_interval =
+                             replay->checkpoint_interval };
+  memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+  fwrite(&header, sizeof(header), 1, replay->record);
+
+  long first = replay->record_from > cpu->clock ? replay->record_from
+                                               : cpu->clock;
+  replay->next_hash = first - first % replay->interval + replay->interval;
+  if (replay->checkpoint_interval) {
+    write_checkpoint(replay, cpu);
+    replay->next_checkpoint = cpu->clock -
+                              cpu->clock % replay->checkpoint_interval +
+                              replay->checkpoint_interval;
+  }
+  return 0;
+}
+
+void
+APEX_replay_step(APEX_CPU* cpu)
+{
+  APEX_Replay* replay = cpu->replay;
+
+  if (cpu->clock == replay->trace_from) {
+    cpu->debug_messages = 1;
+    cpu->variant = NULL;
+  }
+  if (!replay->record) {
+    return;
+  }
+  if (cpu->clock >= replay->next_hash) {
+    write_hash(replay, cpu);
+    replay->next_hash += replay->interval;
+  }
+  if (replay->checkpoint_interval && cpu->clock >= replay->next_checkpoint) {
+    write_checkpoint(replay, cpu);
+    replay->next_checkpoint += replay->checkpoint_interval;
+  }
+}
+
+void
+APEX_replay_close(APEX_CPU* cpu)
+{
+  APEX_Replay* replay = cpu->replay;
+
+  if (replay->record) {
+    fclose(replay->record);
+    fprintf(stderr,
+            "APEX_REPLAY : %ld hashes and %ld checkpoints recorded in %s\n",
+            replay->hashes, replay->checkpoints, replay->record_path);
+  }
+  free(replay->record_path);
+  free(replay->restore_path);
+  free(replay);
+  cpu->replay = NULL;
+}
+
+int
+APEX_replay_read(const char* path, Replay_Recording* recording)
+{
+  Replay_Header header;
+  int tag;
+  long cycle;
+  unsigned long long hash;
+  long offset;
+  int hashes_size = 0;
+  int checkpoints_size = 0;
+  int status;
+
+  memset(recording, 0, sizeof(*recording));
+  FILE* fp = open_recording(path, &header);
+  if (!fp) {
+    return -1;
+  }
+  while (!(status = next_record(fp, &tag, &cycle, &hash, &offset))) {
+    if (tag == 'H') {
+      if (recording->num_hashes == hashes_size) {
+        hashes_size = hashes_size ? 2 * hashes_size : 1024;
+        recording->hashes = realloc(recording->hashes,
+                                    hashes_size * sizeof(Replay_Hash));
+      }
+      recording->hashes[recording->num_hashes].cycle = cycle;
+      recording->hashes[recording->num_hashes++].hash = hash;
+    } else {
+      if (recording->num_checkpoints == checkpoints_size) {
+        checkpoints_size = checkpoints_size ? 2 * checkpoints_size : 64;
+        recording->checkpoints = realloc(recording->checkpoints,
+                                         checkpoints_size * sizeof(long));
+      }
+      recording->checkpoints[recording->num_checkpoints++] = cycle;
+    }
+  }
+  fclose(fp);
+  if (status < 0) {
+    fprintf(stderr, "APEX_Error : Truncated recording %s\n", path);
+    APEX_replay_free_recording(recording);
+    return -1;
+  }
+  return 0;
+}
+
+void
+APEX_replay_free_recording(Replay_Recording* recording)
+{
+  free(recording->hashes);
+  free(recording->checkpoints);
+  memset(recording, 0, sizeof(*recording));
+}
@@ -0,0 +1,98 @@
+#ifndef _APEX_REPLAY_H_
+#define _APEX_REPLAY_H_
+/**
+ *  replay.h
+ *  Contains record and replay of simulation runs.
+ *
+ *  A recording holds a hash of the architectural state (pc, registers and
+ *  data memory of every thread, instructions retired) every interval
+ *  cycles and a checkpoint of the cpu every checkpoint interval cycles. A
+ *  run restored from a checkpoint continues exactly as the recorded run
+ *  did, so a divergence between two builds is found by comparing their
+ *  hashes and replaying only the window around the first mismatch, with
+ *  stage messages from --trace-from on (see apex_bisect).
+ *
+ *  Checkpoints hold the cpu and its threads but not the load/store queue,
+ *  the data cache or the predictors, which are left out of recordings with
+ *  them on.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define REPLAY_MAGIC "APEXREC1"
+
+typedef struct APEX_Replay
+{
+  /* Recording, NULL when not recording */
+  FILE* record;
+  char* record_path;
+  long interval;              // Cycles between two hashes
+  long checkpoint_interval;   // Cycles between two checkpoints, 0 for none
+  long record_from;           // First cycle to hash
+  long next_hash;
+  long next_checkpoint;
+  long hashes;
+  long checkpoints;
+
+  /* Checkpoint to start from, the last one at or before restore_cycle */
+  char* restore_path;
+  long restore_cycle;
+
+  /* Stage messages from this cycle on, -1 for the setting of the cpu */
+  long trace_from;
+
+  int started;
+  int failed;                 // The checkpoint could not be restored
+} APEX_Replay;
+
+/* Hash of the state at a cycle, as read back from a recording */
+typedef struct Replay_Hash
+{
+  long cycle;
+  unsigned long long hash;
+} Replay_Hash;
+
+typedef struct Replay_Recording
+{
+  Replay_Hash* hashes;
+  int num_hashes;
+  long* checkpoints;          // Cycles of the checkpoints
+  int num_checkpoints;
+} Replay_Recording;
+
+APEX_Replay*
+APEX_replay_init(void);
+
+int
+APEX_replay_set_record(APEX_Replay* replay, const char* path);
+
+/* Parses file:cycle */
+int
+APEX_replay_set_restore(APEX_Replay* replay, const char* spec);
+
+/* Restores the checkpoint and starts recording, before the first cycle.
+ * Called on the first step if not before. Returns -1 if the restore
+ * failed, on every later call too.
+ */
+int
+APEX_replay_start(APEX_CPU* cpu);
+
+/* Records the cycle just simulated if a hash or checkpoint is due */
+void
+APEX_replay_step(APEX_CPU* cpu);
+
+unsigned long long
+APEX_replay_hash(APEX_CPU* cpu);
+
+void
+APEX_replay_close(APEX_CPU* cpu);
+
+/* Reads the hashes and checkpoint cycles of the recording at path */
+int
+APEX_replay_read(const char* path, Replay_Recording* recording);
+
+void
+APEX_replay_free_recording(Replay_Recording* recording);
+
+#endif
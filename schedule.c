@@ -0,0 +1,490 @@
+/*
+ *  schedule.c
+ *  Contains the profile guided instruction scheduler
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "fastforward.h"
+#include "schedule.h"
+#include "vpred.h"
+
+/* Registers and memory accesses of one instruction */
+typedef struct Sched_Node
+{
+  int dest;             // Register written, -1 for none
+  int src[2];           // Registers read, -1 for none
+  int load;
+  int store;
+  int barrier;          // Unknown opcode, nothing moves across it
+} Sched_Node;
+
+static int
+valid_register(int reg)
+{
+  return reg >= 0 && reg < 32;
+}
+
+/*
+ * Fills the registers ins reads and writes as the decode stage sees them,
+ * ADDL also waits for the validity of rs2
+ */
+static void
+operands(const APEX_Instruction* ins, Sched_Node* node)
+{
+  const char* op = ins->opcode;
+
+  memset(node, 0, sizeof(*node));
+  node->dest = -1;
+  node->src[0] = -1;
+  node->src[1] = -1;
+
+  if (!strcmp(op, "MOVC")) {
+    node->dest = ins->rd;
+  } else if (!strcmp(op, "ADDL") || !strcmp(op, "SUB")) {
+    node->dest = ins->rd;
+    node->src[0] = ins->rs1;
+    node->src[1] = ins->rs2;
+  } else if (!strcmp(op, "LOAD")) {
+    node->dest = ins->rd;
+    node->src[0] = ins->rs1;
+    node->load = 1;
+  } else if (!strcmp(op, "STORE")) {
+    node->src[0] = ins->rs1;
+    node->src[1] = ins->rs2;
+    node->store = 1;
+  } else if (!strcmp(op, "JUMP")) {
+    node->src[0] = ins->rs1;
+  } else {
+    node->barrier = 1;
+  }
+
+  if ((node->dest >= 0 && !valid_register(node->dest)) ||
+      (node->src[0] >= 0 && !valid_register(node->src[0])) ||
+      (node->src[1] >= 0 && !valid_register(node->src[1]))) {
+    node->barrier = 1;
+  }
+}
+
+APEX_Sched*
+APEX_sched_init(void)
+{
+  APEX_Sched* sched = calloc(1, sizeof(*sched));
+  if (!sched) {
+    return NULL;
+  }
+  sched->max_cycles = 10000000;
+  return sched;
+}
+
+/* Cycles between the decode of a producer and its writeback */
+static int
+decode_to_writeback(APEX_CPU* cpu)
+{
+  int latency = 0;
+  int decode = -1;
+
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    if (cpu->pipeline[s].kind == STAGE_DECODE) {
+      decode = s;
+    }
+  }
+  for (int s = decode; s >= 0 && s < cpu->num_stages; ++s) {
+    if (cpu->pipeline[s].kind == STAGE_WRITEBACK) {
+      break;
+    }
+    latency += cpu->pipeline[s].latency;
+  }
+  return latency;
+}
+
+/*
+ * Simulates code with the options of sched until the pipeline drains,
+ * counting decode stall cycles per instruction into profile if not NULL
+ */
+int
+APEX_sched_simulate(APEX_Sched* sched, APEX_Instruction* code,
+                    long* profile, Sched_Run* run)
+{
+  APEX_CPU* cpu = APEX_cpu_init_shared(code, sched->size);
+
+  memset(run, 0, sizeof(*run));
+  if (!cpu) {
+    run->status = SCHED_FAILED;
+    return -1;
+  }
+  memcpy(cpu->data_memory, sched->data, sizeof(int) * sched->data_size);
+  cpu->debug_messages = 0;
+  cpu->stall_profile = profile;
+
+  for (int i = 0; i < sched->num_options; ++i) {
+    if (APEX_cpu_set_option(cpu, sched->option_names[i],
+                            sched->option_values[i])) {
+      fprintf(stderr, "APEX_Error : Invalid option --%s=%s\n",
+              sched->option_names[i], sched->option_values[i]);
+      run->status = SCHED_FAILED;
+    }
+  }
+  sched->latency = decode_to_writeback(cpu);
+
+  while (run->status == SCHED_OK && !APEX_cpu_drained(cpu)) {
+    if (cpu->clock >= sched->max_cycles) {
+      run->status = SCHED_TIMEOUT;
+      break;
+    }
+    if (APEX_cpu_step(cpu)) {
+      run->status = SCHED_FAILED;
+    }
+  }
+
+  run->cycles = cpu->clock;
+  run->stall_cycles = cpu->clock_stalled_cycles;
+  if (cpu->vpred) {
+    run->stall_cycles += cpu->vpred->interlock_cycles;
+  }
+  memcpy(run->regs, cpu->regs, sizeof(run->regs));
+  memcpy(run->data_memory, cpu->data_memory, sizeof(run->data_memory));
+  cpu->stall_profile = NULL;
+  APEX_cpu_stop(cpu);
+  return run->status == SCHED_OK ? 0 : -1;
+}
+
+/*
+ * Executes code in program order with the fast-forward interpreter
+ */
+int
+APEX_sched_execute(APEX_Sched* sched, APEX_Instruction* code,
+                   Sched_Run* run)
+{
+  FF_Engine* engine = APEX_ff_engine_init(code, sched->size, FF_INTERPRET);
+  FF_State* state = calloc(1, sizeof(*state));
+
+  memset(run, 0, sizeof(*run));
+  if (state) {
+    state->pc = 4000;
+    memcpy(state->data_memory, sched->data, sizeof(int) * sched->data_size);
+  }
+  if (!engine || !state || APEX_ff_run(engine, state, sched->max_cycles)) {
+    run->status = SCHED_FAILED;
+  } else if (state->pc >= 4000 && state->pc < 4000 + 4 * sched->size) {
+    run->status = SCHED_TIMEOUT;
+  } else {
+    run->cycles = state->instructions;
+    memcpy(run->regs, state->regs, sizeof(run->regs));
+    memcpy(run->data_memory, state->data_memory, sizeof(run->data_memory));
+  }
+  APEX_ff_engine_free(engine);
+  free(state);
+  return run->status == SCHED_OK ? 0 : -1;
+}
+
+static int
+same_state(const Sched_Run* a, const Sched_Run* b)
+{
+  return !memcmp(a->regs, b->regs, sizeof(a->regs)) &&
+         !memcmp(a->data_memory, b->data_memory, sizeof(a->data_memory));
+}
+
+/*
+ * Simulates the rescheduled program into sched->after, returns 0 if it
+ * computes what the original does
+ */
+int
+APEX_sched_verify(APEX_Sched* sched)
+{
+  Sched_Run executed;
+
+  if (APEX_sched_execute(sched, sched->scheduled, &executed) ||
+      !same_state(&executed, &sched->reference)) {
+    fprintf(stderr, "APEX_SCHED : rescheduled program computes different "
+                    "registers or memory in program order\n");
+    return -1;
+  }
+  if (APEX_sched_simulate(sched, sched->scheduled, NULL, &sched->after)) {
+    return -1;
+  }
+  if (same_state(&sched->after, &sched->before)) {
+    return 0;
+  }
+  if (same_state(&sched->after, &sched->reference)) {
+    fprintf(stderr, "APEX_SCHED : original simulation read stale registers, "
+                    "the rescheduled one matches program order\n");
+    return 0;
+  }
+  fprintf(stderr, "APEX_SCHED : rescheduled simulation ends with different "
+                  "registers or memory\n");
+  return -1;
+}
+
+/*
+ * Marks the first instruction of every block in leader: the instruction
+ * after a JUMP, jump targets and both sides of unknown opcodes. Returns -1
+ * if a jump target is not a constant.
+ */
+static int
+find_blocks(APEX_Sched* sched, const Sched_Node* nodes, char* leader)
+{
+  leader[0] = 1;
+  for (int i = 0; i < sched->size; ++i) {
+    const APEX_Instruction* ins = &sched->code[i];
+
+    if (nodes[i].barrier) {
+      leader[i] = 1;
+      if (i + 1 < sched->size) {
+        leader[i + 1] = 1;
+      }
+      continue;
+    }
+    if (strcmp(ins->opcode, "JUMP")) {
+      continue;
+    }
+    if (i + 1 < sched->size) {
+      leader[i + 1] = 1;
+    }
+
+    /* The target is the last value written to rs1 plus the literal,
+     * registers start at 0
+     */
+    int base = 0;
+    for (int p = i - 1; p >= 0; --p) {
+      if (nodes[p].dest == ins->rs1) {
+        if (strcmp(sched->code[p].opcode, "MOVC")) {
+          return -1;
+        }
+        base = sched->code[p].imm;
+        break;
+      }
+    }
+    int target = base + ins->imm;
+    if (target % 4 == 0 && target >= 4000 &&
+        target < 4000 + 4 * sched->size) {
+      leader[(target - 4000) / 4] = 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Latency of the dependence of instruction j on instruction i, both in
+ * the same block with i first, 0 for none
+ */
+static int
+dependence(APEX_Sched* sched, const Sched_Node* nodes, int i, int j,
+           const char* stalled)
+{
+  const Sched_Node* a = &nodes[i];
+  const Sched_Node* b = &nodes[j];
+
+  if (a->dest >= 0 && (b->src[0] == a->dest || b->src[1] == a->dest)) {
+    /* Consumers which waited in the profile wait for the writeback, JUMP
+     * reads the register file without an interlock
+     */
+    return stalled[j] || !strcmp(sched->code[j].opcode, "JUMP")
+             ? sched->latency
+             : 1;
+  }
+  if ((b->dest >= 0 && (a->src[0] == b->dest || a->src[1] == b->dest)) ||
+      (a->dest >= 0 && a->dest == b->dest)) {
+    return 1;
+  }
+  if ((a->store && (b->load || b->store)) || (a->load && b->store)) {
+    return 1;
+  }
+  /* The JUMP ends its block */
+  if (!strcmp(sched->code[j].opcode, "JUMP")) {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * List schedules the block [first, last] into sched->scheduled. An
+ * instruction is ready when all instructions it depends on are placed, the
+ * one which issues earliest wins, then the one with the longest path to
+ * the end of the block, then the one first in program order.
+ */
+static int
+schedule_block(APEX_Sched* sched, const Sched_Node* nodes, int first,
+               int last, const char* stalled)
+{
+  int n = last - first + 1;
+  int* latency = calloc((size_t)n * n, sizeof(int));
+  int* height = calloc(n, sizeof(int));
+  long* slot = malloc(n * sizeof(long));
+  int moved = 0;
+
+  if (!latency || !height || !slot) {
+    free(latency);
+    free(height);
+    free(slot);
+    return -1;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    slot[i] = -1;
+    for (int j = i + 1; j < n; ++j) {
+      latency[i * n + j] =
+        dependence(sched, nodes, first + i, first + j, stalled);
+    }
+  }
+  for (int i = n - 1; i >= 0; --i) {
+    for (int j = i + 1; j < n; ++j) {
+      if (latency[i * n + j] && latency[i * n + j] + height[j] > height[i]) {
+        height[i] = latency[i * n + j] + height[j];
+      }
+    }
+  }
+
+  long now = 0;
+  for (int position = 0; position < n; ++position) {
+    int best = -1;
+    long best_issue = 0;
+
+    for (int j = 0; j < n; ++j) {
+      long issue = now;
+      int ready = slot[j] < 0;
+
+      for (int i = 0; ready && i < j; ++i) {
+        if (!latency[i * n + j]) {
+          continue;
+        }
+        if (slot[i] < 0) {
+          ready = 0;
+        } else if (slot[i] + latency[i * n + j] > issue) {
+          issue = slot[i] + latency[i * n + j];
+        }
+      }
+      if (ready && (best < 0 || issue < best_issue ||
+                    (issue == best_issue && height[j] > height[best]))) {
+        best = j;
+        best_issue = issue;
+      }
+    }
+
+    slot[best] = best_issue;
+    now = best_issue + 1;
+    sched->scheduled[first + position] = sched->code[first + best];
+    moved += best != position;
+  }
+
+  free(latency);
+  free(height);
+  free(slot);
+  return moved;
+}
+
+/*
+ * Reorders the blocks of sched->code which stalled in the profile into
+ * sched->scheduled
+ */
+int
+APEX_sched_reorder(APEX_Sched* sched)
+{
+  Sched_Node* nodes = malloc(sched->size * sizeof(*nodes));
+  char* leader = calloc(sched->size + 1, 1);
+  char* stalled = calloc(sched->size, 1);
+  int result = 0;
+
+  sched->scheduled = malloc(sched->size * sizeof(APEX_Instruction));
+  if (!nodes || !leader || !stalled || !sched->scheduled) {
+    result = -1;
+    goto out;
+  }
+  memcpy(sched->scheduled, sched->code,
+         sched->size * sizeof(APEX_Instruction));
+
+  /* Consumers of an opcode which stalled wait for their producers */
+  const char* opcodes[SCHED_MAX_OPCODES];
+  int num_opcodes = 0;
+  for (int i = 0; i < sched->size; ++i) {
+    int known = 0;
+    for (int k = 0; k < num_opcodes && !known; ++k) {
+      known = !strcmp(opcodes[k], sched->code[i].opcode);
+    }
+    if (sched->stalls[i] && !known && num_opcodes < SCHED_MAX_OPCODES) {
+      opcodes[num_opcodes++] = sched->code[i].opcode;
+    }
+  }
+  for (int i = 0; i < sched->size; ++i) {
+    operands(&sched->code[i], &nodes[i]);
+    for (int k = 0; k < num_opcodes && !stalled[i]; ++k) {
+      stalled[i] = !strcmp(opcodes[k], sched->code[i].opcode);
+    }
+  }
+
+  if (find_blocks(sched, nodes, leader)) {
+    fprintf(stderr, "APEX_SCHED : jump target not constant, keeping the "
+                    "program order\n");
+    goto out;
+  }
+
+  leader[sched->size] = 1;
+  for (int first = 0; first < sched->size;) {
+    int last = first;
+    long stalls = sched->stalls[first];
+
+    while (!leader[last + 1] && last - first + 1 < SCHED_WINDOW) {
+      stalls += sched->stalls[++last];
+    }
+    sched->num_blocks++;
+    if (stalls && last > first && !nodes[first].barrier) {
+      int moved = schedule_block(sched, nodes, first, last, stalled);
+      if (moved < 0) {
+        result = -1;
+        goto out;
+      }
+      sched->blocks += moved > 0;
+      sched->moved += moved;
+    }
+    first = last + 1;
+  }
+
+out:
+  free(nodes);
+  free(leader);
+  free(stalled);
+  return result;
+}
+
+int
+APEX_sched_write(APEX_Sched* sched, const char* filename)
+{
+  FILE* fp = fopen(filename, "w");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", filename);
+    return -1;
+  }
+
+  for (int i = 0; i < sched->size; ++i) {
+    char text[64];
+    APEX_format_instruction(&sched->scheduled[i], text, sizeof(text));
+    fprintf(fp, "%s\n", text);
+  }
+  for (int i = 0; i < sched->data_size; ++i) {
+    if (i == 0) {
+      fprintf(fp, ".data\n");
+    }
+    fprintf(fp, i % 8 ? ", %d" : ".word %d", sched->data[i]);
+    if (i % 8 == 7 || i == sched->data_size - 1) {
+      fprintf(fp, "\n");
+    }
+  }
+  if (fclose(fp)) {
+    fprintf(stderr, "APEX_Error : Unable to write %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+void
+APEX_sched_free(APEX_Sched* sched)
+{
+  if (sched) {
+    free(sched->code);
+    free(sched->data);
+    free(sched->stalls);
+    free(sched->scheduled);
+    free(sched);
+  }
+}
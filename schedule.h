@@ -0,0 +1,99 @@
+#ifndef _APEX_SCHEDULE_H_
+#define _APEX_SCHEDULE_H_
+/**
+ *  schedule.h
+ *  Contains the profile guided instruction scheduler.
+ *
+ *  A first simulation counts the decode stall cycles of every instruction.
+ *  Basic blocks with stalls are list scheduled again: an instruction may
+ *  move past others unless a register (read after write, write after read
+ *  or write after write) or a data memory access involving a STORE orders
+ *  them, and a consumer of an opcode which stalled in the profile is kept
+ *  the distance between decode and writeback away from its producer where
+ *  other instructions can fill the gap. Block boundaries (JUMPs and their
+ *  targets) never move, so jump targets stay valid.
+ *
+ *  The rescheduled program is accepted if executing it in program order
+ *  ends with the same registers and data memory as the original, its
+ *  simulation ends with the same state as well (or the one the simulation
+ *  of the original ended with, the legacy ADDL interlock can read stale
+ *  registers) and it takes no more cycles. It is written with its labels
+ *  resolved to numbers, followed by its data section as .word lines.
+ */
+#include "cpu.h"
+
+#define SCHED_MAX_OPTIONS 32
+
+/* Longest run of instructions scheduled together, longer blocks are split */
+#define SCHED_WINDOW 256
+
+/* Distinct opcodes the profile may find stalling */
+#define SCHED_MAX_OPCODES 16
+
+/* Outcome of a simulation */
+enum
+{
+  SCHED_OK,
+  SCHED_TIMEOUT,    // Reached max_cycles before draining the pipeline
+  SCHED_FAILED
+};
+
+typedef struct Sched_Run
+{
+  int status;
+  long cycles;            // Until the last instruction left the pipeline,
+                          // instructions when executed in program order
+  long stall_cycles;
+  int regs[32];
+  int data_memory[4096];
+} Sched_Run;
+
+typedef struct APEX_Sched
+{
+  /* Runtime options applied to every simulation, name and value */
+  const char* option_names[SCHED_MAX_OPTIONS];
+  const char* option_values[SCHED_MAX_OPTIONS];
+  int num_options;
+  long max_cycles;
+
+  APEX_Instruction* code;
+  int size;
+  int* data;              // Preloaded into data memory before every run
+  int data_size;
+  long* stalls;           // Profile, decode stall cycles per instruction
+  int latency;            // Cycles from decode to writeback
+
+  APEX_Instruction* scheduled;
+  int num_blocks;
+  int blocks;             // Blocks rescheduled
+  int moved;              // Instructions at a new position
+
+  Sched_Run before;
+  Sched_Run after;
+  Sched_Run reference;    // Original program executed in program order
+} APEX_Sched;
+
+APEX_Sched*
+APEX_sched_init(void);
+
+int
+APEX_sched_simulate(APEX_Sched* sched, APEX_Instruction* code,
+                    long* profile, Sched_Run* run);
+
+int
+APEX_sched_execute(APEX_Sched* sched, APEX_Instruction* code,
+                   Sched_Run* run);
+
+int
+APEX_sched_reorder(APEX_Sched* sched);
+
+int
+APEX_sched_verify(APEX_Sched* sched);
+
+int
+APEX_sched_write(APEX_Sched* sched, const char* filename);
+
+void
+APEX_sched_free(APEX_Sched* sched);
+
+#endif
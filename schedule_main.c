@@ -0,0 +1,166 @@
+/*
+ *  schedule_main.c
+ *  Driver for the profile guided instruction scheduler
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "assembler.h"
+#include "schedule.h"
+
+/* Stalled instructions listed from the profile */
+#define SCHED_PRINT_LIMIT 8
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_sched [options] <input_file> "
+          "[--option=value ...]\n"
+          "  -o output_file  rescheduled program (default "
+          "<input_file>.sched)\n"
+          "  -x cycles       give up on a simulation after this many cycles "
+          "(default 10000000)\n"
+          "Options:\n");
+  APEX_print_options(stderr);
+  exit(1);
+}
+
+static void
+print_profile(APEX_Sched* sched)
+{
+  int printed = 0;
+
+  fprintf(stderr,
+          "APEX_SCHED : profile %ld cycles, %ld decode stall cycles\n",
+          sched->before.cycles, sched->before.stall_cycles);
+  for (int i = 0; i < sched->size && printed < SCHED_PRINT_LIMIT; ++i) {
+    if (sched->stalls[i]) {
+      char text[64];
+      APEX_format_instruction(&sched->code[i], text, sizeof(text));
+      fprintf(stderr, "APEX_SCHED :   pc(%d) %s stalled %ld cycles\n",
+              4000 + 4 * i, text, sched->stalls[i]);
+      printed++;
+    }
+  }
+}
+
+int
+main(int argc, char const* argv[])
+{
+  APEX_Sched* sched = APEX_sched_init();
+  const char* input = NULL;
+  char* output = NULL;
+
+  if (!sched) {
+    return 1;
+  }
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--", 2)) {
+      const char* value = strchr(argv[i], '=');
+      if (sched->num_options == SCHED_MAX_OPTIONS) {
+        fprintf(stderr, "APEX_Error : More than %d options\n",
+                SCHED_MAX_OPTIONS);
+        return 1;
+      }
+      sched->option_names[sched->num_options] =
+        value ? strndup(argv[i] + 2, value - argv[i] - 2)
+              : strdup(argv[i] + 2);
+      sched->option_values[sched->num_options++] = value ? value + 1 : "1";
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output = strdup(argv[++i]);
+    } else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+      sched->max_cycles = atol(argv[++i]);
+    } else if (argv[i][0] == '-' || input) {
+      usage();
+    } else {
+      input = argv[i];
+    }
+  }
+  if (!input || sched->max_cycles <= 0) {
+    usage();
+  }
+  if (!output) {
+    output = malloc(strlen(input) + sizeof(".sched"));
+    sprintf(output, "%s.sched", input);
+  }
+
+  APEX_Program program;
+  if (APEX_assemble(&input, 1, 0, &program)) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", input);
+    return 1;
+  }
+  sched->code = program.code;
+  sched->size = program.code_size;
+  sched->data = program.data;
+  sched->data_size = program.data_size;
+  sched->stalls = calloc(sched->size, sizeof(long));
+  if (!sched->stalls) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    return 1;
+  }
+
+  if (APEX_sched_simulate(sched, sched->code, sched->stalls,
+                          &sched->before) ||
+      APEX_sched_execute(sched, sched->code, &sched->reference)) {
+    if (sched->before.status == SCHED_TIMEOUT ||
+        sched->reference.status == SCHED_TIMEOUT) {
+      fprintf(stderr,
+              "APEX_Error : %s did not finish in %ld cycles, nothing to "
+              "schedule\n",
+              input, sched->max_cycles);
+    }
+    return 1;
+  }
+  print_profile(sched);
+
+  if (APEX_sched_reorder(sched)) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    return 1;
+  }
+  fprintf(stderr,
+          "APEX_SCHED : %d of %d blocks rescheduled, %d instructions moved\n",
+          sched->blocks, sched->num_blocks, sched->moved);
+
+  /* The new order has to compute the same state and not take longer */
+  Sched_Run* before = &sched->before;
+  Sched_Run* after = &sched->after;
+  if (sched->moved) {
+    if (APEX_sched_verify(sched)) {
+      fprintf(stderr, "APEX_Error : Rescheduled program not written\n");
+      return 1;
+    }
+    if (after->cycles > before->cycles) {
+      fprintf(stderr,
+              "APEX_SCHED : rescheduled program takes %ld cycles, keeping "
+              "the original\n",
+              after->cycles);
+      memcpy(sched->scheduled, sched->code,
+             sched->size * sizeof(APEX_Instruction));
+      *after = *before;
+    }
+  } else {
+    *after = *before;
+  }
+
+  if (APEX_sched_write(sched, output)) {
+    return 1;
+  }
+  fprintf(stderr,
+          "APEX_SCHED : %s %ld cycles, %ld decode stall cycles, saved %ld "
+          "cycles (%.1f%%)\n",
+          output, after->cycles, after->stall_cycles,
+          before->cycles - after->cycles,
+          before->cycles
+            ? 100.0 * (before->cycles - after->cycles) / before->cycles
+            : 0.0);
+
+  for (int i = 0; i < sched->num_options; ++i) {
+    free((char*)sched->option_names[i]);
+  }
+  free(output);
+  APEX_sched_free(sched);
+  return 0;
+}
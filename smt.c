@@ -0,0 +1,186 @@
+/*
+ *  smt.c
+ *  Contains the hardware threads of the APEX cpu
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "smt.h"
+
+static const char* policies[] = { "rr", "icount", "switch" };
+
+#define NUM_POLICIES (int)(sizeof(policies) / sizeof(policies[0]))
+
+APEX_SMT*
+APEX_smt_init(int num_threads)
+{
+  APEX_SMT* smt = calloc(1, sizeof(*smt));
+  if (!smt) {
+    return NULL;
+  }
+  smt->num_threads = num_threads;
+  smt->policy = SMT_ROUND_ROBIN;
+  smt->last = num_threads - 1;
+  smt->switched = 1;    // Switch-on-stall starts with thread 0
+  for (int t = 0; t < num_threads; ++t) {
+    smt->context[t].pc = 4000;
+    memset(smt->context[t].regs_valid, 1, sizeof(smt->context[t].regs_valid));
+  }
+  return smt;
+}
+
+int
+APEX_smt_set_policy(APEX_SMT* smt, const char* name)
+{
+  for (int i = 0; i < NUM_POLICIES; ++i) {
+    if (!strcmp(name, policies[i])) {
+      smt->policy = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int*
+thread_pc(APEX_CPU* cpu, int t)
+{
+  return t ? &cpu->smt->context[t].pc : &cpu->pc;
+}
+
+static int
+in_code(APEX_CPU* cpu, int pc)
+{
+  return pc >= 4000 && pc < 4000 + 4 * cpu->code_memory_size;
+}
+
+/*
+ * Counts the instructions of thread t behind fetch. Fetch runs last in a
+ * cycle, so every latch already holds the instruction of the next cycle.
+ */
+static int
+in_flight(APEX_CPU* cpu, int t)
+{
+  int count = 0;
+
+  for (int s = 1; s < cpu->num_stages; ++s) {
+    count += !cpu->stage[s].busy && cpu->stage[s].thread == t;
+  }
+  return count;
+}
+
+int
+APEX_smt_select(APEX_CPU* cpu)
+{
+  APEX_SMT* smt = cpu->smt;
+  int n = smt->num_threads;
+  int selected = -1;
+  int fewest = 0;
+
+  /* Threads in round robin order from the one after the last, or from the
+   * last one itself to stay on it until it stalls
+   */
+  int first = smt->policy == SMT_SWITCH_ON_STALL && !smt->switched &&
+                  smt->run < SMT_SWITCH_QUANTUM
+                ? 0
+                : 1;
+  smt->switched = 0;
+  for (int i = first; i < first + n; ++i) {
+    int t = (smt->last + i) % n;
+    if (!in_code(cpu, *thread_pc(cpu, t))) {
+      continue;
+    }
+    if (smt->policy != SMT_ICOUNT) {
+      selected = t;
+      break;
+    }
+    int count = in_flight(cpu, t);
+    if (selected < 0 || count < fewest) {
+      selected = t;
+      fewest = count;
+    }
+  }
+  if (selected >= 0) {
+    smt->run = selected == smt->last ? smt->run + 1 : 1;
+    smt->last = selected;
+    smt->context[selected].fetched++;
+  }
+  return selected;
+}
+
+void
+APEX_smt_stall(APEX_CPU* cpu, int s)
+{
+  APEX_SMT* smt = cpu->smt;
+  CPU_Stage* stage = &cpu->stage[s];
+  int t = stage->thread;
+
+  smt->context[t].stall_cycles++;
+
+  /* A bubble moves on, execute does not run its latch again */
+  cpu->stage[s + 1].busy = 1;
+  if (smt->policy != SMT_SWITCH_ON_STALL) {
+    for (int i = 0; i < s; ++i) {
+      cpu->stage[i].stalled = 1;
+    }
+    stage->stalled = 1;
+    return;
+  }
+
+  /* The waiting instruction and the ones of its thread behind it are
+   * squashed, fetch goes on with the next thread
+   */
+  for (int i = 0; i <= s; ++i) {
+    if (i > 0 && cpu->stage[i].thread == t) {
+      cpu->stage[i].busy = 1;
+    }
+    cpu->stage[i].stalled = 0;
+  }
+  *thread_pc(cpu, t) = stage->pc;
+  smt->context[t].switches++;
+  smt->last = t;
+  smt->switched = 1;
+}
+
+int
+APEX_smt_done(APEX_CPU* cpu)
+{
+  for (int t = 0; t < cpu->smt->num_threads; ++t) {
+    if (in_code(cpu, *thread_pc(cpu, t))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void
+APEX_smt_report(APEX_CPU* cpu, FILE* out)
+{
+  APEX_SMT* smt = cpu->smt;
+  long retired = 0;
+  long stall_cycles = 0;
+
+  fprintf(out, "APEX_SMT : %d threads, %s fetch policy, %d cycles\n",
+          smt->num_threads, policies[smt->policy], cpu->clock);
+  for (int t = 0; t < smt->num_threads; ++t) {
+    APEX_Context* context = &smt->context[t];
+    fprintf(out,
+            "APEX_SMT : thread %d %10ld retired, IPC %.3f, %ld fetched, "
+            "%ld decode stall cycles, %ld switches\n",
+            t, context->retired,
+            cpu->clock ? (double)context->retired / cpu->clock : 0.0,
+            context->fetched, context->stall_cycles, context->switches);
+    retired += context->retired;
+    stall_cycles += context->stall_cycles;
+  }
+  fprintf(out,
+          "APEX_SMT : all threads %6ld retired, IPC %.3f, %ld decode stall "
+          "cycles\n",
+          retired, cpu->clock ? (double)retired / cpu->clock : 0.0,
+          stall_cycles);
+}
+
+void
+APEX_smt_free(APEX_SMT* smt)
+{
+  free(smt);
+}
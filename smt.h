@@ -0,0 +1,83 @@
+#ifndef _APEX_SMT_H_
+#define _APEX_SMT_H_
+/**
+ *  smt.h
+ *  Contains the hardware threads of the APEX cpu: 2 to 8 contexts, each with
+ *  its own pc, register file and scoreboard, which run the loaded program
+ *  and share the pipeline and data memory.
+ *
+ *  Fetch picks the thread of every instruction by the thread policy, and
+ *  the latches carry the thread along. A JUMP only squashes the instructions
+ *  of its own thread. When decode waits for an operand a bubble moves on;
+ *  with switch-on-stall the waiting instruction is squashed instead and
+ *  refetched once the pipeline comes back to its thread.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define APEX_MAX_THREADS 8
+
+/* Instructions switch-on-stall fetches for a thread which does not stall
+ * before it moves on anyway, so such a thread does not starve the others
+ */
+#define SMT_SWITCH_QUANTUM 64
+
+/* Thread fetch selects */
+enum
+{
+  SMT_ROUND_ROBIN,    // Next thread after the last one fetched
+  SMT_ICOUNT,         // Fewest instructions in the pipeline
+  SMT_SWITCH_ON_STALL // Same thread until decode waits for an operand
+};
+
+/* State of one hardware thread. Thread 0 runs on the pc, registers and
+ * scoreboard of the cpu
+ */
+typedef struct APEX_Context
+{
+  int pc;
+  int regs[32];
+  int regs_valid[32];
+
+  long fetched;
+  long retired;
+  long stall_cycles;    // Decode waiting for an operand of the thread
+  long switches;        // Switched out on a stall
+} APEX_Context;
+
+typedef struct APEX_SMT
+{
+  int num_threads;
+  int policy;
+  int last;             // Thread fetched last
+  int switched;         // It just switched out on a stall
+  int run;              // Instructions fetched since the last switch
+  APEX_Context context[APEX_MAX_THREADS];
+} APEX_SMT;
+
+APEX_SMT*
+APEX_smt_init(int num_threads);
+
+int
+APEX_smt_set_policy(APEX_SMT* smt, const char* name);
+
+/* Thread to fetch for in this cycle, -1 once every thread left the code */
+int
+APEX_smt_select(APEX_CPU* cpu);
+
+/* Decode stage s waits for an operand of its instruction */
+void
+APEX_smt_stall(APEX_CPU* cpu, int s);
+
+/* Returns 1 once the pc of every thread is outside code memory */
+int
+APEX_smt_done(APEX_CPU* cpu);
+
+void
+APEX_smt_report(APEX_CPU* cpu, FILE* out);
+
+void
+APEX_smt_free(APEX_SMT* smt);
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ *  sweep.c
+ *  Contains the parallel design space exploration driver
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fastforward.h"
+#include "sweep.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ul
+#define FNV_PRIME 0x100000001b3ul
+
+static unsigned long
+fnv1a(unsigned long hash, const void* data, size_t len)
+{
+  const unsigned char* bytes = data;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+APEX_Sweep*
+APEX_sweep_init(void)
+{
+  APEX_Sweep* sweep = calloc(1, sizeof(*sweep));
+  if (!sweep) {
+    return NULL;
+  }
+  sweep->max_cycles = 10000000;
+  sweep->num_threads = 1;
+  pthread_mutex_init(&sweep->lock, NULL);
+  return sweep;
+}
+
+/*
+ * Adds a parameter given as "name=value value ...", values are separated by
+ * white space since option values (pipelines) may contain commas
+ */
+int
+APEX_sweep_add_param(APEX_Sweep* sweep, const char* spec)
+{
+  const char* equals = strchr(spec, '=');
+  if (!equals || equals == spec) {
+    fprintf(stderr, "APEX_Error : Expected name=values, got '%s'\n", spec);
+    return -1;
+  }
+  if (sweep->num_params == SWEEP_MAX_PARAMS) {
+    fprintf(stderr, "APEX_Error : More than %d sweep parameters\n",
+            SWEEP_MAX_PARAMS);
+    return -1;
+  }
+
+  Sweep_Param* param = &sweep->params[sweep->num_params];
+  param->name = strndup(spec, equals - spec);
+  param->num_values = 0;
+
+  char* values = strdup(equals + 1);
+  int status = 0;
+  if (!param->name || !values) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    status = -1;
+  }
+  char* save;
+  for (char* value = status ? NULL : strtok_r(values, " \t\r\n", &save);
+       value; value = strtok_r(NULL, " \t\r\n", &save)) {
+    if (param->num_values == SWEEP_MAX_VALUES) {
+      fprintf(stderr, "APEX_Error : More than %d values for %s\n",
+              SWEEP_MAX_VALUES, param->name);
+      status = -1;
+      break;
+    }
+    char* copy = strdup(value);
+    if (!copy) {
+      fprintf(stderr, "APEX_Error : Out of memory\n");
+      status = -1;
+      break;
+    }
+    param->values[param->num_values++] = copy;
+  }
+  free(values);
+
+  if (!status && !param->num_values) {
+    fprintf(stderr, "APEX_Error : No values for %s\n", param->name);
+    status = -1;
+  }
+  if (status) {
+    for (int i = 0; i < param->num_values; ++i) {
+      free(param->values[i]);
+    }
+    free(param->name);
+    return -1;
+  }
+  sweep->num_params++;
+  return 0;
+}
+
+/*
+ * Reads a grid file, one "name=values" parameter per line, # starts a
+ * comment
+ */
+int
+APEX_sweep_load_grid(APEX_Sweep* sweep, const char* filename)
+{
+  FILE* fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open grid %s\n", filename);
+    return -1;
+  }
+
+  char* line = NULL;
+  size_t len = 0;
+  int result = 0;
+  while (!result && getline(&line, &len, fp) != -1) {
+    char* comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    char* spec = line + strspn(line, " \t\r\n");
+    if (*spec) {
+      result = APEX_sweep_add_param(sweep, spec);
+    }
+  }
+  free(line);
+  fclose(fp);
+  return result;
+}
+
+static unsigned long
+hash_program(const APEX_Program* program)
+{
+  unsigned long hash = FNV_OFFSET;
+  for (int i = 0; i < program->code_size; ++i) {
+    const APEX_Instruction* ins = &program->code[i];
+    int fields[4] = { ins->rd, ins->rs1, ins->rs2, ins->imm };
+    hash = fnv1a(hash, ins->opcode, strlen(ins->opcode) + 1);
+    hash = fnv1a(hash, fields, sizeof(fields));
+  }
+  return fnv1a(hash, program->data, sizeof(int) * program->data_size);
+}
+
+int
+APEX_sweep_add_program(APEX_Sweep* sweep, const char* filename)
+{
+  Sweep_Program* programs = realloc(
+    sweep->programs, (sweep->num_programs + 1) * sizeof(*programs));
+  if (!programs) {
+    return -1;
+  }
+  sweep->programs = programs;
+
+  Sweep_Program* program = &programs[sweep->num_programs];
+  program->filename = filename;
+  if (APEX_assemble(&filename, 1, 0, &program->program)) {
+    fprintf(stderr, "APEX_Error : Unable to load program %s\n", filename);
+    return -1;
+  }
+  program->hash = hash_program(&program->program);
+  sweep->num_programs++;
+  return 0;
+}
+
+static const char*
+config_value(APEX_Sweep* sweep, int config, int p)
+{
+  for (int i = sweep->num_params - 1; i > p; --i) {
+    config /= sweep->params[i].num_values;
+  }
+  return sweep->params[p].values[config % sweep->params[p].num_values];
+}
+
+static unsigned long
+config_hash(APEX_Sweep* sweep, int config)
+{
+  char buffer[64];
+  unsigned long hash = fnv1a(FNV_OFFSET, SWEEP_VERSION, strlen(SWEEP_VERSION));
+
+  snprintf(buffer, sizeof(buffer), "\nmax-cycles=%ld", sweep->max_cycles);
+  hash = fnv1a(hash, buffer, strlen(buffer));
+  for (int p = 0; p < sweep->num_params; ++p) {
+    const char* value = config_value(sweep, config, p);
+    hash = fnv1a(hash, "\n", 1);
+    hash = fnv1a(hash, sweep->params[p].name, strlen(sweep->params[p].name));
+    hash = fnv1a(hash, "=", 1);
+    hash = fnv1a(hash, value, strlen(value));
+  }
+  return hash;
+}
+
+static void
+cache_path(APEX_Sweep* sweep, Sweep_Point* point, char* path, size_t size)
+{
+  snprintf(path, size, "%s/%016lx-%016lx", sweep->cache_dir,
+           sweep->programs[point->program].hash, point->hash);
+}
+
+static int
+cache_load(APEX_Sweep* sweep, Sweep_Point* point)
+{
+  char path[4096];
+  cache_path(sweep, point, path, sizeof(path));
+
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+  Sweep_Result* result = &point->result;
+  int n = fscanf(fp, "%d %ld %ld", &result->status, &result->cycles,
+                 &result->instructions);
+  fclose(fp);
+  return n == 3 ? 0 : -1;
+}
+
+/*
+ * Writes the result to a temporary file first, so that an interrupted
+ * sweep never leaves a truncated entry behind
+ */
+static void
+cache_store(APEX_Sweep* sweep, Sweep_Point* point)
+{
+  char path[4096];
+  char temp[4200];
+  cache_path(sweep, point, path, sizeof(path));
+  snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long)getpid());
+
+  FILE* fp = fopen(temp, "w");
+  if (!fp) {
+    return;
+  }
+  fprintf(fp, "%d %ld %ld\n", point->result.status, point->result.cycles,
+          point->result.instructions);
+  if (fclose(fp) || rename(temp, path)) {
+    unlink(temp);
+  }
+}
+
+static void
+simulate_point(APEX_Sweep* sweep, Sweep_Point* point)
+{
+  Sweep_Program* program = &sweep->programs[point->program];
+  Sweep_Result* result = &point->result;
+
+  APEX_CPU* cpu = APEX_cpu_init_program(&program->program);
+  if (!cpu) {
+    result->status = SWEEP_FAILED;
+    return;
+  }
+  cpu->debug_messages = 0;
+
+  result->status = SWEEP_OK;
+  for (int p = 0; p < sweep->num_params; ++p) {
+    if (APEX_cpu_set_option(cpu, sweep->params[p].name,
+                            config_value(sweep, point->config, p))) {
+      result->status = SWEEP_BAD_OPTION;
+    }
+  }
+  if (result->status == SWEEP_OK && cpu->ff_instructions &&
+      APEX_cpu_fast_forward(cpu)) {
+    result->status = SWEEP_FAILED;
+  }
+
+  /* Every thread retires into ins_completed and fast-forward starts part
+   * of the way in, only an empty pipeline tells the run is over
+   */
+  while (result->status == SWEEP_OK && !APEX_cpu_drained(cpu)) {
+    if (cpu->clock >= sweep->max_cycles) {
+      result->status = SWEEP_TIMEOUT;
+      break;
+    }
+    if (APEX_cpu_step(cpu)) {
+      result->status = SWEEP_FAILED;
+    }
+  }
+
+  result->cycles = cpu->clock;
+  result->instructions = cpu->ins_completed;
+  APEX_cpu_stop(cpu);
+}
+
+static void*
+worker(void* arg)
+{
+  APEX_Sweep* sweep = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&sweep->lock);
+    int index = sweep->next_point++;
+    pthread_mutex_unlock(&sweep->lock);
+    if (index >= sweep->num_points) {
+      break;
+    }
+
+    Sweep_Point* point = &sweep->points[index];
+    if (sweep->cache_dir && !cache_load(sweep, point)) {
+      point->cached = 1;
+      continue;
+    }
+    simulate_point(sweep, point);
+    /* Bad options are not cached, the option set may grow */
+    if (sweep->cache_dir && point->result.status != SWEEP_BAD_OPTION) {
+      cache_store(sweep, point);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Simulates every point of the grid, returns 0 on success
+ */
+int
+APEX_sweep_run(APEX_Sweep* sweep)
+{
+  int num_configs = 1;
+  for (int p = 0; p < sweep->num_params; ++p) {
+    num_configs *= sweep->params[p].num_values;
+  }
+
+  sweep->num_points = sweep->num_programs * num_configs;
+  sweep->points = calloc(sweep->num_points, sizeof(Sweep_Point));
+  if (!sweep->points) {
+    return -1;
+  }
+  for (int i = 0; i < sweep->num_points; ++i) {
+    Sweep_Point* point = &sweep->points[i];
+    point->program = i / num_configs;
+    point->config = i % num_configs;
+    point->hash = config_hash(sweep, point->config);
+  }
+
+  if (sweep->cache_dir && mkdir(sweep->cache_dir, 0777) && errno != EEXIST) {
+    fprintf(stderr, "APEX_Error : Unable to create cache directory %s\n",
+            sweep->cache_dir);
+    return -1;
+  }
+
+  int num_threads = sweep->num_threads;
+  if (num_threads > sweep->num_points) {
+    num_threads = sweep->num_points;
+  }
+  pthread_t threads[num_threads > 0 ? num_threads : 1];
+
+  sweep->next_point = 0;
+  for (int t = 1; t < num_threads; ++t) {
+    if (pthread_create(&threads[t], NULL, worker, sweep)) {
+      fprintf(stderr, "APEX_Error : Unable to create host thread %d\n", t);
+      exit(1);
+    }
+  }
+  worker(sweep);
+  for (int t = 1; t < num_threads; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+  return 0;
+}
+
+static const char*
+status_name(int status)
+{
+  switch (status) {
+    case SWEEP_OK:
+      return "ok";
+    case SWEEP_BAD_OPTION:
+      return "bad-option";
+    case SWEEP_TIMEOUT:
+      return "timeout";
+    default:
+      return "failed";
+  }
+}
+
+/*
+ * Prints one tab separated row per point, in grid order independent of the
+ * number of threads and of which points came from the cache
+ */
+void
+APEX_sweep_report(APEX_Sweep* sweep, FILE* out)
+{
+  int cached = 0;
+
+  fprintf(out, "program");
+  for (int p = 0; p < sweep->num_params; ++p) {
+    fprintf(out, "\t%s", sweep->params[p].name);
+  }
+  fprintf(out, "\tstatus\tcycles\tinstructions\tipc\n");
+
+  for (int i = 0; i < sweep->num_points; ++i) {
+    Sweep_Point* point = &sweep->points[i];
+    Sweep_Result* result = &point->result;
+
+    fprintf(out, "%s", sweep->programs[point->program].filename);
+    for (int p = 0; p < sweep->num_params; ++p) {
+      fprintf(out, "\t%s", config_value(sweep, point->config, p));
+    }
+    fprintf(out, "\t%s\t%ld\t%ld\t%.4f\n", status_name(result->status),
+            result->cycles, result->instructions,
+            result->cycles ? (double)result->instructions / result->cycles
+                           : 0.0);
+    cached += point->cached;
+  }
+
+  fprintf(stderr, "APEX_SWEEP : %d points, %d simulated, %d from cache\n",
+          sweep->num_points, sweep->num_points - cached, cached);
+}
+
+void
+APEX_sweep_free(APEX_Sweep* sweep)
+{
+  if (!sweep) {
+    return;
+  }
+  for (int p = 0; p < sweep->num_params; ++p) {
+    for (int i = 0; i < sweep->params[p].num_values; ++i) {
+      free(sweep->params[p].values[i]);
+    }
+    free(sweep->params[p].name);
+  }
+  for (int i = 0; i < sweep->num_programs; ++i) {
+    APEX_program_free(&sweep->programs[i].program);
+  }
+  free(sweep->programs);
+  free(sweep->points);
+  pthread_mutex_destroy(&sweep->lock);
+  free(sweep);
+}
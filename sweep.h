@@ -0,0 +1,105 @@
+#ifndef _APEX_SWEEP_H_
+#define _APEX_SWEEP_H_
+/**
+ *  sweep.h
+ *  Contains the design space exploration driver: every program of a set is
+ *  simulated under every configuration of a grid of runtime options.
+ *  Points run in parallel on host threads, programs are parsed once and
+ *  their code memory is shared read-only by all runs. Results are cached
+ *  on disk keyed by program and configuration hash.
+ */
+#include <pthread.h>
+#include <stdio.h>
+
+#include "assembler.h"
+#include "cpu.h"
+
+#define SWEEP_MAX_PARAMS 16
+#define SWEEP_MAX_VALUES 64
+
+/* Bump when simulated timing changes, cached results become stale */
+#define SWEEP_VERSION "apex-sweep-2"
+
+/* Outcome of one point */
+enum
+{
+  SWEEP_OK,
+  SWEEP_BAD_OPTION,   // A value was rejected by APEX_cpu_set_option
+  SWEEP_TIMEOUT,      // Reached max_cycles before completion
+  SWEEP_FAILED        // Unable to create the cpu
+};
+
+/* One swept runtime option and its values */
+typedef struct Sweep_Param
+{
+  char* name;
+  int num_values;
+  char* values[SWEEP_MAX_VALUES];
+} Sweep_Param;
+
+typedef struct Sweep_Program
+{
+  const char* filename;
+  APEX_Program program;
+  unsigned long hash;   // Of the code and data, included files too
+} Sweep_Program;
+
+typedef struct Sweep_Result
+{
+  int status;
+  long cycles;
+  long instructions;
+} Sweep_Result;
+
+/* One (program, configuration) pair */
+typedef struct Sweep_Point
+{
+  int program;
+  int config;           // Mixed radix index into the grid, last param fastest
+  unsigned long hash;   // Of the configuration
+  int cached;           // Result was read from the cache
+  Sweep_Result result;
+} Sweep_Point;
+
+typedef struct APEX_Sweep
+{
+  Sweep_Param params[SWEEP_MAX_PARAMS];
+  int num_params;
+
+  Sweep_Program* programs;
+  int num_programs;
+
+  Sweep_Point* points;
+  int num_points;
+
+  const char* cache_dir;  // NULL disables the result cache
+  long max_cycles;
+  int num_threads;
+
+  /* Next point to simulate, shared by the host threads */
+  pthread_mutex_t lock;
+  int next_point;
+} APEX_Sweep;
+
+APEX_Sweep*
+APEX_sweep_init(void);
+
+int
+APEX_sweep_add_param(APEX_Sweep* sweep, const char* spec);
+
+int
+APEX_sweep_load_grid(APEX_Sweep* sweep, const char* filename);
+
+int
+APEX_sweep_add_program(APEX_Sweep* sweep, const char* filename);
+
+int
+APEX_sweep_run(APEX_Sweep* sweep);
+
+void
+APEX_sweep_report(APEX_Sweep* sweep, FILE* out);
+
+void
+APEX_sweep_free(APEX_Sweep* sweep);
+
+#endif
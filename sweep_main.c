@@ -0,0 +1,87 @@
+/*
+ *  sweep_main.c
+ *  Driver for design space exploration over runtime options
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sweep.h"
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage ./apex_sweep [options] <input_file> "
+          "[<input_file> ...]\n"
+          "  -p 'name=v1 v2 ...'  sweep option --name over the values, may "
+          "be repeated\n"
+          "  -g grid_file         read parameters from a file, one per line\n"
+          "  -j threads           host threads (default: online cpus)\n"
+          "  -d directory         result cache (default .apex_sweep)\n"
+          "  -n                   do not use the result cache\n"
+          "  -x cycles            give up on a point after this many cycles "
+          "(default 10000000)\n"
+          "Options:\n");
+  APEX_print_options(stderr);
+  exit(1);
+}
+
+int
+main(int argc, char* argv[])
+{
+  APEX_Sweep* sweep = APEX_sweep_init();
+  int opt;
+
+  if (!sweep) {
+    return 1;
+  }
+  sweep->cache_dir = ".apex_sweep";
+  sweep->num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((opt = getopt(argc, argv, "p:g:j:d:nx:")) != -1) {
+    switch (opt) {
+      case 'p':
+        if (APEX_sweep_add_param(sweep, optarg)) {
+          usage();
+        }
+        break;
+      case 'g':
+        if (APEX_sweep_load_grid(sweep, optarg)) {
+          usage();
+        }
+        break;
+      case 'j':
+        sweep->num_threads = atoi(optarg);
+        break;
+      case 'd':
+        sweep->cache_dir = optarg;
+        break;
+      case 'n':
+        sweep->cache_dir = NULL;
+        break;
+      case 'x':
+        sweep->max_cycles = atol(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind == argc || sweep->num_threads <= 0 || sweep->max_cycles <= 0) {
+    usage();
+  }
+  for (int i = optind; i < argc; ++i) {
+    if (APEX_sweep_add_program(sweep, argv[i])) {
+      return 1;
+    }
+  }
+
+  if (APEX_sweep_run(sweep)) {
+    fprintf(stderr, "APEX_Error : Sweep failed\n");
+    return 1;
+  }
+  APEX_sweep_report(sweep, stdout);
+  APEX_sweep_free(sweep);
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ *  telemetry.c
+ *  Contains the windowed telemetry of long runs and its writer thread
+ */
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+static void
+write_record(APEX_Telemetry* telemetry, const Telemetry_Record* record)
+{
+  FILE* fp = telemetry->fp;
+  int accesses = record->loads + record->stores;
+  double ipc = record->cycles ? (double)record->instructions / record->cycles
+                              : 0.0;
+  double bandwidth =
+    record->cycles ? 4.0 * accesses / record->cycles : 0.0;
+
+  if (telemetry->format == TELEMETRY_CSV) {
+    if (!telemetry->records) {
+      fprintf(fp, "cycle,cycles,instructions,ipc,memory_stalls,"
+                  "dependency_stalls,squashed,loads,stores,bytes_per_cycle,"
+                  "jumps,redirects,jump_accuracy\n");
+    }
+    fprintf(fp, "%ld,%d,%d,%.4f,%d,%d,%d,%d,%d,%.4f,%d,%d,", record->cycle,
+            record->cycles, record->instructions, ipc, record->memory_stalls,
+            record->dependency_stalls, record->squashed, record->loads,
+            record->stores, bandwidth, record->jumps, record->redirects);
+    if (record->jumps) {
+      fprintf(fp, "%.4f",
+              1.0 - (double)record->redirects / record->jumps);
+    }
+    fputc('\n', fp);
+  } else {
+    fprintf(fp,
+            "apex cycles=%di,instructions=%di,ipc=%.4f,memory_stalls=%di,"
+            "dependency_stalls=%di,squashed=%di,loads=%di,stores=%di,"
+            "bytes_per_cycle=%.4f,jumps=%di,redirects=%di",
+            record->cycles, record->instructions, ipc, record->memory_stalls,
+            record->dependency_stalls, record->squashed, record->loads,
+            record->stores, bandwidth, record->jumps, record->redirects);
+    if (record->jumps) {
+      fprintf(fp, ",jump_accuracy=%.4f",
+              1.0 - (double)record->redirects / record->jumps);
+    }
+    fprintf(fp, " %ld\n", record->cycle);
+  }
+  telemetry->records++;
+}
+
+/*
+ * Writer thread, drains the ring until the simulation is done
+ */
+static void*
+writer(void* arg)
+{
+  APEX_Telemetry* telemetry = arg;
+  const struct timespec nap = { 0, 1000000 };
+
+  for (;;) {
+    unsigned long head =
+      atomic_load_explicit(&telemetry->head, memory_order_relaxed);
+    unsigned long tail =
+      atomic_load_explicit(&telemetry->tail, memory_order_acquire);
+
+    if (head == tail) {
+      /* Done is set after the last push, recheck before leaving */
+      if (atomic_load_explicit(&telemetry->done, memory_order_acquire) &&
+          head == atomic_load_explicit(&telemetry->tail,
+                                       memory_order_acquire)) {
+        break;
+      }
+      nanosleep(&nap, NULL);
+      continue;
+    }
+    for (; head != tail; ++head) {
+      write_record(telemetry, &telemetry->ring[head % TELEMETRY_RING]);
+    }
+    atomic_store_explicit(&telemetry->head, head, memory_order_release);
+  }
+  return NULL;
+}
+
+/*
+ * Opens filename for the records of the simulation and starts the writer
+ */
+APEX_Telemetry*
+APEX_telemetry_open(const char* filename)
+{
+  APEX_Telemetry* telemetry = calloc(1, sizeof(*telemetry));
+  if (!telemetry) {
+    return NULL;
+  }
+  telemetry->fp = fopen(filename, "w");
+  if (!telemetry->fp) {
+    fprintf(stderr, "APEX_Error : Unable to open telemetry file %s\n",
+            filename);
+    free(telemetry);
+    return NULL;
+  }
+  telemetry->format = TELEMETRY_CSV;
+  telemetry->current.cycle = -1;
+  APEX_telemetry_set_window(telemetry, 1000);
+  atomic_init(&telemetry->head, 0);
+  atomic_init(&telemetry->tail, 0);
+  atomic_init(&telemetry->done, 0);
+
+  if (pthread_create(&telemetry->writer, NULL, writer, telemetry)) {
+    fclose(telemetry->fp);
+    free(telemetry);
+    return NULL;
+  }
+  return telemetry;
+}
+
+/*
+ * Sets the cycles per record, before the simulation starts
+ */
+void
+APEX_telemetry_set_window(APEX_Telemetry* telemetry, int window)
+{
+  telemetry->window = window;
+  /* The first cycle starts the first window */
+  telemetry->current.cycles = window;
+}
+
+int
+APEX_telemetry_set_format(APEX_Telemetry* telemetry, const char* format)
+{
+  if (!strcmp(format, "csv")) {
+    telemetry->format = TELEMETRY_CSV;
+  } else if (!strcmp(format, "line")) {
+    telemetry->format = TELEMETRY_LINE;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/* Hands the record of the current window to the writer */
+static void
+push(APEX_CPU* cpu)
+{
+  APEX_Telemetry* telemetry = cpu->telemetry;
+  unsigned long tail =
+    atomic_load_explicit(&telemetry->tail, memory_order_relaxed);
+
+  telemetry->current.instructions =
+    cpu->ins_completed - telemetry->base_instructions;
+
+  if (tail - atomic_load_explicit(&telemetry->head, memory_order_acquire) ==
+      TELEMETRY_RING) {
+    telemetry->full_waits++;
+    while (tail - atomic_load_explicit(&telemetry->head,
+                                       memory_order_acquire) ==
+           TELEMETRY_RING) {
+      sched_yield();
+    }
+  }
+  telemetry->ring[tail % TELEMETRY_RING] = telemetry->current;
+  atomic_store_explicit(&telemetry->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * Called by the cycle which would be window + 1 of the current window,
+ * starts a new one
+ */
+void
+APEX_telemetry_window(APEX_CPU* cpu)
+{
+  APEX_Telemetry* telemetry = cpu->telemetry;
+
+  /* The count already includes this cycle, nothing to push before the
+   * first one
+   */
+  if (telemetry->current.cycle >= 0) {
+    telemetry->current.cycles--;
+    push(cpu);
+  }
+  memset(&telemetry->current, 0, sizeof(telemetry->current));
+  telemetry->current.cycle = cpu->clock;
+  telemetry->current.cycles = 1;
+  telemetry->base_instructions = cpu->ins_completed;
+}
+
+/*
+ * Pushes the last partial window, waits for the writer and closes the file
+ */
+void
+APEX_telemetry_close(APEX_CPU* cpu)
+{
+  APEX_Telemetry* telemetry = cpu->telemetry;
+
+  if (telemetry->current.cycle >= 0) {
+    push(cpu);
+  }
+  atomic_store_explicit(&telemetry->done, 1, memory_order_release);
+  pthread_join(telemetry->writer, NULL);
+
+  if (ferror(telemetry->fp) | fclose(telemetry->fp)) {
+    fprintf(stderr, "APEX_Error : Writing the telemetry failed\n");
+  }
+  fprintf(stderr,
+          "APEX_TELEMETRY : %ld records of %d cycles, ring full %ld times\n",
+          telemetry->records, telemetry->window, telemetry->full_waits);
+  free(telemetry);
+  cpu->telemetry = NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef _APEX_TELEMETRY_H_
+#define _APEX_TELEMETRY_H_
+/**
+ *  telemetry.h
+ *  Contains the windowed telemetry of long runs.
+ *
+ *  Every window cycles the simulation closes a record of what happened in
+ *  the window (retired instructions, stall cycles by cause, data accesses,
+ *  jumps) and pushes it into a single producer, single consumer ring. A
+ *  writer thread pops the records and appends them to a CSV or InfluxDB
+ *  line protocol file, so file output never holds up the simulation. The
+ *  simulation only waits when the ring is full.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define TELEMETRY_RING 1024   // Records, a power of two
+
+enum
+{
+  TELEMETRY_CSV,
+  TELEMETRY_LINE    // InfluxDB line protocol, the cycle as timestamp
+};
+
+/* Activity of one window */
+typedef struct Telemetry_Record
+{
+  long cycle;               // First cycle of the window
+  int cycles;
+  int instructions;         // Retired
+  int memory_stalls;        // Cycles the pipeline was frozen on a data access
+  int dependency_stalls;    // Cycles decode held an instruction for an operand
+  int squashed;             // Instructions flushed by jumps and mispredictions
+  int loads;
+  int stores;
+  int jumps;
+  int redirects;            // Jumps whose target was not the next pc
+} Telemetry_Record;
+
+typedef struct APEX_Telemetry
+{
+  FILE* fp;
+  int format;
+  int window;
+
+  /* Record of the current window, counted in by the stage functions. The
+   * step function counts its cycles, cycle is -1 before the first one.
+   */
+  Telemetry_Record current;
+  long base_instructions;   // Retired when the window began
+
+  /* Ring, head is only written by the writer and tail by the simulation */
+  Telemetry_Record ring[TELEMETRY_RING];
+  atomic_ulong head;
+  atomic_ulong tail;
+  atomic_int done;
+
+  pthread_t writer;
+  long records;
+  long full_waits;          // Times the simulation found the ring full
+} APEX_Telemetry;
+
+APEX_Telemetry*
+APEX_telemetry_open(const char* filename);
+
+void
+APEX_telemetry_set_window(APEX_Telemetry* telemetry, int window);
+
+int
+APEX_telemetry_set_format(APEX_Telemetry* telemetry, const char* format);
+
+void
+APEX_telemetry_window(APEX_CPU* cpu);
+
+void
+APEX_telemetry_close(APEX_CPU* cpu);
+
+#endif
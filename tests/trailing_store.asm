@@ -0,0 +1,3 @@
+MOVC,R1,#7
+MOVC,R2,#3
+STORE,R1,R2,#0
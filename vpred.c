@@ -0,0 +1,353 @@
+/*
+ *  vpred.c
+ *  Contains the value and address predictors and their hooks into the
+ *  pipeline
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "vpred.h"
+
+static Pred_Entry*
+lookup(APEX_Predictor* pred, int pc)
+{
+  return &pred->table[(unsigned)(pc / 4) % VPRED_TABLE];
+}
+
+/* Allocates the entry of pc on a tag mismatch, returns 1 if it was new */
+static int
+allocate(Pred_Entry* entry, int pc, int value)
+{
+  if (entry->pc == pc) {
+    return 0;
+  }
+  memset(entry, 0, sizeof(*entry));
+  entry->pc = pc;
+  entry->last = value;
+  entry->history[0] = value;
+  return 1;
+}
+
+static void
+train(int* confidence, int correct)
+{
+  if (!correct) {
+    *confidence = 0;
+  } else if (*confidence < 3) {
+    (*confidence)++;
+  }
+}
+
+/* Last value: predicts the previous value of the pc */
+static int
+last_predict(APEX_Predictor* pred, int pc, int* value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (entry->pc != pc || entry->confidence < 2) {
+    return 0;
+  }
+  *value = entry->last;
+  return 1;
+}
+
+static void
+last_update(APEX_Predictor* pred, int pc, int value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (!allocate(entry, pc, value)) {
+    train(&entry->confidence, entry->last == value);
+    entry->last = value;
+  }
+}
+
+/* Stride: predicts the previous value plus the last difference */
+static int
+stride_predict(APEX_Predictor* pred, int pc, int* value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (entry->pc != pc || entry->confidence < 2) {
+    return 0;
+  }
+  *value = entry->last + entry->stride;
+  return 1;
+}
+
+static void
+stride_update(APEX_Predictor* pred, int pc, int value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (!allocate(entry, pc, value)) {
+    int stride = value - entry->last;
+    train(&entry->confidence, stride == entry->stride);
+    entry->stride = stride;
+    entry->last = value;
+  }
+}
+
+/* Context (order 2 finite context method): the values which followed the
+ * last two values of the pc before
+ */
+static int
+context_index(Pred_Entry* entry)
+{
+  unsigned hash = entry->history[0] * 31u + entry->history[1] * 17u +
+                  (unsigned)entry->pc;
+  return hash % VPRED_CONTEXT_TABLE;
+}
+
+static int
+context_predict(APEX_Predictor* pred, int pc, int* value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (entry->pc != pc) {
+    return 0;
+  }
+  int index = context_index(entry);
+  if (pred->context_confidence[index] < 2) {
+    return 0;
+  }
+  *value = pred->context_value[index];
+  return 1;
+}
+
+static void
+context_update(APEX_Predictor* pred, int pc, int value)
+{
+  Pred_Entry* entry = lookup(pred, pc);
+  if (allocate(entry, pc, value)) {
+    return;
+  }
+  int index = context_index(entry);
+  train(&pred->context_confidence[index], pred->context_value[index] == value);
+  pred->context_value[index] = value;
+  entry->history[1] = entry->history[0];
+  entry->history[0] = value;
+}
+
+static APEX_Predictor*
+create_predictor(const char* kind)
+{
+  APEX_Predictor* pred = calloc(1, sizeof(*pred));
+  if (!pred) {
+    return NULL;
+  }
+  if (!strcmp(kind, "last")) {
+    pred->name = "last";
+    pred->predict = last_predict;
+    pred->update = last_update;
+  } else if (!strcmp(kind, "stride")) {
+    pred->name = "stride";
+    pred->predict = stride_predict;
+    pred->update = stride_update;
+  } else if (!strcmp(kind, "context")) {
+    pred->name = "context";
+    pred->predict = context_predict;
+    pred->update = context_update;
+  } else {
+    free(pred);
+    return NULL;
+  }
+  /* Tags start out invalid, pcs are never negative */
+  for (int i = 0; i < VPRED_TABLE; ++i) {
+    pred->table[i].pc = -1;
+  }
+  return pred;
+}
+
+APEX_VPred*
+APEX_vpred_init(void)
+{
+  APEX_VPred* vpred = calloc(1, sizeof(*vpred));
+  if (vpred) {
+    memset(vpred->used, 0xff, sizeof(vpred->used));
+    vpred->written_back = -1;
+  }
+  return vpred;
+}
+
+/*
+ * Selects the LOAD value predictor: none, last, stride or context
+ */
+int
+APEX_vpred_set_value(APEX_VPred* vpred, const char* kind)
+{
+  APEX_Predictor* pred = NULL;
+  if (strcmp(kind, "none") && !(pred = create_predictor(kind))) {
+    return -1;
+  }
+  free(vpred->value);
+  vpred->value = pred;
+  return 0;
+}
+
+/*
+ * Selects the LOAD address predictor: none or stride
+ */
+int
+APEX_vpred_set_address(APEX_VPred* vpred, const char* kind)
+{
+  APEX_Predictor* pred = NULL;
+  if (strcmp(kind, "none") &&
+      (strcmp(kind, "stride") || !(pred = create_predictor(kind)))) {
+    return -1;
+  }
+  free(vpred->address);
+  vpred->address = pred;
+  return 0;
+}
+
+/*
+ * Called by decode for a LOAD, looks up both predictors. Statistics are
+ * only kept where a prediction is validated, LOADs on a squashed path do
+ * not count.
+ */
+void
+APEX_vpred_decode_load(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_VPred* vpred = cpu->vpred;
+
+  stage->vp_id = vpred->next_id++;
+  stage->vp_valid = 0;
+  stage->ap_valid = 0;
+  stage->ap_hit = 0;
+
+  if (vpred->value) {
+    stage->vp_valid =
+      vpred->value->predict(vpred->value, stage->pc, &stage->vp_value);
+  }
+  if (vpred->address) {
+    stage->ap_valid =
+      vpred->address->predict(vpred->address, stage->pc, &stage->ap_address);
+    stage->ap_cycle = cpu->clock;
+  }
+}
+
+/*
+ * Returns the in-flight LOAD which writes reg for the instruction in
+ * decode stage s, NULL if reg is not written by a LOAD in flight. Latches
+ * are searched from the youngest on. Later stages already ran this cycle,
+ * so the writeback latch holds the LOAD writing back next cycle, or a stale
+ * copy of the one which just did.
+ */
+CPU_Stage*
+APEX_vpred_producer(APEX_CPU* cpu, int s, int reg)
+{
+  for (int i = s + 1; i < cpu->num_stages; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    if (stage->busy || stage->rd != reg) {
+      continue;
+    }
+    if (strcmp(stage->opcode, "LOAD") == 0) {
+      return stage->vp_id > cpu->vpred->written_back ? stage : NULL;
+    }
+    if (strcmp(stage->opcode, "MOVC") == 0 ||
+        strcmp(stage->opcode, "ADDL") == 0 ||
+        strcmp(stage->opcode, "SUB") == 0) {
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Records that a consumer issued with the predicted value of producer
+ */
+void
+APEX_vpred_use(APEX_CPU* cpu, CPU_Stage* producer)
+{
+  cpu->vpred->used[producer->vp_id % VPRED_USED] = producer->vp_id;
+  cpu->vpred->speculated++;
+}
+
+/*
+ * Called by the last execute stage once the address of a LOAD is known
+ */
+void
+APEX_vpred_check_address(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_VPred* vpred = cpu->vpred;
+
+  if (!vpred->address) {
+    return;
+  }
+  stage->ap_hit = stage->ap_valid && stage->ap_address == stage->mem_address;
+  vpred->address_stats.lookups++;
+  vpred->address_stats.predicted += stage->ap_valid;
+  vpred->address_stats.correct += stage->ap_hit;
+  vpred->address->update(vpred->address, stage->pc, stage->mem_address);
+}
+
+/*
+ * Called by writeback for a LOAD, returns 1 if a consumer used a wrong
+ * predicted value and everything behind the LOAD has to be flushed
+ */
+int
+APEX_vpred_validate(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_VPred* vpred = cpu->vpred;
+
+  vpred->written_back = stage->vp_id;
+  if (!vpred->value) {
+    return 0;
+  }
+  vpred->value->update(vpred->value, stage->pc, stage->buffer);
+  vpred->value_stats.lookups++;
+  if (!stage->vp_valid) {
+    return 0;
+  }
+  vpred->value_stats.predicted++;
+  if (stage->vp_value == stage->buffer) {
+    vpred->value_stats.correct++;
+    return 0;
+  }
+  if (vpred->used[stage->vp_id % VPRED_USED] != stage->vp_id) {
+    return 0;
+  }
+  vpred->flushes++;
+  return 1;
+}
+
+static double
+percent(long part, long whole)
+{
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void
+report_predictor(FILE* out, const char* role, APEX_Predictor* pred,
+                 Pred_Stats* stats)
+{
+  fprintf(out,
+          "APEX_VPRED : %s %s: %ld loads, %ld predicted (%.2f%% coverage), "
+          "%ld correct (%.2f%% accuracy)\n",
+          role, pred ? pred->name : "none", stats->lookups, stats->predicted,
+          percent(stats->predicted, stats->lookups), stats->correct,
+          percent(stats->correct, stats->predicted));
+}
+
+void
+APEX_vpred_report(APEX_CPU* cpu, FILE* out)
+{
+  APEX_VPred* vpred = cpu->vpred;
+
+  report_predictor(out, "value", vpred->value, &vpred->value_stats);
+  if (vpred->address) {
+    report_predictor(out, "address", vpred->address, &vpred->address_stats);
+  }
+  fprintf(out,
+          "APEX_VPRED : %ld consumers speculated, %ld flushes, %ld load-use "
+          "interlock cycles, IPC %.4f (%d instructions in %d cycles)\n",
+          vpred->speculated, vpred->flushes, vpred->interlock_cycles,
+          cpu->clock ? (double)cpu->ins_completed / cpu->clock : 0.0,
+          cpu->ins_completed, cpu->clock);
+}
+
+void
+APEX_vpred_free(APEX_VPred* vpred)
+{
+  if (vpred) {
+    free(vpred->value);
+    free(vpred->address);
+    free(vpred);
+  }
+}
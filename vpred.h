@@ -0,0 +1,107 @@
+#ifndef _APEX_VPRED_H_
+#define _APEX_VPRED_H_
+/**
+ *  vpred.h
+ *  Contains the value and address prediction framework.
+ *
+ *  Enabling it adds a load-use interlock to decode: ADDL and JUMP wait
+ *  while the LOAD producing their source register is in flight. A LOAD
+ *  whose value predictor is confident lets them issue with the predicted
+ *  value instead; writeback validates the prediction and, if a consumer
+ *  used a wrong one, flushes everything behind the LOAD and refetches.
+ *
+ *  The address predictor guesses mem_address of a LOAD in decode and is
+ *  validated in the last execute stage. With a load/store queue a correct
+ *  guess lets the LOAD access memory from decode on.
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define VPRED_TABLE 256
+#define VPRED_CONTEXT_TABLE 1024
+#define VPRED_USED 64
+
+/* Table entry of a per pc predictor */
+typedef struct Pred_Entry
+{
+  int pc;
+  int last;
+  int stride;
+  int confidence;     // 2 bit, predictions are made at 2 and above
+  int history[2];     // Last values, for the context predictor
+} Pred_Entry;
+
+/* Interface of a predictor, new kinds plug in by filling it */
+typedef struct APEX_Predictor
+{
+  const char* name;
+
+  /* Returns 1 and sets *value if confident for pc */
+  int (*predict)(struct APEX_Predictor* pred, int pc, int* value);
+  /* Trains with the actual value at pc */
+  void (*update)(struct APEX_Predictor* pred, int pc, int value);
+
+  Pred_Entry table[VPRED_TABLE];
+
+  /* Second level of the context predictor */
+  int context_value[VPRED_CONTEXT_TABLE];
+  int context_confidence[VPRED_CONTEXT_TABLE];
+} APEX_Predictor;
+
+typedef struct Pred_Stats
+{
+  long lookups;
+  long predicted;     // Confident lookups
+  long correct;
+} Pred_Stats;
+
+typedef struct APEX_VPred
+{
+  APEX_Predictor* value;    // NULL: interlock only, the baseline
+  APEX_Predictor* address;  // NULL: no address prediction
+
+  Pred_Stats value_stats;
+  Pred_Stats address_stats;
+
+  /* LOADs are numbered in decode, consumers mark the ones they used */
+  long next_id;
+  long used[VPRED_USED];
+  long written_back;        // Youngest LOAD past writeback
+
+  long speculated;          // Consumers issued with a predicted value
+  long flushes;
+  long interlock_cycles;    // Decode waited for a LOAD
+} APEX_VPred;
+
+APEX_VPred*
+APEX_vpred_init(void);
+
+int
+APEX_vpred_set_value(APEX_VPred* vpred, const char* kind);
+
+int
+APEX_vpred_set_address(APEX_VPred* vpred, const char* kind);
+
+void
+APEX_vpred_decode_load(APEX_CPU* cpu, CPU_Stage* stage);
+
+CPU_Stage*
+APEX_vpred_producer(APEX_CPU* cpu, int s, int reg);
+
+void
+APEX_vpred_use(APEX_CPU* cpu, CPU_Stage* producer);
+
+void
+APEX_vpred_check_address(APEX_CPU* cpu, CPU_Stage* stage);
+
+int
+APEX_vpred_validate(APEX_CPU* cpu, CPU_Stage* stage);
+
+void
+APEX_vpred_report(APEX_CPU* cpu, FILE* out);
+
+void
+APEX_vpred_free(APEX_VPred* vpred);
+
+#endif